@@ -0,0 +1,283 @@
+/*
+ * MVL Stereo Processor: tar archive writer
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "archive_writer.h"
+#include "debug.h"
+#include "utils.h"
+
+#include <cstring>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// POSIX (ustar) header block
+static const int tarBlockSize = 512;
+
+struct TarHeader {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char padding[12];
+};
+
+static void writeOctal (char *field, int length, qint64 value)
+{
+    // Zero-padded octal, terminated by NUL
+    QByteArray digits = QByteArray::number(value, 8).rightJustified(length - 1, '0');
+    if (digits.size() > length - 1) {
+        throw QString("Value %1 does not fit into tar header field").arg(value);
+    }
+    memcpy(field, digits.constData(), length - 1);
+    field[length - 1] = 0;
+}
+
+static void fillTarHeader (TarHeader &header, const QString &name, qint64 size)
+{
+    memset(&header, 0, sizeof(header));
+
+    // Names longer than 100 characters are split into prefix and name
+    // at a directory separator
+    QByteArray encodedName = name.toUtf8();
+    QByteArray encodedPrefix;
+
+    if (encodedName.size() > 100) {
+        int split = encodedName.lastIndexOf('/', 155);
+        if (split <= 0 || encodedName.size() - split - 1 > 100) {
+            throw QString("Archive member name too long: '%1'").arg(name);
+        }
+        encodedPrefix = encodedName.left(split);
+        encodedName = encodedName.mid(split + 1);
+    }
+
+    memcpy(header.name, encodedName.constData(), encodedName.size());
+    memcpy(header.prefix, encodedPrefix.constData(), encodedPrefix.size());
+
+    writeOctal(header.mode, sizeof(header.mode), 0644);
+    writeOctal(header.uid, sizeof(header.uid), 0);
+    writeOctal(header.gid, sizeof(header.gid), 0);
+    writeOctal(header.size, sizeof(header.size), size);
+    writeOctal(header.mtime, sizeof(header.mtime), QDateTime::currentMSecsSinceEpoch() / 1000);
+    header.typeflag = '0';
+    memcpy(header.magic, "ustar", 6);
+    memcpy(header.version, "00", 2);
+
+    // Checksum is computed with checksum field set to spaces
+    memset(header.checksum, ' ', sizeof(header.checksum));
+
+    unsigned int checksum = 0;
+    const unsigned char *bytes = reinterpret_cast<const unsigned char *>(&header);
+    for (size_t i = 0; i < sizeof(header); i++) {
+        checksum += bytes[i];
+    }
+
+    writeOctal(header.checksum, 7, checksum);
+    header.checksum[7] = ' ';
+}
+
+
+ArchiveWriter::ArchiveWriter (const QString &path, qint64 shardSize)
+    : path(path), shardSize(shardSize), shardNumber(-1), shardOffset(0), closed(false)
+{
+    static_assert(sizeof(TarHeader) == tarBlockSize, "Invalid tar header size");
+
+    Utils::ensureParentDirectoryExists(path);
+
+    // Index is written as members are appended
+    indexFile.setFileName(path + ".index");
+    if (!indexFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        throw QString("Failed to create archive index '%1': %2").arg(indexFile.fileName()).arg(indexFile.errorString());
+    }
+}
+
+ArchiveWriter::~ArchiveWriter ()
+{
+    try {
+        close();
+    } catch (const QString &error) {
+        qCWarning(mvlStereoProcessor) << "Failed to close archive" << path << ":" << error;
+    }
+}
+
+
+const QString &ArchiveWriter::getPath () const
+{
+    return path;
+}
+
+QString ArchiveWriter::getShardFilename (int shard) const
+{
+    return getShardFilename(path, shardSize, shard);
+}
+
+QString ArchiveWriter::getShardFilename (const QString &path, qint64 shardSize, int shard)
+{
+    // Single archive, or numbered shards (out.tar -> out-00000.tar)
+    if (shardSize <= 0) {
+        return path;
+    }
+
+    QString suffix = QFileInfo(path).suffix();
+    QString base = suffix.isEmpty() ? path : path.left(path.size() - suffix.size() - 1);
+
+    return QString("%1-%2%3").arg(base).arg(shard, 5, 10, QChar('0')).arg(suffix.isEmpty() ? QString() : "." + suffix);
+}
+
+
+// *********************************************************************
+// *                              Shards                               *
+// *********************************************************************
+void ArchiveWriter::openShard ()
+{
+    shardNumber++;
+    shardOffset = 0;
+
+    shardFile.setFileName(getShardFilename(shardNumber));
+    if (!shardFile.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        throw QString("Failed to create archive '%1': %2").arg(shardFile.fileName()).arg(shardFile.errorString());
+    }
+
+    qCDebug(mvlStereoProcessor) << "Started archive shard" << shardFile.fileName();
+}
+
+void ArchiveWriter::finalizeShard ()
+{
+    if (!shardFile.isOpen()) {
+        return;
+    }
+
+    // End-of-archive marker; two zero blocks
+    QByteArray marker(2*tarBlockSize, 0);
+    if (shardFile.write(marker) != marker.size()) {
+        throw QString("Failed to write archive '%1': %2").arg(shardFile.fileName()).arg(shardFile.errorString());
+    }
+
+    shardFile.close();
+}
+
+
+// *********************************************************************
+// *                             Members                               *
+// *********************************************************************
+void ArchiveWriter::append (const QString &name, const char *data, qint64 size)
+{
+    TarHeader header;
+    fillTarHeader(header, name, size);
+
+    qint64 paddedSize = (size + tarBlockSize - 1) / tarBlockSize * tarBlockSize;
+    static const char padding[tarBlockSize] = { 0 };
+
+    QMutexLocker locker(&mutex);
+
+    if (closed) {
+        throw QString("Archive '%1' is already closed!").arg(path);
+    }
+
+    // Roll over to next shard (but never leave a shard empty)
+    if (shardFile.isOpen() && shardSize > 0 && shardOffset > 0 && shardOffset + tarBlockSize + paddedSize > shardSize) {
+        finalizeShard();
+    }
+    if (!shardFile.isOpen()) {
+        openShard();
+    }
+
+    if (shardFile.write(reinterpret_cast<const char *>(&header), tarBlockSize) != tarBlockSize ||
+        shardFile.write(data, size) != size ||
+        shardFile.write(padding, paddedSize - size) != paddedSize - size) {
+        throw QString("Failed to write archive '%1': %2").arg(shardFile.fileName()).arg(shardFile.errorString());
+    }
+
+    QByteArray entry = QString("%1\t%2\t%3\t%4\n").arg(QFileInfo(shardFile.fileName()).fileName()).arg(name).arg(shardOffset + tarBlockSize).arg(size).toUtf8();
+    if (indexFile.write(entry) != entry.size()) {
+        throw QString("Failed to write archive index '%1': %2").arg(indexFile.fileName()).arg(indexFile.errorString());
+    }
+
+    shardOffset += tarBlockSize + paddedSize;
+}
+
+qint64 ArchiveWriter::getAppendedSize (const QString &path, qint64 shardSize, const QString &name, qint64 size)
+{
+    qint64 paddedSize = (size + tarBlockSize - 1) / tarBlockSize * tarBlockSize;
+
+    // Index entry; data offset is bounded by the shard size, and is
+    // assumed to take ten digits in an unsharded archive
+    QString shardName = QFileInfo(getShardFilename(path, shardSize, 0)).fileName();
+    int offsetDigits = shardSize > 0 ? QString::number(shardSize).size() : 10;
+    qint64 indexSize = QString("%1\t%2\t\t%3\n").arg(shardName).arg(name).arg(size).toUtf8().size() + offsetDigits;
+
+    return tarBlockSize + paddedSize + indexSize;
+}
+
+void ArchiveWriter::close ()
+{
+    QMutexLocker locker(&mutex);
+
+    if (closed) {
+        return;
+    }
+    closed = true;
+
+    finalizeShard();
+    indexFile.close();
+}
+
+
+// *********************************************************************
+// *                             Registry                              *
+// *********************************************************************
+ArchiveRegistry::ArchiveRegistry ()
+{
+}
+
+ArchiveRegistry::~ArchiveRegistry ()
+{
+}
+
+QSharedPointer<ArchiveWriter> ArchiveRegistry::acquire (const QString &path, qint64 shardSize)
+{
+    QString key = QFileInfo(path).absoluteFilePath();
+
+    QMutexLocker locker(&mutex);
+
+    QSharedPointer<ArchiveWriter> archive = archives.value(key).toStrongRef();
+    if (!archive) {
+        archive = QSharedPointer<ArchiveWriter>(new ArchiveWriter(path, shardSize));
+        archives.insert(key, archive);
+    }
+
+    return archive;
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,100 @@
+/*
+ * MVL Stereo Processor: tar archive writer
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__ARCHIVE_WRITER_H
+#define MVL_STEREO_PROCESSOR__ARCHIVE_WRITER_H
+
+#include <QtCore>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Streaming writer of (optionally sharded) tar archives. Members are
+// appended in the order in which they arrive, from any thread; once a
+// shard exceeds the size limit, it is finalized and the next one is
+// started. Each member is also recorded in a tab-separated index file
+// (shard, member name, data offset, size), which allows random access
+// without scanning the archive.
+//
+// Archives are shared between all sinks of a run that target the same
+// path; use ArchiveRegistry::acquire() to obtain the writer for the
+// given path.
+class ArchiveWriter
+{
+public:
+    ArchiveWriter (const QString &path, qint64 shardSize);
+    virtual ~ArchiveWriter ();
+
+    void append (const QString &name, const char *data, qint64 size);
+    void close ();
+
+    const QString &getPath () const;
+
+    // Number of bytes that appending a member of given name and size
+    // adds to the archive and its index (header and padding included;
+    // the offset in the index entry is approximated)
+    static qint64 getAppendedSize (const QString &path, qint64 shardSize, const QString &name, qint64 size);
+
+protected:
+    QString getShardFilename (int shard) const;
+    static QString getShardFilename (const QString &path, qint64 shardSize, int shard);
+
+    void openShard ();
+    void finalizeShard ();
+
+protected:
+    QString path;
+    qint64 shardSize;
+
+    QMutex mutex;
+
+    QFile shardFile;
+    int shardNumber;
+    qint64 shardOffset;
+
+    QFile indexFile;
+
+    bool closed;
+};
+
+
+// Archives opened by the sinks of a single run (i.e., a processor
+// instance); each run has its own registry, so that concurrent runs in
+// server mode never share (and close) each other's writers
+class ArchiveRegistry
+{
+public:
+    ArchiveRegistry ();
+    virtual ~ArchiveRegistry ();
+
+    QSharedPointer<ArchiveWriter> acquire (const QString &path, qint64 shardSize);
+
+protected:
+    QMutex mutex;
+    QHash<QString, QWeakPointer<ArchiveWriter>> archives;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
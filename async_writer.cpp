@@ -0,0 +1,125 @@
+/*
+ * MVL Stereo Processor: asynchronous output writer
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "async_writer.h"
+#include "thread_budget.h"
+#include "utils.h"
+
+#include <opencv2/core.hpp>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+AsyncWriter::AsyncWriter (QThreadPool *threadPool, const QList<int> &cores, int maxPending)
+    : threadPool(threadPool), cores(cores), freeSlots(maxPending), numPending(0)
+{
+}
+
+AsyncWriter::~AsyncWriter ()
+{
+    // Wait for pending tasks; errors at this point cannot be reported
+    // anymore
+    QMutexLocker locker(&mutex);
+    while (numPending > 0) {
+        allDone.wait(&mutex);
+    }
+}
+
+
+void AsyncWriter::submit (const std::function<void ()> &task)
+{
+    checkError();
+
+    freeSlots.acquire();
+
+    mutex.lock();
+    numPending++;
+    mutex.unlock();
+
+    Utils::runInThreadPool(threadPool, [this, task] () mutable {
+        runTask(task);
+    });
+}
+
+void AsyncWriter::waitForDone ()
+{
+    mutex.lock();
+    while (numPending > 0) {
+        allDone.wait(&mutex);
+    }
+    mutex.unlock();
+
+    checkError();
+}
+
+int AsyncWriter::getNumPending () const
+{
+    QMutexLocker locker(&mutex);
+    return numPending;
+}
+
+
+void AsyncWriter::runTask (std::function<void ()> &task)
+{
+    ThreadBudget::pinCurrentThread(cores);
+
+    QString taskError;
+
+    try {
+        task();
+    } catch (const QString &e) {
+        taskError = e;
+    } catch (const cv::Exception &e) {
+        taskError = QString::fromStdString(e.what());
+    } catch (const std::exception &e) {
+        taskError = QString::fromStdString(e.what());
+    }
+
+    // Release the task's captured state (e.g., frame data and its memory
+    // reservation) before the task is reported as done, so that it is
+    // gone once waitForDone() returns
+    task = std::function<void ()>();
+
+    QMutexLocker locker(&mutex);
+
+    if (!taskError.isEmpty() && error.isEmpty()) {
+        error = taskError;
+    }
+
+    numPending--;
+    freeSlots.release();
+    allDone.wakeAll();
+}
+
+void AsyncWriter::checkError ()
+{
+    QMutexLocker locker(&mutex);
+
+    if (!error.isEmpty()) {
+        QString e = error;
+        error.clear();
+        throw e;
+    }
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,69 @@
+/*
+ * MVL Stereo Processor: asynchronous output writer
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__ASYNC_WRITER_H
+#define MVL_STEREO_PROCESSOR__ASYNC_WRITER_H
+
+#include <QtCore>
+
+#include <functional>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Runs output-writing tasks on a thread pool, so that encoding and disk
+// I/O overlap with processing of subsequent frames. The number of pending
+// tasks is bounded; submit() blocks when the limit is reached. The first
+// error raised by a task is re-thrown by the next call to submit() or
+// waitForDone().
+class AsyncWriter
+{
+public:
+    AsyncWriter (QThreadPool *threadPool, const QList<int> &cores, int maxPending);
+    virtual ~AsyncWriter ();
+
+    void submit (const std::function<void ()> &task);
+    void waitForDone ();
+
+    int getNumPending () const;
+
+protected:
+    void runTask (std::function<void ()> &task);
+    void checkError ();
+
+protected:
+    QThreadPool *threadPool;
+    QList<int> cores;
+
+    QSemaphore freeSlots;
+
+    mutable QMutex mutex;
+    QWaitCondition allDone;
+    int numPending;
+    QString error;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
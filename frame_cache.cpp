@@ -0,0 +1,317 @@
+/*
+ * MVL Stereo Processor: on-disk frame cache
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "frame_cache.h"
+#include "debug.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/types.h>
+#include <utime.h>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Entry file header
+static const char entryMagic[8] = { 'M', 'V', 'L', 'F', 'C', 'A', 'C', '1' };
+
+struct EntryHeader {
+    char magic[8];
+    qint32 rows[2];
+    qint32 cols[2];
+    qint32 type[2];
+};
+
+
+FrameCache::FrameCache (const QString &directory, qint64 maxSize)
+    : directory(directory), maxSize(maxSize), totalSize(0), numHits(0), numMisses(0)
+{
+    if (!QDir().mkpath(directory)) {
+        throw QString("Failed to create frame cache directory '%1'").arg(directory);
+    }
+
+    scanDirectory();
+}
+
+FrameCache::~FrameCache ()
+{
+}
+
+
+// *********************************************************************
+// *                               Keys                                *
+// *********************************************************************
+QString FrameCache::makeKey (const QStringList &components)
+{
+    return QString::fromLatin1(QCryptographicHash::hash(components.join('\n').toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+QString FrameCache::hashFileContents (const QString &filename)
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw QString("Failed to open file '%1' for hashing").arg(filename);
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(&file);
+
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString FrameCache::getEntryFilename (const QString &key) const
+{
+    // Two-level layout, to keep directories reasonably small
+    return QString("%1/%2/%3.frame").arg(directory).arg(key.left(2)).arg(key);
+}
+
+
+// *********************************************************************
+// *                          Lookup and store                         *
+// *********************************************************************
+bool FrameCache::lookup (const QString &key, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    QString filename = getEntryFilename(key);
+
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMutexLocker locker(&mutex);
+        numMisses++;
+        return false;
+    }
+
+    // Truncated entry
+    if (file.size() < static_cast<qint64>(sizeof(EntryHeader))) {
+        file.close();
+        removeInvalidEntry(key, filename);
+        return false;
+    }
+
+    // Images are read straight into their matrices; a mapping would
+    // have to be copied out anyway, as the entry may be evicted (and
+    // its file removed) while the images are still in use
+    EntryHeader header;
+    bool valid = file.read(reinterpret_cast<char *>(&header), sizeof(header)) == static_cast<qint64>(sizeof(header)) &&
+                 memcmp(header.magic, entryMagic, sizeof(entryMagic)) == 0;
+
+    // Validate the header (dimensions, type, and the size of the data
+    // against the size of the file) before allocating anything, as the
+    // file may be truncated or corrupted
+    qint64 offset = sizeof(EntryHeader);
+    for (int i = 0; i < 2 && valid; i++) {
+        int type = header.type[i];
+        if (header.rows[i] <= 0 || header.cols[i] <= 0 || type < 0 || type != CV_MAT_TYPE(type) || CV_MAT_DEPTH(type) > CV_64F) {
+            valid = false;
+            break;
+        }
+
+        // Checked by division, so that garbage cannot overflow
+        qint64 rowSize = static_cast<qint64>(header.cols[i]) * CV_ELEM_SIZE(type);
+        if (header.rows[i] > (file.size() - offset) / rowSize) {
+            valid = false;
+            break;
+        }
+        offset += header.rows[i] * rowSize;
+    }
+    if (offset != file.size()) {
+        valid = false;
+    }
+
+    cv::Mat images[2];
+
+    try {
+        for (int i = 0; i < 2 && valid; i++) {
+            cv::Mat image(header.rows[i], header.cols[i], header.type[i]);
+            qint64 size = static_cast<qint64>(image.total() * image.elemSize());
+
+            if (file.read(reinterpret_cast<char *>(image.data), size) != size) {
+                valid = false;
+                break;
+            }
+
+            images[i] = image;
+        }
+    } catch (const cv::Exception &error) {
+        qCWarning(mvlStereoProcessor) << "Failed to read frame cache entry" << filename << ":" << error.what();
+        valid = false;
+    }
+
+    file.close();
+
+    if (!valid) {
+        removeInvalidEntry(key, filename);
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    imageLeft = images[0];
+    imageRight = images[1];
+
+    // Update last-use time, both in index and on disk (for subsequent runs)
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        it->lastUse = QDateTime::currentMSecsSinceEpoch();
+    }
+    ::utime(QFile::encodeName(filename).constData(), 0);
+
+    numHits++;
+
+    return true;
+}
+
+void FrameCache::store (const QString &key, const cv::Mat &imageLeft, const cv::Mat &imageRight)
+{
+    EntryHeader header;
+    memcpy(header.magic, entryMagic, sizeof(entryMagic));
+
+    const cv::Mat images[2] = { imageLeft.isContinuous() ? imageLeft : imageLeft.clone(), imageRight.isContinuous() ? imageRight : imageRight.clone() };
+
+    qint64 size = sizeof(EntryHeader);
+    for (int i = 0; i < 2; i++) {
+        header.rows[i] = images[i].rows;
+        header.cols[i] = images[i].cols;
+        header.type[i] = images[i].type();
+        size += images[i].total() * images[i].elemSize();
+    }
+
+    if (size > maxSize) {
+        return;
+    }
+
+    evict(size);
+
+    // Write to temporary file and rename it, so that concurrent readers
+    // never observe partial entries
+    QString filename = getEntryFilename(key);
+    QDir().mkpath(QFileInfo(filename).absolutePath());
+
+    QSaveFile file(filename);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(mvlStereoProcessor) << "Failed to create frame cache entry" << filename;
+        return;
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (int i = 0; i < 2; i++) {
+        file.write(reinterpret_cast<const char *>(images[i].data), images[i].total() * images[i].elemSize());
+    }
+
+    if (!file.commit()) {
+        qCWarning(mvlStereoProcessor) << "Failed to write frame cache entry" << filename;
+        return;
+    }
+
+    QMutexLocker locker(&mutex);
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        totalSize -= it->size;
+    }
+    entries[key] = Entry({ size, QDateTime::currentMSecsSinceEpoch() });
+    totalSize += size;
+}
+
+
+void FrameCache::removeInvalidEntry (const QString &key, const QString &filename)
+{
+    // Invalid entries are removed, and count as misses (the entry is
+    // then stored anew)
+    QMutexLocker locker(&mutex);
+
+    qCDebug(mvlStereoProcessor) << "Removing invalid frame cache entry" << filename;
+    QFile::remove(filename);
+
+    auto it = entries.find(key);
+    if (it != entries.end()) {
+        totalSize -= it->size;
+        entries.erase(it);
+    }
+
+    numMisses++;
+}
+
+
+int FrameCache::getNumHits () const
+{
+    QMutexLocker locker(&mutex);
+    return numHits;
+}
+
+int FrameCache::getNumMisses () const
+{
+    QMutexLocker locker(&mutex);
+    return numMisses;
+}
+
+
+// *********************************************************************
+// *                          LRU eviction                             *
+// *********************************************************************
+void FrameCache::scanDirectory ()
+{
+    QDirIterator it(directory, QStringList() << "*.frame", QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        it.next();
+
+        QFileInfo info = it.fileInfo();
+        entries[info.completeBaseName()] = Entry({ info.size(), info.lastModified().toMSecsSinceEpoch() });
+        totalSize += info.size();
+    }
+
+    qCInfo(mvlStereoProcessor) << "Frame cache:" << entries.size() << "entries," << totalSize / (1024*1024) << "MB out of" << maxSize / (1024*1024) << "MB";
+}
+
+void FrameCache::evict (qint64 requiredSize)
+{
+    QMutexLocker locker(&mutex);
+
+    if (totalSize + requiredSize <= maxSize) {
+        return;
+    }
+
+    // Sort entries by last use, and remove the oldest ones until there
+    // is enough room
+    QList<QPair<qint64, QString>> order;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        order.append(qMakePair(it->lastUse, it.key()));
+    }
+    std::sort(order.begin(), order.end());
+
+    int numEvicted = 0;
+    for (const QPair<qint64, QString> &entry : order) {
+        if (totalSize + requiredSize <= maxSize) {
+            break;
+        }
+
+        QFile::remove(getEntryFilename(entry.second));
+        totalSize -= entries.value(entry.second).size;
+        entries.remove(entry.second);
+        numEvicted++;
+    }
+
+    qCDebug(mvlStereoProcessor) << "Frame cache: evicted" << numEvicted << "entries";
+}
+
+
+} // StereoProcessor
+} // MVL
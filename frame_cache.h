@@ -0,0 +1,81 @@
+/*
+ * MVL Stereo Processor: on-disk frame cache
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__FRAME_CACHE_H
+#define MVL_STEREO_PROCESSOR__FRAME_CACHE_H
+
+#include <QtCore>
+#include <opencv2/core.hpp>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// On-disk cache of image pairs (decoded or rectified frames), shared
+// between runs. Each pair is stored in its own file, in raw format that
+// is read straight into the images; entries are keyed by a content hash built
+// by the caller, and the least-recently used entries are evicted when
+// the cache exceeds its size limit.
+class FrameCache
+{
+public:
+    FrameCache (const QString &directory, qint64 maxSize);
+    virtual ~FrameCache ();
+
+    bool lookup (const QString &key, cv::Mat &imageLeft, cv::Mat &imageRight);
+    void store (const QString &key, const cv::Mat &imageLeft, const cv::Mat &imageRight);
+
+    int getNumHits () const;
+    int getNumMisses () const;
+
+    // Key helpers
+    static QString makeKey (const QStringList &components);
+    static QString hashFileContents (const QString &filename);
+
+protected:
+    QString getEntryFilename (const QString &key) const;
+    void removeInvalidEntry (const QString &key, const QString &filename);
+
+    void scanDirectory ();
+    void evict (qint64 requiredSize);
+
+protected:
+    QString directory;
+    qint64 maxSize;
+
+    mutable QMutex mutex;
+
+    struct Entry {
+        qint64 size;
+        qint64 lastUse;
+    };
+    QHash<QString, Entry> entries;
+    qint64 totalSize;
+
+    int numHits;
+    int numMisses;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
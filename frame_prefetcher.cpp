@@ -0,0 +1,282 @@
+/*
+ * MVL Stereo Processor: frame prefetcher
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "frame_prefetcher.h"
+#include "frame_cache.h"
+#include "source.h"
+#include "thread_budget.h"
+#include "utils.h"
+
+#include <algorithm>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+FramePrefetcher::FramePrefetcher (Source *source, QThreadPool *threadPool, const QList<int> &cores, int numWorkers, int depth, bool fetchColor)
+    : source(source),
+      threadPool(threadPool),
+      cores(cores),
+      numWorkers(source->supportsConcurrentAccess() ? std::max(1, numWorkers) : 1),
+      depth(std::max(0, depth)),
+      fetchColor(fetchColor),
+      frameCache(0),
+      memoryBudget(0),
+      rangeStep(1),
+      rangeLast(-1),
+      nextToFetch(0),
+      nextToReturn(0),
+      stopRequested(false),
+      reservationPending(false),
+      numActiveTasks(0)
+{
+}
+
+FramePrefetcher::~FramePrefetcher ()
+{
+    stop();
+}
+
+
+void FramePrefetcher::start (int first, int last, int step)
+{
+    stop();
+
+    QMutexLocker locker(&mutex);
+
+    rangeStep = step;
+    rangeLast = last;
+    nextToFetch = first;
+    nextToReturn = first;
+    stopRequested = false;
+    reservationPending = false;
+    readyFrames.clear();
+
+    if (depth == 0) {
+        return;
+    }
+
+    scheduleFetches();
+}
+
+void FramePrefetcher::stop ()
+{
+    QMutexLocker locker(&mutex);
+
+    stopRequested = true;
+    stateChanged.wakeAll();
+
+    while (numActiveTasks > 0) {
+        stateChanged.wait(&mutex);
+    }
+
+    readyFrames.clear();
+}
+
+int FramePrefetcher::getNumReady () const
+{
+    QMutexLocker locker(&mutex);
+    return readyFrames.size();
+}
+
+
+void FramePrefetcher::setFrameCache (FrameCache *cache, const QString &keyBase)
+{
+    frameCache = cache;
+    frameCacheKeyBase = keyBase;
+}
+
+void FramePrefetcher::setMemoryBudget (MemoryBudget *budget)
+{
+    memoryBudget = budget;
+}
+
+
+bool FramePrefetcher::next (Frame &frame)
+{
+    QMutexLocker locker(&mutex);
+
+    // Pull-through mode; fetch the frame on the calling thread
+    if (depth == 0) {
+        if (rangeLast >= 0 && nextToReturn > rangeLast) {
+            return false;
+        }
+
+        frame = Frame();
+        frame.number = nextToReturn;
+        nextToReturn += rangeStep;
+
+        locker.unlock();
+        frame.reservation = reserveFrame();
+        fetchFrame(frame);
+        locker.relock();
+
+        if (frame.failed && (rangeLast < 0 || frame.number < rangeLast)) {
+            rangeLast = frame.number;
+        }
+
+        return true;
+    }
+
+    for (;;) {
+        if (rangeLast >= 0 && nextToReturn > rangeLast) {
+            return false;
+        }
+
+        auto it = readyFrames.find(nextToReturn);
+        if (it != readyFrames.end()) {
+            frame = it.value();
+            readyFrames.erase(it);
+
+            nextToReturn += rangeStep;
+            scheduleFetches();
+
+            return true;
+        }
+
+        // Reservations are released by other threads (writers), which
+        // do not signal us; if admission of a frame is pending, poll
+        if (reservationPending) {
+            stateChanged.wait(&mutex, 10);
+            scheduleFetches();
+        } else {
+            stateChanged.wait(&mutex);
+        }
+    }
+}
+
+
+void FramePrefetcher::scheduleFetches ()
+{
+    reservationPending = false;
+
+    while (!stopRequested && numActiveTasks < numWorkers && (rangeLast < 0 || nextToFetch <= rangeLast) && (nextToFetch - nextToReturn) / rangeStep < depth) {
+        // Frames are admitted in order, so the frame that is waited for
+        // is never blocked by later ones
+        QSharedPointer<MemoryBudget::Reservation> reservation;
+        if (memoryBudget) {
+            reservation = memoryBudget->tryReserveFrame();
+            if (!reservation) {
+                reservationPending = true;
+                return;
+            }
+        }
+
+        Frame frame;
+        frame.number = nextToFetch;
+        frame.reservation = reservation;
+        nextToFetch += rangeStep;
+
+        numActiveTasks++;
+        Utils::runInThreadPool(threadPool, [this, frame] () {
+            fetchTask(frame);
+        });
+    }
+}
+
+void FramePrefetcher::fetchTask (Frame frame)
+{
+    ThreadBudget::pinCurrentThread(cores);
+
+    fetchFrame(frame);
+
+    QMutexLocker locker(&mutex);
+
+    // A failed frame ends an open-ended range; frames beyond it are
+    // not fetched (and those already fetched are not returned)
+    if (frame.failed && (rangeLast < 0 || frame.number < rangeLast)) {
+        rangeLast = frame.number;
+    }
+
+    readyFrames.insert(frame.number, frame);
+    numActiveTasks--;
+
+    scheduleFetches();
+    stateChanged.wakeAll();
+}
+
+QSharedPointer<MemoryBudget::Reservation> FramePrefetcher::reserveFrame ()
+{
+    // Blocking reservation for pull-through mode; reservations are
+    // released by writers, which do not signal us, so poll
+    QSharedPointer<MemoryBudget::Reservation> reservation;
+
+    if (memoryBudget) {
+        while (!(reservation = memoryBudget->tryReserveFrame())) {
+            QThread::msleep(10);
+        }
+    }
+
+    return reservation;
+}
+
+void FramePrefetcher::fetchFrame (Frame &frame)
+{
+    frame.timestamp = -1;
+    frame.missing = false;
+    frame.failed = false;
+
+    if (!source->isFrameAvailable(frame.number)) {
+        frame.missing = true;
+        return;
+    }
+
+    try {
+        QString cacheKey;
+        bool cached = false;
+
+        if (frameCache) {
+            cacheKey = FrameCache::makeKey(QStringList() << frameCacheKeyBase << QString::number(frame.number) << source->getFrameIdentity(frame.number));
+            cached = frameCache->lookup(cacheKey, frame.imageLeft, frame.imageRight);
+        }
+
+        if (!cached) {
+            frame.timestamp = source->getFrame(frame.number, frame.imageLeft, frame.imageRight);
+
+            if (frameCache) {
+                frameCache->store(cacheKey, frame.imageLeft, frame.imageRight);
+            }
+        }
+
+        if (fetchColor && source->getGrayscale()) {
+            source->getColorFrame(frame.number, frame.colorLeft, frame.colorRight);
+        } else {
+            frame.colorLeft = frame.imageLeft;
+            frame.colorRight = frame.imageRight;
+        }
+    } catch (const QString &error) {
+        frame.failed = true;
+        frame.error = error;
+    } catch (const cv::Exception &error) {
+        frame.failed = true;
+        frame.error = QString::fromStdString(error.what());
+    }
+
+    // Sources with a growing index (watched image sequences) may find
+    // out only while waiting for it that the frame has been skipped
+    if (frame.failed && !source->isFrameAvailable(frame.number)) {
+        frame.failed = false;
+        frame.missing = true;
+    }
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,141 @@
+/*
+ * MVL Stereo Processor: frame prefetcher
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__FRAME_PREFETCHER_H
+#define MVL_STEREO_PROCESSOR__FRAME_PREFETCHER_H
+
+#include <QtCore>
+#include <opencv2/core.hpp>
+
+#include "memory_budget.h"
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+class FrameCache;
+class Source;
+
+
+// Decodes frames of a range ahead of processing, on the given thread
+// pool. Each frame is decoded by its own task, which returns its thread
+// to the pool once done, so that a pool shared by several jobs is not
+// monopolized by one of them. Up to the given number of frames are
+// decoded at once, but more than one only if the source supports
+// concurrent access; frames are always returned in order. With
+// depth of 0, nothing is prefetched, and frames are pulled straight
+// through from the source by next() (for sources that buffer frames on
+// their own, where prefetching would only add a frame of latency).
+class FramePrefetcher
+{
+public:
+    struct Frame {
+        int number;
+
+        cv::Mat imageLeft;
+        cv::Mat imageRight;
+
+        // Colour images (only in grayscale mode, if requested)
+        cv::Mat colorLeft;
+        cv::Mat colorRight;
+
+        // Acquisition timestamp (-1 if not known)
+        qint64 timestamp;
+
+        // Frame is not available in the source (gap in sequence)
+        bool missing;
+
+        // Retrieval failed; error message
+        bool failed;
+        QString error;
+
+        // Memory reserved for the frame (if memory budget is used)
+        QSharedPointer<MemoryBudget::Reservation> reservation;
+    };
+
+    FramePrefetcher (Source *source, QThreadPool *threadPool, const QList<int> &cores, int numWorkers, int depth, bool fetchColor);
+    virtual ~FramePrefetcher ();
+
+    // Start prefetching frames of the range; last frame of -1 denotes
+    // open-ended range, which ends at the first frame that fails
+    void start (int first, int last, int step);
+
+    // Retrieve next frame in the range; returns false once the range
+    // has been exhausted
+    bool next (Frame &frame);
+
+    void stop ();
+
+    // Number of decoded frames waiting to be processed
+    int getNumReady () const;
+
+    // Look up decoded frames in the given cache before retrieving them
+    // from the source, and store retrieved frames into it; keys are
+    // derived from the given key base, frame number and the frame's
+    // identity in the source
+    void setFrameCache (FrameCache *cache, const QString &keyBase);
+
+    // Admit frames only when the given memory budget allows it
+    void setMemoryBudget (MemoryBudget *budget);
+
+protected:
+    // Submit decode tasks while there are frames to fetch, room in the
+    // queue and free decode slots; called with the mutex held
+    void scheduleFetches ();
+    void fetchTask (Frame frame);
+
+    void fetchFrame (Frame &frame);
+
+    QSharedPointer<MemoryBudget::Reservation> reserveFrame ();
+
+protected:
+    Source *source;
+    QThreadPool *threadPool;
+    QList<int> cores;
+    int numWorkers;
+    int depth;
+    bool fetchColor;
+
+    FrameCache *frameCache;
+    QString frameCacheKeyBase;
+
+    MemoryBudget *memoryBudget;
+
+    mutable QMutex mutex;
+    QWaitCondition stateChanged;
+
+    int rangeStep;
+    int rangeLast;
+    int nextToFetch;
+    int nextToReturn;
+
+    bool stopRequested;
+    bool reservationPending;
+    int numActiveTasks;
+
+    QMap<int, Frame> readyFrames;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
@@ -0,0 +1,140 @@
+/*
+ * MVL Stereo Processor: memory budget
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "memory_budget.h"
+
+#include <algorithm>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// *********************************************************************
+// *                            Reservation                            *
+// *********************************************************************
+MemoryBudget::Reservation::Reservation (MemoryBudget *budget, qint64 size)
+    : budget(budget), size(size)
+{
+}
+
+MemoryBudget::Reservation::~Reservation ()
+{
+    budget->release(size);
+}
+
+void MemoryBudget::Reservation::resize (qint64 newSize)
+{
+    budget->resize(size, newSize);
+    size = newSize;
+}
+
+
+// *********************************************************************
+// *                              Budget                               *
+// *********************************************************************
+MemoryBudget::MemoryBudget (qint64 limit)
+    : limit(limit),
+      used(0),
+      numFrames(0),
+      frameEstimate(-1),
+      peakUsage(0),
+      peakFrames(0)
+{
+}
+
+MemoryBudget::~MemoryBudget ()
+{
+}
+
+
+QSharedPointer<MemoryBudget::Reservation> MemoryBudget::tryReserveFrame ()
+{
+    QMutexLocker locker(&mutex);
+
+    if (numFrames > 0 && (frameEstimate < 0 || used + frameEstimate > limit)) {
+        return QSharedPointer<Reservation>();
+    }
+
+    qint64 size = std::max<qint64>(frameEstimate, 0);
+
+    used += size;
+    numFrames++;
+
+    peakUsage = std::max(peakUsage, used);
+    peakFrames = std::max(peakFrames, numFrames);
+
+    return QSharedPointer<Reservation>(new Reservation(this, size));
+}
+
+void MemoryBudget::updateFrameEstimate (qint64 footprint)
+{
+    QMutexLocker locker(&mutex);
+
+    if (frameEstimate < footprint) {
+        frameEstimate = footprint;
+    } else {
+        frameEstimate = (9*frameEstimate + footprint) / 10;
+    }
+}
+
+
+void MemoryBudget::resize (qint64 oldSize, qint64 newSize)
+{
+    QMutexLocker locker(&mutex);
+
+    used += newSize - oldSize;
+    peakUsage = std::max(peakUsage, used);
+}
+
+void MemoryBudget::release (qint64 size)
+{
+    QMutexLocker locker(&mutex);
+
+    used -= size;
+    numFrames--;
+}
+
+
+qint64 MemoryBudget::getLimit () const
+{
+    return limit;
+}
+
+qint64 MemoryBudget::getFrameEstimate () const
+{
+    QMutexLocker locker(&mutex);
+    return frameEstimate;
+}
+
+qint64 MemoryBudget::getPeakUsage () const
+{
+    QMutexLocker locker(&mutex);
+    return peakUsage;
+}
+
+int MemoryBudget::getPeakFrames () const
+{
+    QMutexLocker locker(&mutex);
+    return peakFrames;
+}
+
+
+} // StereoProcessor
+} // MVL
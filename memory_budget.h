@@ -0,0 +1,97 @@
+/*
+ * MVL Stereo Processor: memory budget
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__MEMORY_BUDGET_H
+#define MVL_STEREO_PROCESSOR__MEMORY_BUDGET_H
+
+#include <QtCore>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Budget of memory used by frames in flight (prefetched, processed, or
+// waiting for their outputs to be written). Each frame reserves its
+// estimated footprint when it is admitted into the pipeline, and holds
+// the reservation until the last of its outputs is written (the
+// reservation is shared by all tasks that use the frame's data).
+//
+// The per-frame footprint is not known in advance; until the first frame
+// is measured, frames are admitted one at a time. Afterwards, the
+// estimate follows the measured footprints (immediately upwards, and
+// slowly downwards), so the number of frames in flight adapts to the
+// budget. A frame is always admitted when nothing is reserved, so that
+// processing can progress even if a single frame exceeds the budget.
+class MemoryBudget
+{
+public:
+    class Reservation
+    {
+    public:
+        Reservation (MemoryBudget *budget, qint64 size);
+        virtual ~Reservation ();
+
+        // Replace the estimate with the actual footprint
+        void resize (qint64 size);
+
+    protected:
+        MemoryBudget *budget;
+        qint64 size;
+    };
+
+    // Limit is given in bytes
+    MemoryBudget (qint64 limit);
+    virtual ~MemoryBudget ();
+
+    // Reserve memory for a frame; returns null if the budget does not
+    // allow another frame at the moment
+    QSharedPointer<Reservation> tryReserveFrame ();
+
+    void updateFrameEstimate (qint64 footprint);
+
+    qint64 getLimit () const;
+    qint64 getFrameEstimate () const;
+    qint64 getPeakUsage () const;
+    int getPeakFrames () const;
+
+protected:
+    void resize (qint64 oldSize, qint64 newSize);
+    void release (qint64 size);
+
+protected:
+    const qint64 limit;
+
+    mutable QMutex mutex;
+    qint64 used;
+    int numFrames;
+
+    // Per-frame footprint estimate; -1 until the first frame is measured
+    qint64 frameEstimate;
+
+    qint64 peakUsage;
+    int peakFrames;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
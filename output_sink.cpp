@@ -0,0 +1,882 @@
+/*
+ * MVL Stereo Processor: output sinks
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "output_sink.h"
+#include "archive_writer.h"
+#include "utils.h"
+
+#include <stereo-pipeline/utils.h>
+
+#include <opencv2/imgcodecs.hpp>
+
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// *********************************************************************
+// *                             Base class                            *
+// *********************************************************************
+OutputSink::OutputSink (Kind kind, const QString &format, int stride)
+    : kind(kind), format(format), stride(stride), archiveShardSize(0), bytesWritten(0)
+{
+}
+
+OutputSink::~OutputSink ()
+{
+}
+
+
+OutputSink::Kind OutputSink::getKind () const
+{
+    return kind;
+}
+
+const QString &OutputSink::getFormat () const
+{
+    return format;
+}
+
+const QString &OutputSink::getArchivePath () const
+{
+    return archivePath;
+}
+
+const QString &OutputSink::getEncoderOptions () const
+{
+    return encoderOptions;
+}
+
+int OutputSink::getStride () const
+{
+    return stride;
+}
+
+bool OutputSink::isActive (int rangeIndex) const
+{
+    return rangeIndex % stride == 0;
+}
+
+qint64 OutputSink::getBytesWritten () const
+{
+    return bytesWritten.load();
+}
+
+bool OutputSink::requiresColor () const
+{
+    return false;
+}
+
+bool OutputSink::usesImageEncoder () const
+{
+    return false;
+}
+
+
+void OutputSink::open ()
+{
+    // Archive is opened only when processing starts, so that validation
+    // (and dry run) do not create any files
+    if (!archivePath.isEmpty()) {
+        if (archiveRegistry) {
+            archive = archiveRegistry->acquire(archivePath, archiveShardSize);
+        } else {
+            archive = QSharedPointer<ArchiveWriter>(new ArchiveWriter(archivePath, archiveShardSize));
+        }
+    }
+}
+
+void OutputSink::close ()
+{
+    if (archive) {
+        archive->close();
+        archive.clear();
+    }
+}
+
+
+QString OutputSink::makeFilename (const QHash<QString, QVariant> &variables) const
+{
+    return Utils::formatString(format, variables);
+}
+
+void OutputSink::ensureDirectoryExists (const QString &filename)
+{
+    QString directory = QFileInfo(filename).absolutePath();
+
+    QMutexLocker locker(&directoryMutex);
+    if (!directories.contains(directory)) {
+        Utils::ensureParentDirectoryExists(filename);
+        directories.insert(directory);
+    }
+}
+
+
+void OutputSink::writeImage (const QString &filename, const cv::Mat &image)
+{
+    try {
+        if (archive) {
+            std::vector<uchar> buffer;
+            if (!cv::imencode("." + QFileInfo(filename).suffix().toStdString(), image, buffer, encoderParameters)) {
+                throw QString("Failed to encode output image '%1'").arg(filename);
+            }
+            archive->append(filename, reinterpret_cast<const char *>(buffer.data()), buffer.size());
+            addBytesWritten(buffer.size());
+        } else {
+            ensureDirectoryExists(filename);
+            if (!cv::imwrite(filename.toStdString(), image, encoderParameters)) {
+                throw QString("Failed to write output image '%1'").arg(filename);
+            }
+            addBytesWritten(QFileInfo(filename).size());
+        }
+    } catch (const cv::Exception &error) {
+        throw QString("Failed to save image %1: %2").arg(filename).arg(QString::fromStdString(error.what()));
+    }
+}
+
+void OutputSink::writeViaFile (const QString &filename, const std::function<void (const QString &)> &writer)
+{
+    if (!archive) {
+        ensureDirectoryExists(filename);
+        writer(filename);
+        addBytesWritten(QFileInfo(filename).size());
+        return;
+    }
+
+    // Temporary file keeps the suffix, which may determine the format
+    QTemporaryFile file(QDir::tempPath() + "/mvl-stereo-processor-XXXXXX." + QFileInfo(filename).completeSuffix());
+    if (!file.open()) {
+        throw QString("Failed to create temporary file: %1").arg(file.errorString());
+    }
+    file.close();
+
+    writer(file.fileName());
+
+    if (!file.open()) {
+        throw QString("Failed to read temporary file: %1").arg(file.errorString());
+    }
+    QByteArray data = file.readAll();
+
+    archive->append(filename, data.constData(), data.size());
+    addBytesWritten(data.size());
+}
+
+void OutputSink::writeViaMemoryFile (const QString &filename, const std::function<void (const QString &)> &writer)
+{
+    if (!archive) {
+        ensureDirectoryExists(filename);
+        writer(filename);
+        addBytesWritten(QFileInfo(filename).size());
+        return;
+    }
+
+    // Anonymous memory-backed file, which the writer opens via its
+    // /proc path; nothing touches the disk. Without memfd support, fall
+    // back to a temporary file
+#ifdef HAVE_MEMFD_CREATE
+    int fd = ::memfd_create("mvl-stereo-processor", MFD_CLOEXEC);
+#else
+    int fd = -1;
+#endif
+    if (fd < 0) {
+        writeViaFile(filename, writer);
+        return;
+    }
+
+    QByteArray data;
+    try {
+        writer(QString("/proc/self/fd/%1").arg(fd));
+
+        struct stat info;
+        if (::fstat(fd, &info) < 0) {
+            throw QString("Failed to query in-memory file: %1").arg(strerror(errno));
+        }
+
+        data.resize(info.st_size);
+        qint64 offset = 0;
+        while (offset < data.size()) {
+            ssize_t n = ::pread(fd, data.data() + offset, data.size() - offset, offset);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                throw QString("Failed to read in-memory file: %1").arg(n < 0 ? strerror(errno) : "unexpected end of file");
+            }
+            offset += n;
+        }
+    } catch (...) {
+        ::close(fd);
+        throw;
+    }
+    ::close(fd);
+
+    archive->append(filename, data.constData(), data.size());
+    addBytesWritten(data.size());
+}
+
+void OutputSink::addBytesWritten (qint64 size)
+{
+    bytesWritten.fetchAndAddRelaxed(size);
+}
+
+
+QString OutputSink::getKindName (Kind kind)
+{
+    switch (kind) {
+        case KindFrames: return "frames";
+        case KindRectified: return "rectified";
+        case KindDisparity: return "disparity";
+        case KindPoints: return "points";
+        case KindDepth: return "depth";
+        case KindStats: return "stats";
+        default: return QString();
+    }
+}
+
+
+// *********************************************************************
+// *                           Image pairs                             *
+// *********************************************************************
+// Input or rectified frames, written with cv::imwrite; %{s} placeholder
+// is substituted by L and R
+class ImagePairSink : public OutputSink
+{
+public:
+    ImagePairSink (Kind kind, const QString &format, int stride)
+        : OutputSink(kind, format, stride)
+    {
+    }
+
+    virtual bool requiresColor () const
+    {
+        return kind == KindFrames;
+    }
+
+    virtual bool usesImageEncoder () const
+    {
+        return true;
+    }
+
+    virtual void write (const OutputFrame &frame)
+    {
+        const cv::Mat &imageLeft = (kind == KindFrames) ? frame.frameLeft : frame.rectifiedLeft;
+        const cv::Mat &imageRight = (kind == KindFrames) ? frame.frameRight : frame.rectifiedRight;
+
+        QHash<QString, QVariant> variables = frame.variables;
+
+        variables["s"] = "L";
+        writeImage(makeFilename(variables), imageLeft);
+
+        variables["s"] = "R";
+        writeImage(makeFilename(variables), imageRight);
+    }
+};
+
+
+// *********************************************************************
+// *                        Raw matrix storage                         *
+// *********************************************************************
+static const cv::Mat &selectMatrix (OutputSink::Kind kind, const OutputFrame &frame)
+{
+    switch (kind) {
+        case OutputSink::KindPoints: return frame.points;
+        case OutputSink::KindDepth: return frame.depth;
+        default: return frame.disparity;
+    }
+}
+
+// Raw matrix in OpenCV storage format (xml, yml, yaml); the node is named
+// after the output kind
+class MatrixStorageSink : public OutputSink
+{
+public:
+    MatrixStorageSink (Kind kind, const QString &format, int stride)
+        : OutputSink(kind, format, stride), nodeName(getKindName(kind).toStdString())
+    {
+    }
+
+    virtual void write (const OutputFrame &frame)
+    {
+        QString filename = makeFilename(frame.variables);
+        const cv::Mat &matrix = selectMatrix(kind, frame);
+
+        if (!archive) {
+            writeViaFile(filename, [this, &filename, &matrix] (const QString &file) {
+                try {
+                    cv::FileStorage fs(file.toStdString(), cv::FileStorage::WRITE);
+                    fs << nodeName << matrix;
+                } catch (const cv::Exception &error) {
+                    throw QString("Failed to save matrix to file %1: %2").arg(filename).arg(QString::fromStdString(error.what()));
+                }
+            });
+            return;
+        }
+
+        // Archive member is serialized into a string; the format is
+        // chosen by the suffix given in place of the filename
+        std::string data;
+        try {
+            cv::FileStorage fs("." + QFileInfo(filename).suffix().toStdString(), cv::FileStorage::WRITE | cv::FileStorage::MEMORY);
+            fs << nodeName << matrix;
+            data = fs.releaseAndGetString();
+        } catch (const cv::Exception &error) {
+            throw QString("Failed to save matrix to file %1: %2").arg(filename).arg(QString::fromStdString(error.what()));
+        }
+
+        archive->append(filename, data.data(), data.size());
+        addBytesWritten(data.size());
+    }
+
+protected:
+    const std::string nodeName;
+};
+
+// Raw matrix in custom binary matrix format
+class MatrixBinarySink : public OutputSink
+{
+public:
+    MatrixBinarySink (Kind kind, const QString &format, int stride)
+        : OutputSink(kind, format, stride)
+    {
+    }
+
+    virtual void write (const OutputFrame &frame)
+    {
+        QString filename = makeFilename(frame.variables);
+        const cv::Mat &matrix = selectMatrix(kind, frame);
+
+        writeViaMemoryFile(filename, [&filename, &matrix] (const QString &file) {
+            try {
+                MVL::StereoToolbox::Pipeline::Utils::writeMatrixToBinaryFile(matrix, file);
+            } catch (const QString &error) {
+                throw QString("Failed to save binary file %1: %2").arg(filename).arg(error);
+            }
+        });
+    }
+};
+
+
+// *********************************************************************
+// *                      Disparity visualization                      *
+// *********************************************************************
+class DisparityVisualizationSink : public OutputSink
+{
+public:
+    DisparityVisualizationSink (Kind kind, const QString &format, int stride)
+        : OutputSink(kind, format, stride)
+    {
+    }
+
+    virtual bool usesImageEncoder () const
+    {
+        return true;
+    }
+
+    virtual void write (const OutputFrame &frame)
+    {
+        QString filename = makeFilename(frame.variables);
+
+        cv::Mat visualization;
+        MVL::StereoToolbox::Pipeline::Utils::createColorCodedDisparityCpu(frame.disparity, visualization, frame.numDisparities);
+
+        writeImage(filename, visualization);
+    }
+};
+
+
+// *********************************************************************
+// *                         PCD point cloud                           *
+// *********************************************************************
+class PointCloudPcdSink : public OutputSink
+{
+public:
+    PointCloudPcdSink (Kind kind, const QString &format, int stride)
+        : OutputSink(kind, format, stride)
+    {
+    }
+
+    // Point colours are taken from rectified left image
+    virtual bool requiresColor () const
+    {
+        return true;
+    }
+
+    virtual void write (const OutputFrame &frame)
+    {
+        QString filename = makeFilename(frame.variables);
+
+        writeViaMemoryFile(filename, [&filename, &frame] (const QString &file) {
+            try {
+                MVL::StereoToolbox::Pipeline::Utils::writePointCloudToPcdFile(frame.pointColors, frame.points, file, true);
+            } catch (const QString &error) {
+                throw QString("Failed to save PCD file %1: %2").arg(filename).arg(error);
+            }
+        });
+    }
+};
+
+
+// *********************************************************************
+// *                           Depth images                            *
+// *********************************************************************
+// Floating-point depth image, or 16-bit image of scaled depth, with
+// invalid and out-of-range values stored as zero
+class DepthImageSink : public OutputSink
+{
+public:
+    DepthImageSink (Kind kind, const QString &format, int stride, bool floatingPoint, double scale)
+        : OutputSink(kind, format, stride), floatingPoint(floatingPoint), scale(scale)
+    {
+    }
+
+    virtual bool usesImageEncoder () const
+    {
+        return true;
+    }
+
+    virtual void write (const OutputFrame &frame)
+    {
+        QString filename = makeFilename(frame.variables);
+
+        cv::Mat image;
+        if (floatingPoint) {
+            image = frame.depth;
+        } else {
+            image.create(frame.depth.size(), CV_16UC1);
+
+            for (int y = 0; y < frame.depth.rows; y++) {
+                const float *z = frame.depth.ptr<float>(y);
+                ushort *out = image.ptr<ushort>(y);
+
+                for (int x = 0; x < frame.depth.cols; x++) {
+                    double value = z[x] * scale;
+                    out[x] = (value > 0 && value < 65535.5) ? static_cast<ushort>(value + 0.5) : 0;
+                }
+            }
+        }
+
+        writeImage(filename, image);
+    }
+
+protected:
+    const bool floatingPoint;
+    const double scale;
+};
+
+
+// *********************************************************************
+// *                        Summary statistics                         *
+// *********************************************************************
+// Per-frame disparity statistics of the whole run, collected into a
+// single CSV or JSON-lines file. Rows are appended as frames complete,
+// so they are not necessarily ordered by frame number.
+class StatisticsSink : public OutputSink
+{
+public:
+    StatisticsSink (Kind kind, const QString &format, int stride, bool json, int numBins, double nearDistance)
+        : OutputSink(kind, format, stride), json(json), numBins(numBins), nearDistance(nearDistance)
+    {
+        if (format.contains("%{")) {
+            throw QString("Statistics output is a single file; format must not contain placeholders: '%1'").arg(format);
+        }
+    }
+
+    virtual void open ()
+    {
+        if (!archivePath.isEmpty()) {
+            throw QString("Statistics output cannot be written into an archive!");
+        }
+
+        ensureDirectoryExists(format);
+
+        file.setFileName(format);
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+            throw QString("Failed to create statistics file '%1': %2").arg(format).arg(file.errorString());
+        }
+
+        if (!json) {
+            QStringList columns = { "frame", "method", "reused", "change", "pixels", "valid", "valid_ratio", "median_disparity", "median_depth", "near" };
+            for (int i = 0; i < numBins; i++) {
+                columns.append(QString("hist_%1").arg(i));
+            }
+            file.write(columns.join(",").toUtf8() + "\n");
+        }
+    }
+
+    virtual void write (const OutputFrame &frame)
+    {
+        Utils::DisparityStatistics statistics;
+        Utils::computeDisparityStatistics(frame.disparity, frame.numDisparities, frame.reprojectionMatrix, numBins, nearDistance, statistics);
+
+        int frameNumber = frame.variables.value("f").toInt();
+        QString method = frame.variables.value("m").toString();
+        double validRatio = statistics.numPixels ? static_cast<double>(statistics.numValid) / statistics.numPixels : 0.0;
+
+        QByteArray line;
+        if (json) {
+            QJsonArray histogram;
+            for (int count : statistics.histogram) {
+                histogram.append(count);
+            }
+
+            QJsonObject object;
+            object["frame"] = frameNumber;
+            object["method"] = method;
+            object["reused"] = frame.disparityReused;
+            object["change"] = frame.change >= 0 ? QJsonValue(frame.change) : QJsonValue();
+            object["pixels"] = statistics.numPixels;
+            object["valid"] = statistics.numValid;
+            object["valid_ratio"] = validRatio;
+            object["median_disparity"] = formatJsonValue(statistics.medianDisparity);
+            object["median_depth"] = formatJsonValue(statistics.medianDepth);
+            object["near"] = statistics.numNear >= 0 ? QJsonValue(statistics.numNear) : QJsonValue();
+            object["histogram"] = histogram;
+
+            line = QJsonDocument(object).toJson(QJsonDocument::Compact) + "\n";
+        } else {
+            QStringList fields;
+            fields << QString::number(frameNumber)
+                   << "\"" + QString(method).replace("\"", "\"\"") + "\""
+                   << (frame.disparityReused ? "1" : "0")
+                   << (frame.change >= 0 ? QString::number(frame.change, 'g', 6) : QString())
+                   << QString::number(statistics.numPixels)
+                   << QString::number(statistics.numValid)
+                   << QString::number(validRatio, 'g', 6)
+                   << formatCsvValue(statistics.medianDisparity)
+                   << formatCsvValue(statistics.medianDepth)
+                   << (statistics.numNear >= 0 ? QString::number(statistics.numNear) : QString());
+            for (int count : statistics.histogram) {
+                fields << QString::number(count);
+            }
+
+            line = fields.join(",").toUtf8() + "\n";
+        }
+
+        QMutexLocker locker(&fileMutex);
+        if (file.write(line) != line.size()) {
+            throw QString("Failed to write statistics file '%1': %2").arg(format).arg(file.errorString());
+        }
+        addBytesWritten(line.size());
+    }
+
+    virtual void close ()
+    {
+        QMutexLocker locker(&fileMutex);
+        file.close();
+    }
+
+protected:
+    static QJsonValue formatJsonValue (double value)
+    {
+        return std::isnan(value) ? QJsonValue() : QJsonValue(value);
+    }
+
+    static QString formatCsvValue (double value)
+    {
+        return std::isnan(value) ? QString() : QString::number(value, 'g', 6);
+    }
+
+protected:
+    const bool json;
+    const int numBins;
+    const double nearDistance;
+
+    QMutex fileMutex;
+    QFile file;
+};
+
+
+// *********************************************************************
+// *                             Registry                              *
+// *********************************************************************
+struct SinkType {
+    OutputSink::Kind kind;
+    QStringList suffixes; // empty for any suffix
+    OutputSink::Factory factory;
+};
+
+static QList<SinkType> createBuiltinSinkTypes ()
+{
+    QList<SinkType> types;
+
+    const QStringList storageSuffixes = { "xml", "yml", "yaml" };
+    const QStringList binarySuffixes = { "bin" };
+
+    auto imagePair = [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &) -> OutputSink * {
+        return new ImagePairSink(kind, format, stride);
+    };
+    auto matrixStorage = [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &) -> OutputSink * {
+        return new MatrixStorageSink(kind, format, stride);
+    };
+    auto matrixBinary = [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &) -> OutputSink * {
+        return new MatrixBinarySink(kind, format, stride);
+    };
+
+    // Frames
+    types.append({ OutputSink::KindFrames, QStringList(), imagePair });
+    types.append({ OutputSink::KindRectified, QStringList(), imagePair });
+
+    // Disparity
+    types.append({ OutputSink::KindDisparity, storageSuffixes, matrixStorage });
+    types.append({ OutputSink::KindDisparity, binarySuffixes, matrixBinary });
+    types.append({ OutputSink::KindDisparity, QStringList(), [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &) -> OutputSink * {
+        return new DisparityVisualizationSink(kind, format, stride);
+    } });
+
+    // Points
+    types.append({ OutputSink::KindPoints, storageSuffixes, matrixStorage });
+    types.append({ OutputSink::KindPoints, binarySuffixes, matrixBinary });
+    types.append({ OutputSink::KindPoints, QStringList({ "pcd" }), [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &) -> OutputSink * {
+        return new PointCloudPcdSink(kind, format, stride);
+    } });
+
+    // Depth
+    types.append({ OutputSink::KindDepth, storageSuffixes, matrixStorage });
+    types.append({ OutputSink::KindDepth, binarySuffixes, matrixBinary });
+    types.append({ OutputSink::KindDepth, QStringList({ "tif", "tiff", "exr", "pfm" }), [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &) -> OutputSink * {
+        return new DepthImageSink(kind, format, stride, true, 1.0);
+    } });
+    types.append({ OutputSink::KindDepth, QStringList(), [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &options) -> OutputSink * {
+        return new DepthImageSink(kind, format, stride, false, options.depthScale);
+    } });
+
+    // Statistics
+    types.append({ OutputSink::KindStats, QStringList({ "csv" }), [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &options) -> OutputSink * {
+        return new StatisticsSink(kind, format, stride, false, options.statsBins, options.statsNearDistance);
+    } });
+    types.append({ OutputSink::KindStats, QStringList({ "jsonl", "json" }), [] (OutputSink::Kind kind, const QString &format, int stride, const OutputSink::Options &options) -> OutputSink * {
+        return new StatisticsSink(kind, format, stride, true, options.statsBins, options.statsNearDistance);
+    } });
+
+    return types;
+}
+
+static QList<SinkType> &getSinkTypes ()
+{
+    // Initialized on first use (thread-safe)
+    static QList<SinkType> types = createBuiltinSinkTypes();
+    return types;
+}
+
+void OutputSink::registerSinkType (Kind kind, const QStringList &suffixes, const Factory &factory)
+{
+    // Registered types take precedence over built-in ones; registration
+    // is expected to happen at startup, before any sinks are created
+    getSinkTypes().prepend({ kind, suffixes, factory });
+}
+
+OutputSink *OutputSink::create (Kind kind, const QString &format, int stride, const Options &options)
+{
+    // Archive target; archive.tar#member. The separator includes the
+    // suffix, so that a '#' elsewhere in the path is not mistaken for it
+    QString archivePath;
+    QString memberFormat = format;
+
+    int separator = format.indexOf(".tar#", 0, Qt::CaseInsensitive);
+    if (separator >= 0) {
+        archivePath = format.left(separator + 4);
+        memberFormat = format.mid(separator + 5);
+
+        if (archivePath.size() == 4 || memberFormat.isEmpty()) {
+            throw QString("Invalid archive output format: '%1'").arg(format);
+        }
+        if (archivePath.contains("%{")) {
+            throw QString("Archive path must not contain placeholders: '%1'").arg(archivePath);
+        }
+    }
+
+    // Encoder options; template?key=value&key=value
+    QString encoderOptions;
+
+    int query = memberFormat.lastIndexOf('?');
+    if (query >= 0) {
+        encoderOptions = memberFormat.mid(query + 1);
+        memberFormat = memberFormat.left(query);
+
+        if (encoderOptions.isEmpty()) {
+            throw QString("Empty encoder options in output format: '%1'").arg(format);
+        }
+    }
+
+    // Fast intermediate profile applies to frames and rectified images,
+    // unless they have explicit encoder options
+    QString suffix = QFileInfo(memberFormat).suffix().toLower();
+    if (encoderOptions.isEmpty() && options.fastIntermediate && (kind == KindFrames || kind == KindRectified)) {
+        encoderOptions = getFastIntermediateOptions(suffix);
+    }
+
+    std::vector<int> encoderParameters = parseEncoderOptions(suffix, encoderOptions);
+
+    OutputSink *sink = createForSuffix(kind, memberFormat, stride, options);
+
+    if (!encoderOptions.isEmpty() && !sink->usesImageEncoder()) {
+        delete sink;
+        throw QString("Encoder options are supported only by image outputs: '%1'").arg(format);
+    }
+
+    sink->archivePath = archivePath;
+    sink->archiveShardSize = options.archiveShardSize;
+    sink->archiveRegistry = options.archiveRegistry;
+    sink->encoderOptions = encoderOptions;
+    sink->encoderParameters = encoderParameters;
+
+    return sink;
+}
+
+OutputSink *OutputSink::createForSuffix (Kind kind, const QString &format, int stride, const Options &options)
+{
+    QString suffix = QFileInfo(format).completeSuffix();
+
+    // Exact suffix match first, then catch-all types
+    const SinkType *catchAll = 0;
+
+    for (const SinkType &type : getSinkTypes()) {
+        if (type.kind != kind) {
+            continue;
+        }
+
+        if (type.suffixes.contains(suffix)) {
+            return type.factory(kind, format, stride, options);
+        } else if (type.suffixes.isEmpty() && !catchAll) {
+            catchAll = &type;
+        }
+    }
+
+    if (catchAll) {
+        return catchAll->factory(kind, format, stride, options);
+    }
+
+    throw QString("Invalid output format for %1: %2").arg(getKindName(kind)).arg(suffix);
+}
+
+
+// *********************************************************************
+// *                          Encoder options                          *
+// *********************************************************************
+std::vector<int> OutputSink::parseEncoderOptions (const QString &suffix, const QString &encoderOptions)
+{
+    // Option name, applicable suffixes, OpenCV parameter, and either
+    // integer range or named values
+    struct EncoderOption {
+        const char *name;
+        QStringList suffixes;
+        int parameter;
+        int minimum;
+        int maximum;
+        QHash<QString, int> values;
+    };
+
+    static const QStringList pxmSuffixes = { "ppm", "pgm", "pbm", "pnm", "pxm" };
+
+    static const QList<EncoderOption> encoderOptionTypes = {
+        { "png_compression", { "png" }, cv::IMWRITE_PNG_COMPRESSION, 0, 9, {} },
+        { "png_strategy", { "png" }, cv::IMWRITE_PNG_STRATEGY, 0, 0, {
+            { "default", cv::IMWRITE_PNG_STRATEGY_DEFAULT },
+            { "filtered", cv::IMWRITE_PNG_STRATEGY_FILTERED },
+            { "huffman", cv::IMWRITE_PNG_STRATEGY_HUFFMAN_ONLY },
+            { "rle", cv::IMWRITE_PNG_STRATEGY_RLE },
+            { "fixed", cv::IMWRITE_PNG_STRATEGY_FIXED },
+        } },
+        { "jpeg_quality", { "jpg", "jpeg" }, cv::IMWRITE_JPEG_QUALITY, 0, 100, {} },
+        { "jpeg_progressive", { "jpg", "jpeg" }, cv::IMWRITE_JPEG_PROGRESSIVE, 0, 1, {} },
+        { "webp_quality", { "webp" }, cv::IMWRITE_WEBP_QUALITY, 1, 101, {} }, // above 100 is lossless
+        { "tiff_compression", { "tif", "tiff" }, cv::IMWRITE_TIFF_COMPRESSION, 0, 0, {
+            // libtiff compression schemes
+            { "none", 1 },
+            { "lzw", 5 },
+            { "deflate", 8 },
+            { "packbits", 32773 },
+        } },
+        { "exr_type", { "exr" }, cv::IMWRITE_EXR_TYPE, 0, 0, {
+            { "half", cv::IMWRITE_EXR_TYPE_HALF },
+            { "float", cv::IMWRITE_EXR_TYPE_FLOAT },
+        } },
+        { "pxm_binary", pxmSuffixes, cv::IMWRITE_PXM_BINARY, 0, 1, {} },
+    };
+
+    std::vector<int> parameters;
+
+    if (encoderOptions.isEmpty()) {
+        return parameters;
+    }
+
+    for (const QString &option : encoderOptions.split('&')) {
+        QString name = option.section('=', 0, 0);
+        QString value = option.section('=', 1);
+
+        const EncoderOption *type = 0;
+        for (const EncoderOption &candidate : encoderOptionTypes) {
+            if (name == candidate.name) {
+                type = &candidate;
+                break;
+            }
+        }
+
+        if (!type) {
+            throw QString("Unknown encoder option: '%1'").arg(name);
+        }
+        if (!type->suffixes.contains(suffix)) {
+            throw QString("Encoder option '%1' is not applicable to .%2 files").arg(name).arg(suffix);
+        }
+
+        int parameterValue;
+        if (!type->values.isEmpty()) {
+            if (!type->values.contains(value)) {
+                throw QString("Invalid value of encoder option '%1': '%2' (valid values: %3)").arg(name).arg(value).arg(QStringList(type->values.keys()).join(", "));
+            }
+            parameterValue = type->values.value(value);
+        } else {
+            bool ok;
+            parameterValue = value.toInt(&ok);
+            if (!ok || parameterValue < type->minimum || parameterValue > type->maximum) {
+                throw QString("Invalid value of encoder option '%1': '%2' (valid range: %3 to %4)").arg(name).arg(value).arg(type->minimum).arg(type->maximum);
+            }
+        }
+
+        parameters.push_back(type->parameter);
+        parameters.push_back(parameterValue);
+    }
+
+    return parameters;
+}
+
+QString OutputSink::getFastIntermediateOptions (const QString &suffix)
+{
+    // Cheapest lossless encoding that keeps the file type; lossy and
+    // uncompressed formats are left as they are
+    if (suffix == "png") {
+        return "png_compression=0";
+    } else if (suffix == "tif" || suffix == "tiff") {
+        return "tiff_compression=none";
+    }
+
+    return QString();
+}
+
+
+} // StereoProcessor
+} // MVL
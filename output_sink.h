@@ -0,0 +1,205 @@
+/*
+ * MVL Stereo Processor: output sinks
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__OUTPUT_SINK_H
+#define MVL_STEREO_PROCESSOR__OUTPUT_SINK_H
+
+#include <QtCore>
+#include <opencv2/core.hpp>
+
+#include <functional>
+#include <vector>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+class ArchiveRegistry;
+class ArchiveWriter;
+
+
+// Data of a processed frame, handed to output sinks. Matrices are not
+// modified after the frame is submitted, so sinks may process it
+// asynchronously.
+struct OutputFrame
+{
+    OutputFrame ()
+        : numDisparities(0), disparityReused(false), change(-1)
+    {
+    }
+
+    // Variables for filename formatting (frame number, method label,
+    // range)
+    QHash<QString, QVariant> variables;
+
+    // Input frames (colour, if available)
+    cv::Mat frameLeft;
+    cv::Mat frameRight;
+
+    // Rectified frames
+    cv::Mat rectifiedLeft;
+    cv::Mat rectifiedRight;
+
+    // Disparity
+    cv::Mat disparity;
+    int numDisparities;
+
+    // Point cloud, and point colours (for PCD)
+    cv::Mat points;
+    cv::Mat pointColors;
+
+    // Depth map
+    cv::Mat depth;
+
+    // Reprojection matrix (for sinks that compute depth themselves)
+    cv::Mat reprojectionMatrix;
+
+    // Incremental mode; whether disparity was reused from an earlier
+    // frame, and the measured change (negative if not measured)
+    bool disparityReused;
+    double change;
+};
+
+
+// Output sink; writes one type of data for each frame, according to its
+// filename template. Sinks are created and validated once at setup, via
+// the registry of sink types, which is keyed by output kind and file
+// suffix. write() may be called concurrently from several threads.
+//
+// A template of form archive.tar#member redirects the output into
+// members of a (sharded) tar archive; the sink type is chosen by the
+// suffix of the member template. Only '#' following a .tar suffix acts
+// as separator; elsewhere, it is part of the filename. Image outputs accept encoder options,
+// appended to the template as ?key=value&key=value (e.g.,
+// ?png_compression=1); these are parsed and validated at setup.
+class OutputSink
+{
+public:
+    enum Kind {
+        KindFrames,
+        KindRectified,
+        KindDisparity,
+        KindPoints,
+        KindDepth,
+        KindStats,
+    };
+
+    // Options shared by sinks
+    struct Options {
+        Options () : depthScale(1.0), archiveShardSize(0), statsBins(16), statsNearDistance(0), fastIntermediate(false) {}
+
+        double depthScale;
+        qint64 archiveShardSize; // bytes; 0 for single archive
+        QSharedPointer<ArchiveRegistry> archiveRegistry; // archives of the run
+        int statsBins;
+        double statsNearDistance; // 0 to disable near-pixel count
+        bool fastIntermediate; // cheapest lossless encoding of frames and rectified images
+    };
+
+    OutputSink (Kind kind, const QString &format, int stride);
+    virtual ~OutputSink ();
+
+    Kind getKind () const;
+    const QString &getFormat () const;
+    const QString &getArchivePath () const;
+    const QString &getEncoderOptions () const;
+    int getStride () const;
+
+    // Whether output is produced for the frame with given index within
+    // its frame range
+    bool isActive (int rangeIndex) const;
+
+    // Number of bytes written so far (for progress reporting)
+    qint64 getBytesWritten () const;
+
+    // Whether the sink needs colour data (input frames in colour, or
+    // point colours); in grayscale mode, these are retrieved on demand
+    virtual bool requiresColor () const;
+
+    // Whether the sink writes images via OpenCV image codecs, and thus
+    // accepts encoder options
+    virtual bool usesImageEncoder () const;
+
+    virtual void open ();
+    virtual void write (const OutputFrame &frame) = 0;
+    virtual void close ();
+
+    // Registry
+    typedef std::function<OutputSink *(Kind kind, const QString &format, int stride, const Options &options)> Factory;
+
+    static void registerSinkType (Kind kind, const QStringList &suffixes, const Factory &factory);
+    static OutputSink *create (Kind kind, const QString &format, int stride, const Options &options);
+
+    static QString getKindName (Kind kind);
+
+protected:
+    static OutputSink *createForSuffix (Kind kind, const QString &format, int stride, const Options &options);
+
+    static std::vector<int> parseEncoderOptions (const QString &suffix, const QString &encoderOptions);
+    static QString getFastIntermediateOptions (const QString &suffix);
+
+    QString makeFilename (const QHash<QString, QVariant> &variables) const;
+    void ensureDirectoryExists (const QString &filename);
+
+    // Write image, encoded according to filename suffix and encoder
+    // options
+    void writeImage (const QString &filename, const cv::Mat &image);
+
+    // Write using a function that requires a filename; in archive mode,
+    // output is written to an anonymous in-memory file, which is then
+    // appended to the archive
+    void writeViaMemoryFile (const QString &filename, const std::function<void (const QString &)> &writer);
+
+    // As above, but in archive mode, output is written to a temporary
+    // file with the same suffix, for writers that select the format by
+    // filename suffix (e.g., cv::FileStorage)
+    void writeViaFile (const QString &filename, const std::function<void (const QString &)> &writer);
+
+    void addBytesWritten (qint64 size);
+
+protected:
+    const Kind kind;
+    const QString format;
+    const int stride;
+
+    // Target archive (if any)
+    QString archivePath;
+    qint64 archiveShardSize;
+    QSharedPointer<ArchiveRegistry> archiveRegistry;
+    QSharedPointer<ArchiveWriter> archive;
+
+    // Encoder options, as given in the template, and corresponding
+    // OpenCV image codec parameters
+    QString encoderOptions;
+    std::vector<int> encoderParameters;
+
+    QAtomicInteger<qint64> bytesWritten;
+
+    // Directories that were already created by this sink
+    QMutex directoryMutex;
+    QSet<QString> directories;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
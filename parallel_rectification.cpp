@@ -0,0 +1,192 @@
+/*
+ * MVL Stereo Processor: parallel rectification
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "parallel_rectification.h"
+#include "debug.h"
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+ParallelRectification::ParallelRectification (MVL::StereoToolbox::Pipeline::Rectification *rectification, int numStripes)
+    : rectification(rectification), numStripes(numStripes), fallback(false)
+{
+}
+
+ParallelRectification::~ParallelRectification ()
+{
+}
+
+
+// *********************************************************************
+// *                         Map recovery                              *
+// *********************************************************************
+void ParallelRectification::initialize (const cv::Size &imageSize)
+{
+    mapImageSize = imageSize;
+    fallback = false;
+
+    try {
+        // Coordinate ramps, and all-ones image for interpolation weight
+        cv::Mat rampX(imageSize, CV_32FC1);
+        cv::Mat rampY(imageSize, CV_32FC1);
+        cv::Mat ones(imageSize, CV_32FC1, cv::Scalar(1));
+
+        for (int y = 0; y < imageSize.height; y++) {
+            float *px = rampX.ptr<float>(y);
+            float *py = rampY.ptr<float>(y);
+            for (int x = 0; x < imageSize.width; x++) {
+                px[x] = static_cast<float>(x);
+                py[x] = static_cast<float>(y);
+            }
+        }
+
+        cv::Mat mapX[2], mapY[2], weight[2];
+        rectification->rectifyImagePair(rampX, rampX, mapX[0], mapX[1]);
+        rectification->rectifyImagePair(rampY, rampY, mapY[0], mapY[1]);
+        rectification->rectifyImagePair(ones, ones, weight[0], weight[1]);
+
+        // Pixels that interpolate (partly) from outside of the image are
+        // marked invalid, so that they are filled with border value
+        cv::Mat valid[2];
+        for (int side = 0; side < 2; side++) {
+            valid[side] = cv::abs(weight[side] - 1.0) < 1e-3;
+
+            mapX[side].setTo(-1, ~valid[side]);
+            mapY[side].setTo(-1, ~valid[side]);
+
+            cv::convertMaps(mapX[side], mapY[side], map1[side], map2[side], CV_16SC2);
+        }
+
+        // Verify against pipeline's rectification on a test pattern
+        cv::Mat pattern(imageSize, CV_8UC1);
+        cv::randu(pattern, 0, 256);
+
+        cv::Mat reference[2];
+        rectification->rectifyImagePair(pattern, pattern, reference[0], reference[1]);
+
+        for (int side = 0; side < 2; side++) {
+            cv::Mat result;
+            cv::remap(pattern, result, map1[side], map2[side], cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+
+            cv::Mat difference;
+            cv::absdiff(result, reference[side], difference);
+
+            double maxDifference;
+            cv::minMaxLoc(difference, 0, &maxDifference, 0, 0, valid[side]);
+
+            if (maxDifference > 1) {
+                qCWarning(mvlStereoProcessor) << "Recovered rectification maps do not reproduce pipeline's rectification (max. difference:" << maxDifference << "); using serial rectification.";
+                fallback = true;
+                return;
+            }
+        }
+    } catch (const cv::Exception &error) {
+        qCWarning(mvlStereoProcessor) << "Failed to recover rectification maps:" << QString::fromStdString(error.what()) << "; using serial rectification.";
+        fallback = true;
+        return;
+    } catch (const QString &error) {
+        qCWarning(mvlStereoProcessor) << "Failed to recover rectification maps:" << error << "; using serial rectification.";
+        fallback = true;
+        return;
+    }
+
+    qCDebug(mvlStereoProcessor) << "Recovered rectification maps for" << imageSize.width << "x" << imageSize.height << "images.";
+}
+
+
+// *********************************************************************
+// *                          Rectification                            *
+// *********************************************************************
+void ParallelRectification::rectifyImagePair (const cv::Mat &imageLeft, const cv::Mat &imageRight, cv::Mat &rectifiedLeft, cv::Mat &rectifiedRight)
+{
+    if (imageLeft.size() != mapImageSize) {
+        initialize(imageLeft.size());
+    }
+
+    if (fallback || imageRight.size() != imageLeft.size()) {
+        rectification->rectifyImagePair(imageLeft, imageRight, rectifiedLeft, rectifiedRight);
+        return;
+    }
+
+    const int sides[2] = { 0, 1 };
+    const cv::Mat *images[2] = { &imageLeft, &imageRight };
+    cv::Mat *rectified[2] = { &rectifiedLeft, &rectifiedRight };
+
+    remapStripes(2, sides, images, rectified);
+}
+
+void ParallelRectification::rectifyImage (int side, const cv::Mat &image, cv::Mat &rectified)
+{
+    if (image.size() != mapImageSize) {
+        initialize(image.size());
+    }
+
+    if (fallback) {
+        // Pipeline's rectification works on pairs only
+        cv::Mat other;
+        if (side == 0) {
+            rectification->rectifyImagePair(image, image, rectified, other);
+        } else {
+            rectification->rectifyImagePair(image, image, other, rectified);
+        }
+        return;
+    }
+
+    const cv::Mat *images[1] = { &image };
+    cv::Mat *rectifiedImages[1] = { &rectified };
+
+    remapStripes(1, &side, images, rectifiedImages);
+}
+
+void ParallelRectification::remapStripes (int numImages, const int *sides, const cv::Mat **images, cv::Mat **rectified)
+{
+    for (int i = 0; i < numImages; i++) {
+        rectified[i]->create(map1[sides[i]].size(), images[i]->type());
+    }
+
+    // Stripes of all images are processed in one parallel region; the
+    // nested parallel_for_ of each cv::remap() runs sequentially
+    int stripes = numStripes > 0 ? numStripes : 2*std::max(1, cv::getNumThreads());
+    int rows = map1[0].rows;
+    int stripeHeight = std::max(16, (rows + stripes - 1) / stripes);
+    stripes = (rows + stripeHeight - 1) / stripeHeight;
+
+    cv::parallel_for_(cv::Range(0, numImages*stripes), [&] (const cv::Range &range) {
+        for (int i = range.start; i < range.end; i++) {
+            int image = i / stripes;
+            int side = sides[image];
+            int rowStart = (i % stripes) * stripeHeight;
+            int rowEnd = std::min(rowStart + stripeHeight, rows);
+
+            cv::Mat stripe = rectified[image]->rowRange(rowStart, rowEnd);
+            cv::remap(*images[image], stripe, map1[side].rowRange(rowStart, rowEnd), map2[side].rowRange(rowStart, rowEnd), cv::INTER_LINEAR, cv::BORDER_CONSTANT);
+        }
+    }, numImages*stripes);
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,84 @@
+/*
+ * MVL Stereo Processor: parallel rectification
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__PARALLEL_RECTIFICATION_H
+#define MVL_STEREO_PROCESSOR__PARALLEL_RECTIFICATION_H
+
+#include <QtCore>
+#include <opencv2/core.hpp>
+
+#include <stereo-pipeline/rectification.h>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Rectification of image pairs, with left and right image remapped
+// concurrently, each split into horizontal stripes that are processed
+// in a single cv::parallel_for_ region (i.e., on the compute threads of
+// the rectification stage), using precomputed fixed-point maps.
+//
+// The rectification maps are not exposed by the pipeline's
+// rectification object, so they are recovered by rectifying coordinate
+// ramps (which is exact, as interpolation reproduces linear functions),
+// and converted into fixed-point maps. Pixels whose source lies partly
+// outside the input image (the one-pixel rim of the valid region) are
+// treated as invalid. If the recovered maps do not reproduce the
+// pipeline's output on a test pattern, rectification falls back to the
+// pipeline's own (serial) implementation.
+class ParallelRectification
+{
+public:
+    // Number of stripes per image; 0 for twice the number of compute
+    // threads
+    ParallelRectification (MVL::StereoToolbox::Pipeline::Rectification *rectification, int numStripes);
+    virtual ~ParallelRectification ();
+
+    void rectifyImagePair (const cv::Mat &imageLeft, const cv::Mat &imageRight, cv::Mat &rectifiedLeft, cv::Mat &rectifiedRight);
+
+    // Rectify only one image of the pair; side is 0 for left, and 1 for
+    // right image
+    void rectifyImage (int side, const cv::Mat &image, cv::Mat &rectified);
+
+protected:
+    void initialize (const cv::Size &imageSize);
+    void remapStripes (int numImages, const int *sides, const cv::Mat **images, cv::Mat **rectified);
+
+protected:
+    MVL::StereoToolbox::Pipeline::Rectification *rectification;
+
+    int numStripes;
+
+    // Fixed-point maps for left (0) and right (1) image, valid for
+    // given image size
+    cv::Size mapImageSize;
+    cv::Mat map1[2];
+    cv::Mat map2[2];
+
+    // Maps could not be recovered; use pipeline's rectification
+    bool fallback;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
@@ -0,0 +1,222 @@
+/*
+ * MVL Stereo Processor: pipeline cache
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "pipeline_cache.h"
+#include "debug.h"
+
+#include <stereo-pipeline/pipeline.h>
+#include <stereo-pipeline/plugin_manager.h>
+#include <stereo-pipeline/plugin_factory.h>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+PipelineCache::PipelineCache (int maxIdlePipelines)
+    : maxIdlePipelines(maxIdlePipelines)
+{
+}
+
+PipelineCache::~PipelineCache ()
+{
+    for (CachedPipeline *pipeline : pipelines) {
+        deletePipeline(pipeline);
+    }
+}
+
+
+// *********************************************************************
+// *                          Cache management                         *
+// *********************************************************************
+QString PipelineCache::makeKey (const QString &stereoCalibrationFile, const QString &stereoMethodFile)
+{
+    // Key consists of absolute paths and modification times, so that
+    // changed configuration files invalidate the cached pipelines
+    QStringList tokens;
+    for (const QString &filename : { stereoCalibrationFile, stereoMethodFile }) {
+        if (filename.isEmpty()) {
+            tokens << QString();
+        } else {
+            QFileInfo info(filename);
+            tokens << QString("%1@%2").arg(info.absoluteFilePath()).arg(info.lastModified().toMSecsSinceEpoch());
+        }
+    }
+
+    return tokens.join("|");
+}
+
+CachedPipeline *PipelineCache::acquire (const QString &stereoCalibrationFile, const QString &stereoMethodFile)
+{
+    QString key = makeKey(stereoCalibrationFile, stereoMethodFile);
+
+    // Try to obtain an idle pipeline
+    {
+        QMutexLocker locker(&mutex);
+
+        auto it = idlePipelines.find(key);
+        if (it != idlePipelines.end()) {
+            CachedPipeline *pipeline = it.value();
+            idlePipelines.erase(it);
+            idleOrder.removeOne(pipeline);
+
+            qCDebug(mvlStereoProcessor) << "Reusing cached pipeline:" << key;
+            return pipeline;
+        }
+    }
+
+    // Create new pipeline; this is done without holding the lock, as
+    // loading plugins and calibration may take a while
+    qCDebug(mvlStereoProcessor) << "Creating new pipeline:" << key;
+
+    CachedPipeline *pipeline = new CachedPipeline();
+    pipeline->key = key;
+    pipeline->rectification = 0;
+    pipeline->stereoMethod = 0;
+
+    try {
+        if (!stereoCalibrationFile.isEmpty()) {
+            pipeline->rectification = createRectification(stereoCalibrationFile);
+        }
+        if (!stereoMethodFile.isEmpty()) {
+            pipeline->stereoMethod = createStereoMethod(stereoMethodFile);
+        }
+    } catch (...) {
+        delete pipeline->rectification;
+        delete pipeline;
+        throw;
+    }
+
+    QMutexLocker locker(&mutex);
+    pipelines.append(pipeline);
+
+    return pipeline;
+}
+
+void PipelineCache::release (CachedPipeline *pipeline)
+{
+    QList<CachedPipeline *> evicted;
+
+    {
+        QMutexLocker locker(&mutex);
+        idlePipelines.insert(pipeline->key, pipeline);
+        idleOrder.append(pipeline);
+
+        while (idleOrder.size() > maxIdlePipelines) {
+            CachedPipeline *oldest = idleOrder.takeFirst();
+            idlePipelines.remove(oldest->key, oldest);
+            pipelines.removeOne(oldest);
+            evicted.append(oldest);
+        }
+    }
+
+    // Pipeline elements are destroyed without holding the lock
+    for (CachedPipeline *oldest : evicted) {
+        qCDebug(mvlStereoProcessor) << "Evicting cached pipeline:" << oldest->key;
+        deletePipeline(oldest);
+    }
+}
+
+void PipelineCache::deletePipeline (CachedPipeline *pipeline)
+{
+    delete pipeline->rectification;
+    delete pipeline->stereoMethod;
+    delete pipeline;
+}
+
+int PipelineCache::getNumPipelines () const
+{
+    QMutexLocker locker(&mutex);
+    return pipelines.size();
+}
+
+int PipelineCache::getNumIdlePipelines () const
+{
+    QMutexLocker locker(&mutex);
+    return idlePipelines.size();
+}
+
+
+// *********************************************************************
+// *                     Pipeline element factories                    *
+// *********************************************************************
+MVL::StereoToolbox::Pipeline::Rectification *PipelineCache::createRectification (const QString &stereoCalibrationFile)
+{
+    qCDebug(mvlStereoProcessor) << "Setting up rectification:" << qPrintable(stereoCalibrationFile);
+
+    MVL::StereoToolbox::Pipeline::Rectification *rectification = new MVL::StereoToolbox::Pipeline::Rectification();
+    try {
+        rectification->loadStereoCalibration(stereoCalibrationFile);
+    } catch (const QString &error) {
+        delete rectification;
+        throw QString("Failed to load stereo calibration: %1").arg(error);
+    } catch (const std::exception &error) {
+        delete rectification;
+        throw QString("Failed to load stereo calibration: %1").arg(error.what());
+    }
+
+    return rectification;
+}
+
+QObject *PipelineCache::createStereoMethod (const QString &stereoMethodFile)
+{
+    qCDebug(mvlStereoProcessor) << "Setting up stereo method:" << qPrintable(stereoMethodFile);
+
+    // Open config file
+    cv::FileStorage storage(stereoMethodFile.toStdString(), cv::FileStorage::READ);
+    if (!storage.isOpened()) {
+        throw QString("Failed to open OpenCV file storage on '%1'").arg(stereoMethodFile);
+    }
+
+    std::string methodName;
+    storage["MethodName"] >> methodName;
+
+    // Traverse list of plugins and try to find stereo method based
+    // on its name
+    QObject *stereoMethod = 0;
+
+    MVL::StereoToolbox::Pipeline::PluginManager pluginManager;
+    for (QObject *pluginFactoryObject : pluginManager.getAvailablePlugins()) {
+        MVL::StereoToolbox::Pipeline::PluginFactory *pluginFactory = qobject_cast<MVL::StereoToolbox::Pipeline::PluginFactory *>(pluginFactoryObject);
+        if (pluginFactory->getPluginType() == MVL::StereoToolbox::Pipeline::PluginFactory::PluginStereoMethod) {
+            if (pluginFactory->getShortName().toStdString() == methodName) {
+                stereoMethod = pluginFactory->createObject();
+                break;
+            }
+        }
+    }
+
+    if (!stereoMethod) {
+        throw QString("Plugin for stereo method '%1' not found!").arg(QString::fromStdString(methodName));
+    }
+
+    // Load config
+    try {
+        qobject_cast<MVL::StereoToolbox::Pipeline::StereoMethod *>(stereoMethod)->loadParameters(stereoMethodFile);
+    } catch (const QString &error) {
+        delete stereoMethod;
+        throw QString("Failed to load method parameters: %1").arg(error);
+    }
+
+    return stereoMethod;
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,89 @@
+/*
+ * MVL Stereo Processor: pipeline cache
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__PIPELINE_CACHE_H
+#define MVL_STEREO_PROCESSOR__PIPELINE_CACHE_H
+
+#include <QtCore>
+
+#include <stereo-pipeline/rectification.h>
+#include <stereo-pipeline/stereo_method.h>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Warm pipeline elements for a given calibration and method
+// configuration
+struct CachedPipeline
+{
+    QString key;
+
+    MVL::StereoToolbox::Pipeline::Rectification *rectification;
+    QObject *stereoMethod;
+};
+
+
+// Cache of warm pipelines, keyed by stereo calibration and stereo
+// method configuration. Since pipeline elements are not thread-safe,
+// each acquired pipeline is used exclusively by a single processor
+// until it is released; if all pipelines with requested configuration
+// are in use, a new one is created. The number of idle pipelines is
+// bounded; when exceeded, the least recently released ones are evicted
+// (pipelines of outdated configurations are never requested again, and
+// thus eventually evicted).
+class PipelineCache
+{
+public:
+    PipelineCache (int maxIdlePipelines);
+    virtual ~PipelineCache ();
+
+    CachedPipeline *acquire (const QString &stereoCalibrationFile, const QString &stereoMethodFile);
+    void release (CachedPipeline *pipeline);
+
+    int getNumPipelines () const;
+    int getNumIdlePipelines () const;
+
+    // Pipeline element factories
+    static MVL::StereoToolbox::Pipeline::Rectification *createRectification (const QString &stereoCalibrationFile);
+    static QObject *createStereoMethod (const QString &stereoMethodFile);
+
+protected:
+    static QString makeKey (const QString &stereoCalibrationFile, const QString &stereoMethodFile);
+    static void deletePipeline (CachedPipeline *pipeline);
+
+protected:
+    mutable QMutex mutex;
+
+    const int maxIdlePipelines;
+
+    QList<CachedPipeline *> pipelines;
+    QMultiHash<QString, CachedPipeline *> idlePipelines;
+
+    // Idle pipelines, least recently released first
+    QList<CachedPipeline *> idleOrder;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
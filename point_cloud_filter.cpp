@@ -0,0 +1,347 @@
+/*
+ * MVL Stereo Processor: point cloud filter
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "point_cloud_filter.h"
+
+#include <opencv2/core/utility.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+PointCloudFilter::PointCloudFilter ()
+    : mode(ModeNone),
+      stride(1),
+      voxelSize(0),
+      rangeClipping(false),
+      rangeMin(0),
+      rangeMax(std::numeric_limits<float>::max())
+{
+}
+
+PointCloudFilter::~PointCloudFilter ()
+{
+}
+
+
+void PointCloudFilter::configure (const QString &decimation, const QString &range)
+{
+    // Decimation
+    QString type = decimation.section(':', 0, 0);
+    QString value = decimation.section(':', 1);
+    bool ok = true;
+
+    if (decimation.isEmpty() || type == "none") {
+        mode = ModeNone;
+    } else if (type == "stride") {
+        mode = ModeStride;
+        stride = value.toInt(&ok);
+        ok = ok && stride >= 1;
+    } else if (type == "voxel") {
+        mode = ModeVoxel;
+        voxelSize = value.toFloat(&ok);
+        ok = ok && voxelSize > 0;
+    } else {
+        ok = false;
+    }
+
+    if (!ok) {
+        throw QString("Invalid point cloud decimation: '%1'").arg(decimation);
+    }
+
+    // Range clipping
+    rangeClipping = !range.isEmpty();
+    rangeMin = 0;
+    rangeMax = std::numeric_limits<float>::max();
+
+    if (rangeClipping) {
+        QStringList tokens = range.split(":");
+        if (tokens.size() != 2) {
+            throw QString("Invalid point cloud range: '%1'").arg(range);
+        }
+        if (!tokens[0].isEmpty()) {
+            rangeMin = tokens[0].toFloat(&ok);
+            if (!ok) {
+                throw QString("Invalid point cloud range: '%1'").arg(range);
+            }
+        }
+        if (!tokens[1].isEmpty()) {
+            rangeMax = tokens[1].toFloat(&ok);
+            if (!ok) {
+                throw QString("Invalid point cloud range: '%1'").arg(range);
+            }
+        }
+    }
+}
+
+bool PointCloudFilter::isEnabled () const
+{
+    return mode != ModeNone || rangeClipping;
+}
+
+
+bool PointCloudFilter::isPointValid (const cv::Vec3f &point) const
+{
+    if (!std::isfinite(point[0]) || !std::isfinite(point[1]) || !std::isfinite(point[2])) {
+        return false;
+    }
+
+    return point[2] >= rangeMin && point[2] <= rangeMax;
+}
+
+
+void PointCloudFilter::apply (const cv::Mat &points, const cv::Mat &colors, cv::Mat &filteredPoints, cv::Mat &filteredColors) const
+{
+    cv::Mat points32f;
+    if (points.type() == CV_32FC3) {
+        points32f = points;
+    } else {
+        points.convertTo(points32f, CV_32F);
+    }
+
+    if (!colors.empty() && (colors.size() != points.size() || colors.depth() != CV_8U)) {
+        throw QString("Point cloud filter: colour image does not match points!");
+    }
+
+    if (mode == ModeVoxel) {
+        applyVoxelGrid(points32f, colors, filteredPoints, filteredColors);
+    } else {
+        // Stride (1 if only range clipping is enabled)
+        applyStride(points32f, colors, filteredPoints, filteredColors);
+    }
+}
+
+
+// *********************************************************************
+// *                              Stride                               *
+// *********************************************************************
+void PointCloudFilter::applyStride (const cv::Mat &points, const cv::Mat &colors, cv::Mat &filteredPoints, cv::Mat &filteredColors) const
+{
+    // Subsample rows and columns; the result remains organized, with
+    // clipped points set to NaN
+    int rows = (points.rows + stride - 1) / stride;
+    int cols = (points.cols + stride - 1) / stride;
+
+    filteredPoints.create(rows, cols, CV_32FC3);
+    if (!colors.empty()) {
+        filteredColors.create(rows, cols, colors.type());
+    } else {
+        filteredColors.release();
+    }
+
+    const float nan = std::numeric_limits<float>::quiet_NaN();
+
+    cv::parallel_for_(cv::Range(0, rows), [&] (const cv::Range &range) {
+        for (int y = range.start; y < range.end; y++) {
+            const cv::Vec3f *in = points.ptr<cv::Vec3f>(y*stride);
+            cv::Vec3f *out = filteredPoints.ptr<cv::Vec3f>(y);
+
+            for (int x = 0; x < cols; x++) {
+                const cv::Vec3f &point = in[x*stride];
+                out[x] = isPointValid(point) ? point : cv::Vec3f(nan, nan, nan);
+            }
+
+            if (!colors.empty()) {
+                size_t elemSize = colors.elemSize();
+                const uchar *colorIn = colors.ptr<uchar>(y*stride);
+                uchar *colorOut = filteredColors.ptr<uchar>(y);
+
+                for (int x = 0; x < cols; x++) {
+                    memcpy(colorOut + x*elemSize, colorIn + x*stride*elemSize, elemSize);
+                }
+            }
+        }
+    });
+}
+
+
+// *********************************************************************
+// *                            Voxel grid                             *
+// *********************************************************************
+namespace {
+
+struct Voxel {
+    double sum[3];
+    double colorSum[3];
+    int count;
+};
+
+// Integer voxel coordinates
+struct VoxelKey {
+    qint64 index[3];
+
+    bool operator == (const VoxelKey &other) const
+    {
+        return index[0] == other.index[0] && index[1] == other.index[1] && index[2] == other.index[2];
+    }
+
+    bool operator < (const VoxelKey &other) const
+    {
+        return std::lexicographical_compare(index, index + 3, other.index, other.index + 3);
+    }
+};
+
+struct VoxelKeyHash {
+    size_t operator () (const VoxelKey &key) const
+    {
+        // Large odd multipliers, so that neighbouring voxels spread
+        quint64 hash = static_cast<quint64>(key.index[0]) * 0x9e3779b97f4a7c15ULL;
+        hash ^= static_cast<quint64>(key.index[1]) * 0xc2b2ae3d27d4eb4fULL;
+        hash ^= static_cast<quint64>(key.index[2]) * 0x165667b19e3779f9ULL;
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+typedef std::unordered_map<VoxelKey, Voxel, VoxelKeyHash> VoxelMap;
+
+// Voxel coordinates of a (finite) point; returns false if they do not
+// fit into 64-bit integers
+inline bool voxelKey (const cv::Vec3f &point, float voxelSize, VoxelKey &key)
+{
+    const double limit = 4611686018427387904.0; // 2^62
+
+    for (int c = 0; c < 3; c++) {
+        double index = std::floor(static_cast<double>(point[c]) / voxelSize);
+        if (!(std::fabs(index) < limit)) {
+            return false;
+        }
+        key.index[c] = static_cast<qint64>(index);
+    }
+
+    return true;
+}
+
+}
+
+void PointCloudFilter::applyVoxelGrid (const cv::Mat &points, const cv::Mat &colors, cv::Mat &filteredPoints, cv::Mat &filteredColors) const
+{
+    // Rows are split into stripes, each accumulated into its own hash
+    // grid; the grids are merged afterwards, in order. The number of
+    // stripes does not depend on the number of threads, so that sums
+    // (and thus centroids) are the same regardless of the latter
+    int numStripes = std::max(1, std::min(points.rows, 64));
+    std::vector<VoxelMap> grids(numStripes);
+
+    int channels = colors.empty() ? 0 : colors.channels();
+    std::atomic<bool> outOfRange(false);
+
+    cv::parallel_for_(cv::Range(0, numStripes), [&] (const cv::Range &range) {
+        for (int stripe = range.start; stripe < range.end; stripe++) {
+            VoxelMap &grid = grids[stripe];
+
+            int rowStart = points.rows * stripe / numStripes;
+            int rowEnd = points.rows * (stripe + 1) / numStripes;
+
+            for (int y = rowStart; y < rowEnd; y++) {
+                const cv::Vec3f *in = points.ptr<cv::Vec3f>(y);
+                const uchar *colorIn = channels ? colors.ptr<uchar>(y) : 0;
+
+                for (int x = 0; x < points.cols; x++) {
+                    const cv::Vec3f &point = in[x];
+                    if (!isPointValid(point)) {
+                        continue;
+                    }
+
+                    VoxelKey key;
+                    if (!voxelKey(point, voxelSize, key)) {
+                        outOfRange = true;
+                        continue;
+                    }
+
+                    Voxel &voxel = grid[key];
+                    for (int c = 0; c < 3; c++) {
+                        voxel.sum[c] += point[c];
+                    }
+                    for (int c = 0; c < channels; c++) {
+                        voxel.colorSum[c] += colorIn[x*channels + c];
+                    }
+                    voxel.count++;
+                }
+            }
+        }
+    });
+
+    if (outOfRange) {
+        throw QString("Point coordinates out of range for voxel size %1!").arg(voxelSize);
+    }
+
+    // Merge
+    VoxelMap &grid = grids[0];
+    for (int i = 1; i < numStripes; i++) {
+        for (const auto &entry : grids[i]) {
+            Voxel &voxel = grid[entry.first];
+            for (int c = 0; c < 3; c++) {
+                voxel.sum[c] += entry.second.sum[c];
+                voxel.colorSum[c] += entry.second.colorSum[c];
+            }
+            voxel.count += entry.second.count;
+        }
+    }
+
+    // Voxels are written in order of their coordinates, so that output
+    // does not depend on the hash map's iteration order
+    std::vector<VoxelMap::const_iterator> voxels;
+    voxels.reserve(grid.size());
+    for (auto it = grid.cbegin(); it != grid.cend(); ++it) {
+        voxels.push_back(it);
+    }
+    std::sort(voxels.begin(), voxels.end(), [] (const VoxelMap::const_iterator &a, const VoxelMap::const_iterator &b) {
+        return a->first < b->first;
+    });
+
+    // Centroids and average colours
+    filteredPoints.create(static_cast<int>(grid.size()), 1, CV_32FC3);
+    if (channels) {
+        filteredColors.create(static_cast<int>(grid.size()), 1, CV_8UC(channels));
+    } else {
+        filteredColors.release();
+    }
+
+    int i = 0;
+    for (const auto &entry : voxels) {
+        const Voxel &voxel = entry->second;
+
+        cv::Vec3f &point = filteredPoints.at<cv::Vec3f>(i);
+        for (int c = 0; c < 3; c++) {
+            point[c] = static_cast<float>(voxel.sum[c] / voxel.count);
+        }
+
+        if (channels) {
+            uchar *color = filteredColors.ptr<uchar>(i);
+            for (int c = 0; c < channels; c++) {
+                color[c] = cv::saturate_cast<uchar>(voxel.colorSum[c] / voxel.count);
+            }
+        }
+
+        i++;
+    }
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,80 @@
+/*
+ * MVL Stereo Processor: point cloud filter
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__POINT_CLOUD_FILTER_H
+#define MVL_STEREO_PROCESSOR__POINT_CLOUD_FILTER_H
+
+#include <QtCore>
+#include <opencv2/core.hpp>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Decimation of reprojected point clouds, applied before they are
+// written out. Points are first clipped to the given range of depth
+// (invalid points are always discarded), and then either subsampled
+// with a fixed stride (keeping the organized structure), or reduced to
+// a voxel grid, where each occupied voxel is replaced by the centroid
+// of its points and their average colour.
+class PointCloudFilter
+{
+public:
+    PointCloudFilter ();
+    virtual ~PointCloudFilter ();
+
+    // Decimation, given as none, stride:N or voxel:SIZE; range is given
+    // as min:max (either may be empty)
+    void configure (const QString &decimation, const QString &range);
+
+    bool isEnabled () const;
+
+    // Filter points and their colours (image of same size as points,
+    // may be empty); results are either organized (stride) or N x 1
+    // matrices
+    void apply (const cv::Mat &points, const cv::Mat &colors, cv::Mat &filteredPoints, cv::Mat &filteredColors) const;
+
+protected:
+    void applyStride (const cv::Mat &points, const cv::Mat &colors, cv::Mat &filteredPoints, cv::Mat &filteredColors) const;
+    void applyVoxelGrid (const cv::Mat &points, const cv::Mat &colors, cv::Mat &filteredPoints, cv::Mat &filteredColors) const;
+
+    bool isPointValid (const cv::Vec3f &point) const;
+
+protected:
+    enum Mode {
+        ModeNone,
+        ModeStride,
+        ModeVoxel,
+    } mode;
+
+    int stride;
+    float voxelSize;
+
+    bool rangeClipping;
+    float rangeMin;
+    float rangeMax;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
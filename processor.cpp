@@ -18,19 +18,30 @@
  */
 
 #include "processor.h"
+#include "archive_writer.h"
+#include "async_writer.h"
 #include "debug.h"
+#include "frame_cache.h"
+#include "frame_prefetcher.h"
+#include "memory_budget.h"
+#include "parallel_rectification.h"
+#include "pipeline_cache.h"
+#include "progress_reporter.h"
+#include "server.h"
 #include "utils.h"
 
 #include "source_image.h"
+#include "source_live.h"
 #include "source_video.h"
+#include "source_video_pair.h"
 #include "source_vrms.h"
 
-#include <stereo-pipeline/pipeline.h>
-#include <stereo-pipeline/plugin_manager.h>
-#include <stereo-pipeline/plugin_factory.h>
 #include <stereo-pipeline/utils.h>
 
 #include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
 
 
 namespace MVL {
@@ -38,11 +49,71 @@ namespace StereoProcessor {
 
 
 Processor::Processor ()
+    : numServerWorkers(1),
+      serverCacheSize(8),
+      videoSyncTimestamp(false),
+      numVrmsReaders(1),
+      liveDropFrames(false),
+      watchInput(false),
+      watchTimeout(60),
+      cropRectified(false),
+      cropRectifiedToValidRoi(false),
+      rectifiedRoiInitialized(false),
+      disparityBandHeight(0),
+      disparityBandOverlap(-1),
+      serialRectification(false),
+      grayscale(false),
+      changeThreshold(-1),
+      changeDownsampleFactor(8),
+      frameCacheSize(10240LL * 1024 * 1024),
+      frameCacheDecoded(true),
+      frameCacheRectified(true),
+      numThreads(0),
+      pinThreads(false),
+      threadBudget(&ownThreadBudget),
+      estimateOnly(false),
+      estimateSamples(5),
+      estimateJobs(1),
+      depthScale(1.0),
+      fastIntermediate(false),
+      statsBins(16),
+      statsNearDistance(0),
+      archiveShardSize(0),
+      archiveRegistry(new ArchiveRegistry()),
+      progressInterval(0),
+      progressJsonFd(-1),
+      progressReporter(0),
+      maxMemory(0),
+      frameCache(0),
+      pipelineCache(0),
+      cachedPipeline(0),
+      parallelRectification(0)
 {
 }
 
 Processor::~Processor ()
 {
+    delete progressReporter;
+    delete inputSource;
+    delete parallelRectification;
+    delete stereoReprojection;
+    delete frameCache;
+    qDeleteAll(outputSinks);
+
+    // Return warm pipeline to the cache, or destroy our own
+    if (cachedPipeline) {
+        // Methods created for parameter sweep are our own
+        for (QObject *method : stereoMethods) {
+            if (method != cachedPipeline->stereoMethod) {
+                delete method;
+            }
+        }
+
+        pipelineCache->release(cachedPipeline);
+    } else {
+        delete stereoRectification;
+        qDeleteAll(stereoMethods);
+    }
 }
 
 
@@ -54,13 +125,48 @@ void Processor::run ()
     // Parse command-line arguments
     parseCommandLine();
 
+    // Server mode
+    if (!serverSocket.isEmpty()) {
+        Server server(serverSocket, numServerWorkers, serverCacheSize, numThreads, threadStages, pinThreads);
+        server.start();
+
+        QCoreApplication::exec();
+        return;
+    }
+
+    process();
+}
+
+void Processor::process ()
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    statistics = Statistics();
+
     // Display options
     qCInfo(mvlStereoProcessor) << "";
     qCInfo(mvlStereoProcessor) << "Input file:" << inputFile;
     qCInfo(mvlStereoProcessor) << "Input file type:" << inputFileType;
+    if (inputFileType == "live") {
+        qCInfo(mvlStereoProcessor) << "Live stream format:" << liveFormat;
+        qCInfo(mvlStereoProcessor) << "Drop frames:" << liveDropFrames;
+    }
+    if (watchInput) {
+        qCInfo(mvlStereoProcessor) << "Watch input; idle timeout:" << watchTimeout << "s";
+    }
     qCInfo(mvlStereoProcessor) << "";
     qCInfo(mvlStereoProcessor) << "Stereo calibration file:" << stereoCalibrationFile;
-    qCInfo(mvlStereoProcessor) << "Stereo method config file:" << stereoMethodFile;
+    qCInfo(mvlStereoProcessor) << "Stereo method config file(s):" << stereoMethodFiles;
+    qCInfo(mvlStereoProcessor) << "Stereo method parameter sweep(s):" << stereoMethodSweeps;
+    qCInfo(mvlStereoProcessor) << "Rectified image ROI:" << rectifiedRoiString;
+    qCInfo(mvlStereoProcessor) << "Grayscale processing:" << grayscale;
+    qCInfo(mvlStereoProcessor) << "Change detection threshold:" << changeThreshold;
+    qCInfo(mvlStereoProcessor) << "";
+    qCInfo(mvlStereoProcessor) << "Threads:" << (numThreads ? QString::number(numThreads) : QString("auto"));
+    qCInfo(mvlStereoProcessor) << "Thread stage assignment:" << threadStages;
+    qCInfo(mvlStereoProcessor) << "Pin threads:" << pinThreads;
+    qCInfo(mvlStereoProcessor) << "Memory budget:" << (maxMemory ? QString("%1 MB").arg(maxMemory / (1024 * 1024)) : QString("unlimited"));
     qCInfo(mvlStereoProcessor) << "";
     qCInfo(mvlStereoProcessor) << "Frame range(s):";
     for (const FrameRange &range : frameRanges) {
@@ -68,30 +174,86 @@ void Processor::run ()
     }
     qCInfo(mvlStereoProcessor) << "";
     qCInfo(mvlStereoProcessor) << "Output frame format(s):";
-    for (const QString &format : outputFrames) {
-        qCInfo(mvlStereoProcessor) << " *" << format;
+    for (const OutputFormat &output : outputFrames) {
+        qCInfo(mvlStereoProcessor) << " *" << output.format << "every" << output.stride << "frame(s)";
     }
     qCInfo(mvlStereoProcessor) << "Output rectified format(s):";
-    for (const QString &format : outputRectified) {
-        qCInfo(mvlStereoProcessor) << " *" << format;
+    for (const OutputFormat &output : outputRectified) {
+        qCInfo(mvlStereoProcessor) << " *" << output.format << "every" << output.stride << "frame(s)";
     }
     qCInfo(mvlStereoProcessor) << "Output disparity format(s):";
-    for (const QString &format : outputDisparity) {
-        qCInfo(mvlStereoProcessor) << " *" << format;
+    for (const OutputFormat &output : outputDisparity) {
+        qCInfo(mvlStereoProcessor) << " *" << output.format << "every" << output.stride << "frame(s)";
     }
     qCInfo(mvlStereoProcessor) << "Output points format(s):";
-    for (const QString &format : outputPoints) {
-        qCInfo(mvlStereoProcessor) << " *" << format;
+    for (const OutputFormat &output : outputPoints) {
+        qCInfo(mvlStereoProcessor) << " *" << output.format << "every" << output.stride << "frame(s)";
+    }
+    qCInfo(mvlStereoProcessor) << "Output depth format(s):";
+    for (const OutputFormat &output : outputDepth) {
+        qCInfo(mvlStereoProcessor) << " *" << output.format << "every" << output.stride << "frame(s)";
     }
+    qCInfo(mvlStereoProcessor) << "Output statistics file(s):";
+    for (const OutputFormat &output : outputStats) {
+        qCInfo(mvlStereoProcessor) << " *" << output.format << "every" << output.stride << "frame(s)";
+    }
+    qCInfo(mvlStereoProcessor) << "Fast intermediate encoding:" << fastIntermediate;
     qCInfo(mvlStereoProcessor) << "";
 
     // Validate options
     validateOptions();
 
+    // Distribute threads between processing stages; a shared budget is
+    // configured by its owner, so only the processing thread is pinned
+    if (threadBudget == &ownThreadBudget) {
+        threadBudget->configure(numThreads, threadStages, pinThreads);
+        threadBudget->print();
+        threadBudget->applyComputeSettings();
+    } else {
+        if (numThreads || !threadStages.isEmpty() || pinThreads) {
+            qCWarning(mvlStereoProcessor) << "Threading options are ignored; using shared thread budget.";
+        }
+        threadBudget->pinComputeThread();
+    }
+
     // Setup pipeline
     setupPipeline();
 
+    statistics.setupTime = timer.restart();
+
+    // Dry run; estimate time and disk usage from a few sample frames
+    if (estimateOnly) {
+        qCInfo(mvlStereoProcessor) << "";
+        estimate();
+
+        statistics.processingTime = timer.elapsed();
+        return;
+    }
+
     // Process
+    for (OutputSink *sink : outputSinks) {
+        sink->open();
+    }
+
+    // Periodic progress reports; total number of frames is known only if
+    // all ranges are bounded, or the source has an index of frames
+    if (progressInterval > 0) {
+        qint64 numFramesTotal = 0;
+        for (const FrameRange &range : frameRanges) {
+            int rangeEnd = range.end >= 0 ? range.end : inputSource->getLastFrame();
+            if (rangeEnd < 0) {
+                numFramesTotal = -1;
+                break;
+            }
+            if (rangeEnd >= range.start) {
+                numFramesTotal += (rangeEnd - range.start) / range.step + 1;
+            }
+        }
+
+        progressReporter = new ProgressReporter(progressInterval, progressPrometheusFile, progressJsonFd, outputSinks);
+        progressReporter->start(numFramesTotal);
+    }
+
     for (const FrameRange &range : frameRanges) {
         qCInfo(mvlStereoProcessor) << "";
         qCInfo(mvlStereoProcessor) << "Processing frame range:" << range.start << "to" << range.end << "with step" << range.step;
@@ -100,6 +262,27 @@ void Processor::run ()
 
         qCInfo(mvlStereoProcessor) << "Done!";
     }
+
+    for (OutputSink *sink : outputSinks) {
+        sink->close();
+    }
+
+    if (progressReporter) {
+        progressReporter->stop();
+        delete progressReporter;
+        progressReporter = 0;
+    }
+
+    if (frameCache) {
+        qCInfo(mvlStereoProcessor) << "Frame cache:" << frameCache->getNumHits() << "hits," << frameCache->getNumMisses() << "misses.";
+    }
+
+    statistics.processingTime = timer.elapsed();
+}
+
+const Processor::Statistics &Processor::getStatistics () const
+{
+    return statistics;
 }
 
 
@@ -108,12 +291,23 @@ void Processor::run ()
 // *********************************************************************
 void Processor::processFrameRange (const FrameRange &range)
 {
-    cv::Mat imageLeft, imageRight;
-    cv::Mat rectifiedLeft, rectifiedRight;
-    cv::Mat disparity;
-    cv::Mat points;
+    // Disparities of the last frame for which they were computed (for
+    // each stereo method); kept for reuse by change detection
+    QVector<cv::Mat> previousDisparities;
+
+    QVector<int> numDisparities(stereoMethods.size(), 0);
+
+    // Change detection state
+    cv::Mat changeReference;
+    int numFramesProcessed = 0;
+    int numFramesReused = 0;
 
-    int numDisparities;
+    // Live stream latency; recorded by frames' completion callbacks,
+    // which may run on write threads
+    QMutex latencyMutex;
+    qint64 latencySum = 0;
+    qint64 latencyMax = 0;
+    int numLatencies = 0;
 
     // Variable map for filename formatting
     QHash<QString, QVariant> variableMap;
@@ -121,158 +315,973 @@ void Processor::processFrameRange (const FrameRange &range)
     variableMap["rangeEnd"] = range.end;
     variableMap["rangeStep"] = range.step;
 
-    for (int frame = range.start; range.end < 0 || frame <= range.end; frame += range.step) {
+    // If source has an index of frames, an open-ended range ends at the
+    // last available frame
+    int rangeEnd = range.end;
+    if (inputSource->getNumFrames() == 0) {
+        qCInfo(mvlStereoProcessor) << "No frames available!";
+        return;
+    }
+    if (rangeEnd < 0 && inputSource->getLastFrame() >= 0) {
+        rangeEnd = inputSource->getLastFrame();
+    }
+
+    int numFramesMissing = 0;
+
+    // In grayscale mode, colour images are retrieved only when required
+    // by colour-dependent outputs
+    bool needColor = isColorRequired();
+
+    // With memory budget, the number of frames in flight is bounded by
+    // the budget, and the fixed queue limits are relaxed
+    QScopedPointer<MemoryBudget> memoryBudget;
+    if (maxMemory > 0) {
+        memoryBudget.reset(new MemoryBudget(maxMemory));
+    }
+    int queueFactor = memoryBudget ? 4 : 1;
+
+    // Frames are decoded ahead of processing on the decode thread pool;
+    // live sources are prefetched by only a single frame, to keep latency
+    // low, and sources that buffer frames on their own (live streams)
+    // are not prefetched at all
+    int numDecodeThreads = threadBudget->getNumThreadsPerJob(ThreadBudget::StageDecode);
+    FramePrefetcher prefetcher(inputSource, threadBudget->getThreadPool(ThreadBudget::StageDecode), threadBudget->getCores(ThreadBudget::StageDecode), numDecodeThreads, inputSource->isBuffered() ? 0 : inputSource->isLive() ? 1 : 2*queueFactor*numDecodeThreads, grayscale && needColor);
+
+    // Outputs are written asynchronously on the write thread pool
+    int numWriteThreads = threadBudget->getNumThreadsPerJob(ThreadBudget::StageWrite);
+    AsyncWriter writer(threadBudget->getThreadPool(ThreadBudget::StageWrite), threadBudget->getCores(ThreadBudget::StageWrite), 4*queueFactor*numWriteThreads);
+
+    if (memoryBudget) {
+        prefetcher.setMemoryBudget(memoryBudget.data());
+    }
+
+    if (frameCache && frameCacheDecoded) {
+        prefetcher.setFrameCache(frameCache, decodedCacheKeyBase);
+    }
+
+    // Queue depths are reported only while the queues exist
+    struct QueueReporting {
+        QueueReporting (ProgressReporter *reporter, const FramePrefetcher *prefetcher, const AsyncWriter *writer)
+            : reporter(reporter)
+        {
+            if (reporter) {
+                reporter->attachQueues(prefetcher, writer);
+            }
+        }
+
+        ~QueueReporting ()
+        {
+            if (reporter) {
+                reporter->detachQueues();
+            }
+        }
+
+        ProgressReporter *reporter;
+    } queueReporting(progressReporter, &prefetcher, &writer);
+
+    prefetcher.start(range.start, rangeEnd, range.step);
+
+    FramePrefetcher::Frame item;
+    while (prefetcher.next(item)) {
+        int frame = item.number;
+        int rangeIndex = getRangeIndex(range, frame);
         variableMap["f"] = frame;
 
+        // Memory reserved for the frame is held by this iteration and by
+        // the frame's pending output writes
+        QSharedPointer<FrameInFlight> frameInFlight(new FrameInFlight());
+        frameInFlight->reservation = item.reservation;
+        item.reservation.clear();
+        qint64 outputBytes = 0;
+
+        // Skip gaps in the sequence
+        if (item.missing) {
+            qCDebug(mvlStereoProcessor) << "Frame" << frame << "not available; skipping";
+            numFramesMissing++;
+            if (progressReporter) {
+                progressReporter->addSkippedFrame();
+            }
+            continue;
+        }
+
         qCDebug(mvlStereoProcessor) << "Processing frame" << frame;
 
         // *** Grab frames ***
-        try {
-            inputSource->getFrame(frame, imageLeft, imageRight);
-        } catch (const QString &error) {
+        if (item.failed) {
             // If range is open-ended, just break; otherwise, propagate
             // the error
             if (range.end < 0) {
                 qCInfo(mvlStereoProcessor) << "Reached end of sequence!";
                 break;
             } else {
-                throw error;
+                throw item.error;
             }
         }
 
-        // Export frames
-        for (const QString &format : outputFrames) {
-            // Left
-            variableMap["s"] = "L";
-            QString filenameLeft = Utils::formatString(format, variableMap);
-            Utils::ensureParentDirectoryExists(filenameLeft);
+        // Per-frame buffers are allocated anew for each frame, as they
+        // may still be in use by pending output writes
+        cv::Mat imageLeft = item.imageLeft;
+        cv::Mat imageRight = item.imageRight;
+        cv::Mat colorLeft = item.colorLeft;
+        cv::Mat colorRight = item.colorRight;
+        cv::Mat rectifiedLeft, rectifiedRight;
+        cv::Mat rectifiedColorLeft;
+
+        numFramesProcessed++;
+
+        // Outputs may be produced only for every n-th frame; rectification,
+        // disparity and reprojection are performed only if some output on
+        // this frame requires them
+        bool needPoints = !stereoMethods.isEmpty() && stereoReprojection && isAnyOutputActive(outputPoints, rangeIndex);
+        bool needDepth = !stereoMethods.isEmpty() && stereoReprojection && isAnyOutputActive(outputDepth, rangeIndex);
+        bool needStats = !stereoMethods.isEmpty() && isAnyOutputActive(outputStats, rangeIndex);
+        bool needDisparity = !stereoMethods.isEmpty() && (needPoints || needDepth || needStats || isAnyOutputActive(outputDisparity, rangeIndex));
+        bool needPointColors = needPoints && isPointColorRequired(rangeIndex);
+
+        // *** Change detection ***
+        // If enabled, compare downsampled frames against the last frame
+        // for which disparity was computed, and reuse its disparity and
+        // points if the change is below threshold
+        bool reuseDisparity = false;
+        double change = -1;
+        if (changeThreshold >= 0 && needDisparity) {
+            cv::Mat signature = computeChangeSignature(imageLeft, imageRight);
+
+            if (!changeReference.empty() && changeReference.size() == signature.size()) {
+                change = cv::norm(signature, changeReference, cv::NORM_L1) / signature.total();
+                reuseDisparity = change < changeThreshold;
+
+                qCDebug(mvlStereoProcessor) << "Frame" << frame << "change:" << change << (reuseDisparity ? "(reusing disparity)" : "(recomputing disparity)");
+            }
 
-            if (!cv::imwrite(filenameLeft.toStdString(), imageLeft)) {
-                throw QString("Failed to write output image '%1'").arg(filenameLeft);
+            if (reuseDisparity) {
+                numFramesReused++;
+            } else {
+                changeReference = signature;
             }
+        }
 
+        // Rectified frames are needed for computing disparity (unless it
+        // is reused), for rectified outputs, and as point colours (unless
+        // colour is rectified separately in grayscale mode)
+        bool needRectified = (needDisparity && !reuseDisparity) || isAnyOutputActive(outputRectified, rangeIndex) || (needPointColors && !grayscale);
 
-            // Right
-            variableMap["s"] = "R";
-            QString filenameRight = Utils::formatString(format, variableMap);
-            Utils::ensureParentDirectoryExists(filenameRight);
+        // Export frames
+        if (isAnyOutputActive(outputFrames, rangeIndex)) {
+            OutputFrame data;
+            data.variables = variableMap;
+            data.frameLeft = colorLeft;
+            data.frameRight = colorRight;
 
-            if (!cv::imwrite(filenameRight.toStdString(), imageRight)) {
-                throw QString("Failed to write output image '%1'").arg(filenameRight);
-            }
+            outputBytes += submitOutputs(writer, OutputSink::KindFrames, rangeIndex, data, frameInFlight);
         }
 
         // *** Undistort frames ***
-        if (stereoRectification) {
+        // ROI is determined from the full-size image, and must be set up
+        // even if cropped rectified frames are taken from the cache, as
+        // it also adjusts the reprojection
+        if ((needRectified || needDisparity) && cropRectified && !rectifiedRoiInitialized) {
+            setupRectifiedRoi(imageLeft.size());
+        }
+
+        // Look up rectified (and cropped) frames in frame cache
+        QString rectifiedCacheKey;
+        bool rectifiedCached = false;
+        if (needRectified && frameCache && frameCacheRectified) {
+            rectifiedCacheKey = FrameCache::makeKey(QStringList() << rectifiedCacheKeyBase << QString::number(frame) << inputSource->getFrameIdentity(frame));
+            rectifiedCached = frameCache->lookup(rectifiedCacheKey, rectifiedLeft, rectifiedRight);
+        }
+
+        if (!needRectified || rectifiedCached) {
+            // Nothing to do for this frame
+        } else if (stereoRectification) {
             // Rectify
-            stereoRectification->rectifyImagePair(imageLeft, imageRight, rectifiedLeft, rectifiedRight);
+            rectifyImagePair(imageLeft, imageRight, rectifiedLeft, rectifiedRight);
         } else {
             // Passthrough (assume images are already rectified)
             rectifiedLeft = imageLeft;
             rectifiedRight = imageRight;
         }
 
-        // Export rectified frames
-        for (const QString &format : outputRectified) {
-            // Left
-            variableMap["s"] = "L";
-            QString filenameLeft = Utils::formatString(format, variableMap);
-            Utils::ensureParentDirectoryExists(filenameLeft);
+        // Crop rectified images to ROI
+        if (needRectified && !rectifiedCached && cropRectified) {
+            rectifiedLeft = rectifiedLeft(rectifiedRoi).clone();
+            rectifiedRight = rectifiedRight(rectifiedRoi).clone();
+        }
+
+        // Store rectified frames into frame cache
+        if (!rectifiedCacheKey.isEmpty() && !rectifiedCached) {
+            FrameCache *cache = frameCache;
+            writer.submit([cache, rectifiedCacheKey, rectifiedLeft, rectifiedRight, frameInFlight] () {
+                cache->store(rectifiedCacheKey, rectifiedLeft, rectifiedRight);
+            });
+        }
+
+        // Export rectified frames
+        if (isAnyOutputActive(outputRectified, rangeIndex)) {
+            OutputFrame data;
+            data.variables = variableMap;
+            data.rectifiedLeft = rectifiedLeft;
+            data.rectifiedRight = rectifiedRight;
+
+            outputBytes += submitOutputs(writer, OutputSink::KindRectified, rangeIndex, data, frameInFlight);
+        }
+
+
+        // *** Compute disparity ***
+        // With several stereo methods, all of them are fed the same
+        // rectified pair, and run in parallel
+        int numMethods = stereoMethods.size();
+        QVector<cv::Mat> disparities(numMethods);
+        QVector<cv::Mat> points(numMethods);
+
+        if (needDisparity) {
+            // Compute disparity (unless we are reusing the previous one)
+            if (!reuseDisparity) {
+                computeDisparities(rectifiedLeft, rectifiedRight, disparities, numDisparities);
+                previousDisparities = disparities;
+            } else {
+                disparities = previousDisparities;
+            }
+
+            // Export disparity
+            if (isAnyOutputActive(outputDisparity, rangeIndex)) {
+                for (int m = 0; m < numMethods; m++) {
+                    OutputFrame data;
+                    data.variables = variableMap;
+                    data.variables["m"] = stereoMethodLabels[m];
+                    data.disparity = disparities[m];
+                    data.numDisparities = numDisparities[m];
+
+                    outputBytes += submitOutputs(writer, OutputSink::KindDisparity, rangeIndex, data, frameInFlight);
+                }
+            }
+        }
+
+        // *** Reproject point cloud ***
+        // (only possible if stereo method is active)
+        if (needPoints) {
+            // Point colours are taken from rectified left image, and are
+            // needed only by PCD outputs; in grayscale mode, rectify
+            // colour image on demand
+            if (needPointColors) {
+                if (grayscale) {
+                    // Only the left image provides colours
+                    rectifyLeftImage(colorLeft, rectifiedColorLeft);
+                    if (cropRectified) {
+                        rectifiedColorLeft = rectifiedColorLeft(rectifiedRoi);
+                    }
+                } else {
+                    rectifiedColorLeft = rectifiedLeft;
+                }
+            }
+
+            for (int m = 0; m < numMethods; m++) {
+                // Points are reprojected also from reused disparity, as
+                // the frame for which it was computed may not have
+                // required points
+                stereoReprojection->reprojectDisparity(disparities[m], points[m]);
+
+                // Export point cloud, with optional decimation and
+                // range clipping (filter output must not share data with
+                // its input)
+                OutputFrame data;
+                data.variables = variableMap;
+                data.variables["m"] = stereoMethodLabels[m];
+
+                if (pointCloudFilter.isEnabled()) {
+                    pointCloudFilter.apply(points[m], rectifiedColorLeft, data.points, data.pointColors);
+                } else {
+                    data.points = points[m];
+                    data.pointColors = rectifiedColorLeft;
+                }
+
+                outputBytes += submitOutputs(writer, OutputSink::KindPoints, rangeIndex, data, frameInFlight);
+            }
+        }
+
+        // *** Depth ***
+        // Computed directly from disparity, without full reprojection
+        if (needDepth) {
+            for (int m = 0; m < numMethods; m++) {
+                OutputFrame data;
+                data.variables = variableMap;
+                data.variables["m"] = stereoMethodLabels[m];
+                Utils::computeDepthFromDisparity(disparities[m], reprojectionMatrix, data.depth);
+
+                outputBytes += submitOutputs(writer, OutputSink::KindDepth, rangeIndex, data, frameInFlight);
+            }
+        }
+
+        // *** Summary statistics ***
+        // Reduced from disparity on the write thread pool
+        if (needStats) {
+            for (int m = 0; m < numMethods; m++) {
+                OutputFrame data;
+                data.variables = variableMap;
+                data.variables["m"] = stereoMethodLabels[m];
+                data.disparity = disparities[m];
+                data.numDisparities = numDisparities[m];
+                if (stereoReprojection) {
+                    data.reprojectionMatrix = reprojectionMatrix;
+                }
+                data.disparityReused = reuseDisparity;
+                data.change = change;
+
+                outputBytes += submitOutputs(writer, OutputSink::KindStats, rangeIndex, data, frameInFlight);
+            }
+        }
+
+        // *** Live stream latency ***
+        // Measured from capture until the frame's last output is written
+        // (or until the end of processing, if it has no outputs)
+        if (inputSource->isLive()) {
+            qint64 timestamp = item.timestamp;
+            frameInFlight->finished = [&latencyMutex, &latencySum, &latencyMax, &numLatencies, frame, timestamp] () {
+                qint64 latency = QDateTime::currentMSecsSinceEpoch() - timestamp;
+
+                QMutexLocker locker(&latencyMutex);
+                latencySum += latency;
+                latencyMax = std::max(latencyMax, latency);
+                numLatencies++;
+
+                qCDebug(mvlStereoProcessor) << "Frame" << frame << "latency:" << latency << "ms";
+            };
+        }
+
+        // *** Memory budget ***
+        // Measured footprint of the frame replaces the estimate it was
+        // admitted with; it consists of the frame's buffers, plus the
+        // raw matrix footprint of the data handed to each active sink
+        // (outputBytes), as a stand-in for the sinks' encode buffers,
+        // whose actual size is not known
+        if (frameInFlight->reservation) {
+            QVector<cv::Mat> buffers = { imageLeft, imageRight, colorLeft, colorRight, rectifiedLeft, rectifiedRight, rectifiedColorLeft };
+            buffers += disparities;
+            buffers += points;
+
+            qint64 footprint = getMatrixFootprint(buffers) + outputBytes;
+            frameInFlight->reservation->resize(footprint);
+            memoryBudget->updateFrameEstimate(footprint);
+        }
+
+        if (progressReporter) {
+            progressReporter->addFrame();
+        }
+    }
+
+    // Wait for pending writes (and propagate their errors)
+    writer.waitForDone();
+
+    if (inputSource->isLive() && numLatencies > 0) {
+        qCInfo(mvlStereoProcessor) << "Live stream latency: average" << latencySum / numLatencies << "ms, maximum" << latencyMax << "ms; dropped" << inputSource->getNumDroppedFrames() << "frames.";
+    }
+
+    if (numFramesMissing) {
+        qCInfo(mvlStereoProcessor) << "Skipped" << numFramesMissing << "missing frames.";
+    }
+
+    if (memoryBudget) {
+        qCInfo(mvlStereoProcessor) << "Memory budget:" << memoryBudget->getFrameEstimate() / (1024 * 1024) << "MB per frame; peak usage" << memoryBudget->getPeakUsage() / (1024 * 1024) << "MB of" << memoryBudget->getLimit() / (1024 * 1024) << "MB, with up to" << memoryBudget->getPeakFrames() << "frames in flight.";
+    }
+
+    statistics.numFrames += numFramesProcessed;
+    statistics.numFramesReused += numFramesReused;
+
+    if (changeThreshold >= 0) {
+        qCInfo(mvlStereoProcessor) << "Reused disparity for" << numFramesReused << "out of" << numFramesProcessed << "frames.";
+    }
+}
+
+
+cv::Mat Processor::computeChangeSignature (const cv::Mat &imageLeft, const cv::Mat &imageRight) const
+{
+    // Downsampled grayscale versions of both images, stacked on top of
+    // each other
+    const double scale = 1.0 / changeDownsampleFactor;
+    cv::Mat signature;
+
+    for (const cv::Mat &image : { imageLeft, imageRight }) {
+        cv::Mat gray, small;
+        if (image.channels() == 3) {
+            cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+        } else {
+            gray = image;
+        }
+        cv::resize(gray, small, cv::Size(), scale, scale, cv::INTER_AREA);
+
+        signature.push_back(small);
+    }
+
+    return signature;
+}
+
+
+void Processor::computeDisparities (const cv::Mat &rectifiedLeft, const cv::Mat &rectifiedRight, QVector<cv::Mat> &disparities, QVector<int> &numDisparities)
+{
+    // Additional methods run on the method stage's thread pool (so that
+    // they stay within the thread budget), while the first one runs on
+    // the processing thread
+    int numMethods = stereoMethods.size();
+    QVector<QString> errors(numMethods);
+    QSemaphore tasksDone;
+
+    auto compute = [this, &rectifiedLeft, &rectifiedRight, &disparities, &numDisparities, &errors] (int m) {
+        try {
+            computeMethodDisparity(qobject_cast<MVL::StereoToolbox::Pipeline::StereoMethod *>(stereoMethods[m]), rectifiedLeft, rectifiedRight, disparities[m], numDisparities[m]);
+        } catch (const QString &e) {
+            errors[m] = e;
+        } catch (const cv::Exception &e) {
+            errors[m] = QString::fromStdString(e.what());
+        }
+    };
+
+    QThreadPool *threadPool = threadBudget->getThreadPool(ThreadBudget::StageMethod);
+    const QList<int> &cores = threadBudget->getCores(ThreadBudget::StageMethod);
+    for (int m = 1; m < numMethods; m++) {
+        Utils::runInThreadPool(threadPool, [&compute, &tasksDone, &cores, m] () {
+            ThreadBudget::pinCurrentThread(cores);
+            compute(m);
+            tasksDone.release();
+        });
+    }
+
+    compute(0);
+
+    // Wait for all tasks before propagating any error, as they reference
+    // our buffers
+    tasksDone.acquire(numMethods - 1);
+
+    for (int m = 0; m < numMethods; m++) {
+        if (!errors[m].isEmpty()) {
+            throw QString("Failed to compute disparity: %1").arg(m ? QString("%1: %2").arg(stereoMethodLabels[m]).arg(errors[m]) : errors[m]);
+        }
+    }
+}
+
+void Processor::computeMethodDisparity (MVL::StereoToolbox::Pipeline::StereoMethod *method, const cv::Mat &rectifiedLeft, const cv::Mat &rectifiedRight, cv::Mat &disparity, int &numDisparities) const
+{
+    int rows = rectifiedLeft.rows;
+
+    if (disparityBandHeight <= 0 || rows <= disparityBandHeight) {
+        method->computeDisparity(rectifiedLeft, rectifiedRight, disparity, numDisparities);
+        return;
+    }
+
+    // Tiled mode; the pair is split into horizontal bands, which are
+    // extended by overlap so that the matching window of rows in the
+    // band core sees the same neighbourhood as in the full image. The
+    // result is an approximation: methods that aggregate costs along
+    // paths across the whole image (e.g., semi-global matching) see only
+    // the band, so their output differs from the full-image disparity,
+    // mostly near band boundaries. Bands are processed one after
+    // another, as stereo method objects are not re-entrant; this bounds
+    // the method's working memory (e.g., cost volume) by band size, but
+    // the full-size input and output images are still kept in memory
+    int overlap = getDisparityBandOverlap(method);
+
+    disparity = cv::Mat();
+
+    for (int coreStart = 0; coreStart < rows; coreStart += disparityBandHeight) {
+        int coreEnd = std::min(coreStart + disparityBandHeight, rows);
+        int bandStart = std::max(0, coreStart - overlap);
+        int bandEnd = std::min(rows, coreEnd + overlap);
+
+        cv::Mat bandDisparity;
+        method->computeDisparity(rectifiedLeft.rowRange(bandStart, bandEnd), rectifiedRight.rowRange(bandStart, bandEnd), bandDisparity, numDisparities);
+
+        if (bandDisparity.rows != bandEnd - bandStart) {
+            throw QString("Stereo method returned disparity with %1 rows for band of %2 rows!").arg(bandDisparity.rows).arg(bandEnd - bandStart);
+        }
+
+        // Stitch band core into output
+        if (disparity.empty()) {
+            disparity.create(rows, bandDisparity.cols, bandDisparity.type());
+        }
+        bandDisparity.rowRange(coreStart - bandStart, coreEnd - bandStart).copyTo(disparity.rowRange(coreStart, coreEnd));
+    }
+}
+
+int Processor::getDisparityBandOverlap (const QObject *method) const
+{
+    if (disparityBandOverlap >= 0) {
+        return disparityBandOverlap;
+    }
+
+    // Heuristic; derived from matching window size of the method, if it
+    // exposes it as a parameter, with a margin for post-filtering. It
+    // does not cover cost aggregation beyond the window, so the stitched
+    // disparity is approximate either way
+    int windowSize = getMethodWindowSize(method);
+    if (windowSize > 0) {
+        return 2*windowSize + 8;
+    }
+
+    return 32;
+}
+
+int Processor::getMethodWindowSize (const QObject *method)
+{
+    for (const char *name : { "blockSize", "windowSize", "SADWindowSize" }) {
+        bool ok;
+        int windowSize = method->property(name).toInt(&ok);
+        if (ok && windowSize > 0) {
+            return windowSize;
+        }
+    }
+
+    return -1;
+}
+
+
+// *********************************************************************
+// *                              Outputs                              *
+// *********************************************************************
+bool Processor::isColorRequired () const
+{
+    for (const OutputSink *sink : outputSinks) {
+        if (sink->requiresColor()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Processor::isPointColorRequired (int rangeIndex) const
+{
+    for (const OutputSink *sink : outputSinks) {
+        if (sink->getKind() == OutputSink::KindPoints && sink->isActive(rangeIndex) && sink->requiresColor()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Hand frame data to all active sinks of given kind; sinks format
+// filenames and encode the data on the write thread pool
+qint64 Processor::submitOutputs (AsyncWriter &writer, OutputSink::Kind kind, int rangeIndex, const OutputFrame &data, const QSharedPointer<FrameInFlight> &frameInFlight) const
+{
+    qint64 dataBytes = getMatrixFootprint({ data.frameLeft, data.frameRight, data.rectifiedLeft, data.rectifiedRight, data.disparity, data.points, data.pointColors, data.depth });
+    qint64 bytes = 0;
+
+    for (OutputSink *sink : outputSinks) {
+        if (sink->getKind() == kind && sink->isActive(rangeIndex)) {
+            writer.submit([sink, data, frameInFlight] () {
+                sink->write(data);
+            });
+            bytes += dataBytes;
+        }
+    }
+
+    return bytes;
+}
+
+qint64 Processor::getMatrixFootprint (const QVector<cv::Mat> &matrices)
+{
+    // Matrices that share data (e.g., ROI views) are counted once
+    QSet<const uchar *> buffers;
+    qint64 bytes = 0;
+
+    for (const cv::Mat &matrix : matrices) {
+        if (!matrix.empty() && !buffers.contains(matrix.datastart)) {
+            buffers.insert(matrix.datastart);
+            bytes += matrix.dataend - matrix.datastart;
+        }
+    }
+
+    return bytes;
+}
+
+
+// *********************************************************************
+// *                       Dry-run estimation                          *
+// *********************************************************************
+void Processor::estimate ()
+{
+    // *** Enumerate frames to be processed ***
+    // Frames of open-ended ranges are known only if source has an index
+    // of frames; otherwise, only per-frame figures can be reported
+    QVector<int> frames;
+    QVector<int> frameRangeIndices; // for per-output strides
+    bool totalKnown = true;
+
+    for (const FrameRange &range : frameRanges) {
+        int rangeEnd = range.end;
+        if (rangeEnd < 0) {
+            rangeEnd = inputSource->getLastFrame();
+        }
+
+        if (rangeEnd < 0 || inputSource->isLive()) {
+            // Unknown extent; sample from the beginning of the range
+            totalKnown = false;
+            rangeEnd = range.start + (estimateSamples - 1)*range.step;
+        }
+
+        for (int frame = range.start; frame <= rangeEnd; frame += range.step) {
+            if (inputSource->isFrameAvailable(frame)) {
+                frames.append(frame);
+                frameRangeIndices.append(getRangeIndex(range, frame));
+            }
+        }
+    }
+
+    if (frames.isEmpty()) {
+        qCInfo(mvlStereoProcessor) << "No frames available!";
+        return;
+    }
+
+    // *** Sample clusters of consecutive frames across the planned ranges ***
+    // Frames are sampled in a few clusters, spread evenly across the
+    // ranges, and processed in order within each cluster, as they would
+    // be by the actual run. Reaching the first frame of a cluster may
+    // require a seek (which, for video sources, means decoding all the
+    // frames in between), so that frame only positions the source, and
+    // is not timed
+    struct Sample {
+        int frame;
+        bool timed;
+    };
+
+    const int clusterLength = 4;
+    int numClusters = (std::min(estimateSamples, frames.size()) + clusterLength - 1) / clusterLength;
+
+    QVector<Sample> samples;
+    int numSamples = 0;
+    int previousIndex = -1;
+    for (int cluster = 0; cluster < numClusters; cluster++) {
+        int length = std::min(clusterLength, estimateSamples - cluster*clusterLength);
+        int first = numClusters > 1 ? static_cast<int>(static_cast<qint64>(cluster) * std::max(frames.size() - length - 1, 0) / (numClusters - 1)) : 0;
+        first = std::max(first, previousIndex + 1);
+        if (first >= frames.size()) {
+            break;
+        }
+
+        // Positioning frame, unless the cluster continues the previous
+        // one (or there is only a single frame to sample)
+        if ((previousIndex < 0 || first > previousIndex + 1) && first + 1 < frames.size()) {
+            samples.append({ frames[first], false });
+            first++;
+        }
+
+        int last = std::min(first + length, frames.size()) - 1;
+        for (int i = first; i <= last; i++) {
+            samples.append({ frames[i], true });
+            numSamples++;
+        }
+        previousIndex = last;
+    }
+
+    // *** Run pipeline on samples ***
+    // Outputs are written to a temporary directory, so that both
+    // encoding time and size of encoded files are measured
+    QTemporaryDir outputDir;
+    if (!outputDir.isValid()) {
+        throw QString("Failed to create temporary directory for estimation!");
+    }
+
+    enum { TimeDecode, TimeRectify, TimeMethod, TimeReproject, NumTimes };
+    qint64 stageTime[NumTimes] = { 0 };
+
+    // Per-sink encoding time (ns) and encoded size (bytes); each output
+    // sink is mirrored by a sink of the same type that writes into its
+    // own subdirectory of the temporary directory
+    // (statistics, which are collected into a single file, are measured
+    // at the end). Archive members are written as plain files, and the
+    // tar header, padding and index entry of each are added to its size
+    QList<QSharedPointer<OutputSink>> estimateSinks;
+    for (int i = 0; i < outputSinks.size(); i++) {
+        const OutputSink *sink = outputSinks[i];
+        bool perMethod = sink->getKind() != OutputSink::KindFrames && sink->getKind() != OutputSink::KindRectified;
+
+        QString format;
+        if (sink->getKind() == OutputSink::KindStats) {
+            format = QString("%1/%2/%3").arg(outputDir.path()).arg(i).arg(QFileInfo(sink->getFormat()).fileName());
+        } else {
+            format = QString("%1/%2/%3-%4").arg(outputDir.path()).arg(i).arg(perMethod ? "%{m}" : "%{s}").arg(QFileInfo(sink->getFormat()).fileName());
+        }
+        if (!sink->getEncoderOptions().isEmpty()) {
+            format += "?" + sink->getEncoderOptions();
+        }
+
+        QSharedPointer<OutputSink> estimateSink(OutputSink::create(sink->getKind(), format, 1, getSinkOptions()));
+        estimateSink->open();
+        estimateSinks.append(estimateSink);
+    }
+    QVector<qint64> sinkTime(outputSinks.size(), 0);
+    QVector<qint64> sinkSize(outputSinks.size(), 0);
+
+    bool needColor = isColorRequired();
+
+    QHash<QString, QVariant> variableMap;
+    QElapsedTimer timer;
+
+    qCInfo(mvlStereoProcessor) << "Estimating on" << numSamples << "sample frame(s) in" << numClusters << "cluster(s) out of" << frames.size() << (totalKnown ? "" : "(extent of input is unknown)");
+
+    for (const Sample &sample : samples) {
+        int frame = sample.frame;
+        variableMap["f"] = frame;
+
+        cv::Mat imageLeft, imageRight;
+        cv::Mat colorLeft, colorRight;
+        cv::Mat rectifiedLeft, rectifiedRight;
+        QVector<cv::Mat> disparities(stereoMethods.size());
+        QVector<cv::Mat> points(stereoMethods.size());
+        QVector<int> numDisparities(stereoMethods.size(), 0);
+
+        // Decode
+        timer.start();
+        inputSource->getFrame(frame, imageLeft, imageRight);
+        if (grayscale && needColor) {
+            inputSource->getColorFrame(frame, colorLeft, colorRight);
+        } else {
+            colorLeft = imageLeft;
+            colorRight = imageRight;
+        }
+        if (!sample.timed) {
+            continue;
+        }
+        stageTime[TimeDecode] += timer.nsecsElapsed();
+
+        // Rectify
+        timer.start();
+        if (stereoRectification) {
+            rectifyImagePair(imageLeft, imageRight, rectifiedLeft, rectifiedRight);
+        } else {
+            rectifiedLeft = imageLeft;
+            rectifiedRight = imageRight;
+        }
+        if (cropRectified) {
+            if (!rectifiedRoiInitialized) {
+                setupRectifiedRoi(rectifiedLeft.size());
+            }
+            rectifiedLeft = rectifiedLeft(rectifiedRoi).clone();
+            rectifiedRight = rectifiedRight(rectifiedRoi).clone();
+        }
+        stageTime[TimeRectify] += timer.nsecsElapsed();
+
+        // Stereo method(s)
+        if (!stereoMethods.isEmpty()) {
+            timer.start();
+            computeDisparities(rectifiedLeft, rectifiedRight, disparities, numDisparities);
+            stageTime[TimeMethod] += timer.nsecsElapsed();
+        }
+
+        // Reprojection
+        cv::Mat rectifiedColorLeft = rectifiedLeft;
+        if (!stereoMethods.isEmpty() && stereoReprojection) {
+            timer.start();
+            for (int m = 0; m < stereoMethods.size(); m++) {
+                stereoReprojection->reprojectDisparity(disparities[m], points[m]);
+            }
+            stageTime[TimeReproject] += timer.nsecsElapsed();
+
+            if (grayscale && needColor) {
+                cv::Mat rectifiedColorRight;
+                rectifyImagePair(colorLeft, colorRight, rectifiedColorLeft, rectifiedColorRight);
+                if (cropRectified) {
+                    rectifiedColorLeft = rectifiedColorLeft(rectifiedRoi);
+                }
+            }
+        }
+
+        // Outputs
+        for (int i = 0; i < estimateSinks.size(); i++) {
+            OutputSink *sink = estimateSinks[i].data();
+            int numWrites = (sink->getKind() == OutputSink::KindFrames || sink->getKind() == OutputSink::KindRectified) ? 1 : stereoMethods.size();
+
+            timer.start();
+            for (int m = 0; m < numWrites; m++) {
+                OutputFrame data;
+                data.variables = variableMap;
+                data.variables["m"] = m;
+
+                switch (sink->getKind()) {
+                    case OutputSink::KindFrames: {
+                        data.frameLeft = colorLeft;
+                        data.frameRight = colorRight;
+                        break;
+                    }
+                    case OutputSink::KindRectified: {
+                        data.rectifiedLeft = rectifiedLeft;
+                        data.rectifiedRight = rectifiedRight;
+                        break;
+                    }
+                    case OutputSink::KindDisparity: {
+                        data.disparity = disparities[m];
+                        data.numDisparities = numDisparities[m];
+                        break;
+                    }
+                    case OutputSink::KindPoints: {
+                        if (pointCloudFilter.isEnabled()) {
+                            pointCloudFilter.apply(points[m], rectifiedColorLeft, data.points, data.pointColors);
+                        } else {
+                            data.points = points[m];
+                            data.pointColors = rectifiedColorLeft;
+                        }
+                        break;
+                    }
+                    case OutputSink::KindDepth: {
+                        Utils::computeDepthFromDisparity(disparities[m], reprojectionMatrix, data.depth);
+                        break;
+                    }
+                    case OutputSink::KindStats: {
+                        data.disparity = disparities[m];
+                        data.numDisparities = numDisparities[m];
+                        if (stereoReprojection) {
+                            data.reprojectionMatrix = reprojectionMatrix;
+                        }
+                        break;
+                    }
+                }
+
+                sink->write(data);
+            }
+            sinkTime[i] += timer.nsecsElapsed();
+
+            // Measure and remove written files
+            if (sink->getKind() != OutputSink::KindStats) {
+                const QString &archivePath = outputSinks[i]->getArchivePath();
+                QString memberDirectory = QFileInfo(outputSinks[i]->getFormat()).path();
+
+                QDir directory(QString("%1/%2").arg(outputDir.path()).arg(i));
+                for (const QFileInfo &file : directory.entryInfoList(QDir::Files)) {
+                    if (archivePath.isEmpty()) {
+                        sinkSize[i] += file.size();
+                    } else {
+                        // Member name, without the method/side prefix
+                        QString member = file.fileName().section('-', 1);
+                        if (memberDirectory != ".") {
+                            member = memberDirectory + "/" + member;
+                        }
+                        sinkSize[i] += ArchiveWriter::getAppendedSize(archivePath, archiveShardSize, member, file.size());
+                    }
+                    QFile::remove(file.absoluteFilePath());
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < estimateSinks.size(); i++) {
+        estimateSinks[i]->close();
+
+        if (estimateSinks[i]->getKind() == OutputSink::KindStats) {
+            sinkSize[i] = QFileInfo(estimateSinks[i]->getFormat()).size();
+        }
+    }
+
+    // *** Report ***
+    auto formatTime = [] (double seconds) -> QString {
+        if (seconds < 120) {
+            return QString("%1 s").arg(seconds, 0, 'f', 1);
+        } else if (seconds < 7200) {
+            return QString("%1 min").arg(seconds / 60, 0, 'f', 1);
+        } else {
+            return QString("%1 h").arg(seconds / 3600, 0, 'f', 1);
+        }
+    };
+    auto formatSize = [] (double bytes) -> QString {
+        const char *units[] = { "B", "kB", "MB", "GB", "TB" };
+        int unit = 0;
+        while (bytes >= 1024 && unit < 4) {
+            bytes /= 1024;
+            unit++;
+        }
+        return QString("%1 %2").arg(bytes, 0, 'f', 1).arg(units[unit]);
+    };
+
+    const char *stageNames[NumTimes] = { "decode", "rectify", "method", "reproject" };
+
+    qCInfo(mvlStereoProcessor) << "";
+    qCInfo(mvlStereoProcessor) << "Per-frame time of processing stages:";
+    // With per-output strides, rectification, disparity and reprojection
+    // are performed only on a fraction of frames
+    double stageFraction[NumTimes] = { 1.0, 0.0, 0.0, 0.0 };
+    for (int rangeIndex : frameRangeIndices) {
+        bool needPoints = !stereoMethods.isEmpty() && stereoReprojection && isAnyOutputActive(outputPoints, rangeIndex);
+        bool needDepth = !stereoMethods.isEmpty() && stereoReprojection && isAnyOutputActive(outputDepth, rangeIndex);
+        bool needStats = !stereoMethods.isEmpty() && isAnyOutputActive(outputStats, rangeIndex);
+        bool needDisparity = !stereoMethods.isEmpty() && (needPoints || needDepth || needStats || isAnyOutputActive(outputDisparity, rangeIndex));
+        bool needRectified = needDisparity || isAnyOutputActive(outputRectified, rangeIndex);
+
+        stageFraction[TimeRectify] += needRectified;
+        stageFraction[TimeMethod] += needDisparity;
+        stageFraction[TimeReproject] += needPoints;
+    }
+    for (int i = TimeRectify; i < NumTimes; i++) {
+        stageFraction[i] /= frames.size();
+    }
+
+    double computeTime = 0;
+    for (int i = 0; i < NumTimes; i++) {
+        double ms = stageTime[i] / 1e6 / numSamples;
+        if (i != TimeDecode) {
+            computeTime += ms * stageFraction[i];
+        }
+        qCInfo(mvlStereoProcessor) << " *" << stageNames[i] << ":" << qPrintable(QString::number(ms, 'f', 2)) << "ms";
+    }
+
+    qCInfo(mvlStereoProcessor) << "Per-frame encoding time and size of outputs:";
+    double writeTime = 0;
+    double frameSize = 0;
+    for (int i = 0; i < outputSinks.size(); i++) {
+        const OutputSink *sink = outputSinks[i];
+        double ms = sinkTime[i] / 1e6 / numSamples;
+        double bytes = static_cast<double>(sinkSize[i]) / numSamples;
+        writeTime += ms / sink->getStride();
+        frameSize += bytes / sink->getStride();
+        QString label = sink->getFormat();
+        if (!sink->getEncoderOptions().isEmpty()) {
+            label += " (" + sink->getEncoderOptions() + ")";
+        }
+        qCInfo(mvlStereoProcessor) << " *" << qPrintable(OutputSink::getKindName(sink->getKind())) << qPrintable(label) << ":" << qPrintable(QString::number(ms, 'f', 2)) << "ms," << qPrintable(formatSize(bytes));
+    }
+
+    // Decoding and writing overlap with computation; the throughput is
+    // bounded by the slowest of the three stages. Frames are decoded by
+    // several workers only if the source supports concurrent access
+    // (see FramePrefetcher)
+    int numDecodeWorkers = inputSource->supportsConcurrentAccess() ? threadBudget->getNumThreadsPerJob(ThreadBudget::StageDecode) : 1;
+    double decodeTime = stageTime[TimeDecode] / 1e6 / numSamples;
+    double frameTime = std::max({ decodeTime / numDecodeWorkers, computeTime, writeTime / threadBudget->getNumThreadsPerJob(ThreadBudget::StageWrite) });
+
+    qCInfo(mvlStereoProcessor) << "";
+    qCInfo(mvlStereoProcessor) << "Estimated throughput:" << qPrintable(QString::number(1000.0 / frameTime, 'f', 2)) << "frames/s (" << qPrintable(QString::number(frameTime, 'f', 2)) << "ms per frame )";
+    qCInfo(mvlStereoProcessor) << "Estimated average disk usage per frame:" << qPrintable(formatSize(frameSize));
+
+    if (!totalKnown) {
+        qCInfo(mvlStereoProcessor) << "Total number of frames is unknown; totals cannot be extrapolated.";
+        return;
+    }
 
-            if (!cv::imwrite(filenameLeft.toStdString(), rectifiedLeft)) {
-                throw QString("Failed to write output image '%1'").arg(filenameLeft);
-            }
+    double totalTime = frames.size() * frameTime / 1000.0 + statistics.setupTime / 1000.0;
+    double totalSize = frames.size() * frameSize;
 
+    qCInfo(mvlStereoProcessor) << "Estimated total for" << frames.size() << "frames:" << qPrintable(formatTime(totalTime)) << "," << qPrintable(formatSize(totalSize));
 
-            // Right
-            variableMap["s"] = "R";
-            QString filenameRight = Utils::formatString(format, variableMap);
-            Utils::ensureParentDirectoryExists(filenameRight);
+    if (estimateJobs > 1) {
+        int framesPerJob = (frames.size() + estimateJobs - 1) / estimateJobs;
+        qCInfo(mvlStereoProcessor) << "Estimated per job, with" << estimateJobs << "jobs:" << framesPerJob << "frames," << qPrintable(formatTime(framesPerJob * frameTime / 1000.0 + statistics.setupTime / 1000.0)) << "," << qPrintable(formatSize(framesPerJob * frameSize));
+    }
 
-            if (!cv::imwrite(filenameRight.toStdString(), rectifiedRight)) {
-                throw QString("Failed to write output image '%1'").arg(filenameRight);
-            }
+    // Check available disk space at output locations
+    QHash<QString, qint64> requiredSpace;
+    for (int i = 0; i < outputSinks.size(); i++) {
+        const OutputSink *sink = outputSinks[i];
+        QString directory = QFileInfo(sink->getArchivePath().isEmpty() ? sink->getFormat() : sink->getArchivePath()).absolutePath();
+        while (!QFileInfo(directory).exists() && directory != "/") {
+            directory = QFileInfo(directory).absolutePath();
         }
 
+        QString root = QStorageInfo(directory).rootPath();
+        requiredSpace[root] += static_cast<qint64>(frames.size() * static_cast<double>(sinkSize[i]) / numSamples / sink->getStride());
+    }
 
-        // *** Compute disparity ***
-        if (stereoMethod) {
-            // Compute disparity
-            qobject_cast<MVL::StereoToolbox::Pipeline::StereoMethod *>(stereoMethod)->computeDisparity(rectifiedLeft, rectifiedRight, disparity, numDisparities);
-
-            // Export disparity
-            for (const QString &format : outputDisparity) {
-                QString filename = Utils::formatString(format, variableMap);
-                QString ext = QFileInfo(filename).completeSuffix();
-
-                Utils::ensureParentDirectoryExists(filename);
-
-                if (ext == "xml" || ext == "yml" || ext == "yaml") {
-                    // Save raw disparity in OpenCV storage format
-                    try {
-                        cv::FileStorage fs(filename.toStdString(), cv::FileStorage::WRITE);
-                        fs << "disparity" << disparity;
-                    } catch (const cv::Exception &error) {
-                        throw QString("Failed to save matrix to file %1: %2").arg(filename).arg(QString::fromStdString(error.what()));
-                    }
-                } else if (ext == "bin") {
-                    // Save raw disparity in custom binary matrix format
-                    try {
-                        MVL::StereoToolbox::Pipeline::Utils::writeMatrixToBinaryFile(disparity, filename);
-                    } catch (const QString &error) {
-                        throw QString("Failed to save binary file %1: %2").arg(filename).arg(error);
-                    }
-                } else {
-                    // Save disparity visualization as image using cv::imwrite
-                    try {
-                        cv::Mat visualization;
-                        MVL::StereoToolbox::Pipeline::Utils::createColorCodedDisparityCpu(disparity, visualization, numDisparities);
-                        cv::imwrite(filename.toStdString(), visualization);
-                    } catch (const cv::Exception &error) {
-                        throw QString("Failed to save image %1: %2").arg(filename).arg(QString::fromStdString(error.what()));
-                    }
-                }
-            }
+    for (auto it = requiredSpace.constBegin(); it != requiredSpace.constEnd(); ++it) {
+        QStorageInfo storage(it.key());
+        if (it.value() > storage.bytesAvailable()) {
+            qCWarning(mvlStereoProcessor) << "WARNING: estimated output size" << qPrintable(formatSize(it.value())) << "exceeds available space" << qPrintable(formatSize(storage.bytesAvailable())) << "on" << it.key();
         } else {
-            continue; // No further steps possible if stereo method is not active
-        }
-
-        // *** Reproject point cloud ***
-        if (stereoReprojection) {
-            stereoReprojection->reprojectDisparity(disparity, points);
-
-            // Export point cloud
-            for (const QString &format : outputPoints) {
-                QString filename = Utils::formatString(format, variableMap);
-                QString ext = QFileInfo(filename).completeSuffix();
-
-                Utils::ensureParentDirectoryExists(filename);
-
-                if (ext == "xml" || ext == "yml" || ext == "yaml") {
-                    // Save raw matrix in OpenCV storage format
-                    try {
-                        cv::FileStorage fs(filename.toStdString(), cv::FileStorage::WRITE);
-                        fs << "points" << points;
-                    } catch (const cv::Exception &error) {
-                        throw QString("Failed to save matrix to file %1: %2").arg(filename).arg(QString::fromStdString(error.what()));
-                    }
-                } else if (ext == "bin") {
-                    // Save raw matrix in custom binary matrix format
-                    try {
-                        MVL::StereoToolbox::Pipeline::Utils::writeMatrixToBinaryFile(points, filename);
-                    } catch (const QString &error) {
-                        throw QString("Failed to save binary file %1: %2").arg(filename).arg(error);
-                    }
-                } else if (ext == "pcd") {
-                    try {
-                        MVL::StereoToolbox::Pipeline::Utils::writePointCloudToPcdFile(rectifiedLeft, points, filename, true);
-                    } catch (const QString &error) {
-                        throw QString("Failed to save PCD file %1: %2").arg(filename).arg(error);
-                    }
-                } else {
-                    throw QString("Invalid output format for reprojection: %1").arg(ext);
-                }
-            }
+            qCInfo(mvlStereoProcessor) << "Output on" << it.key() << ":" << qPrintable(formatSize(it.value())) << "of" << qPrintable(formatSize(storage.bytesAvailable())) << "available";
         }
     }
 }
@@ -287,72 +1296,187 @@ void Processor::setupPipeline ()
 
     // Create input source
     if (inputFileType == "image") {
-        inputSource = new SourceImage(inputFile);
+        inputSource = new SourceImage(inputFile, watchInput, watchTimeout);
     } else if (inputFileType == "vrms") {
-        inputSource = new SourceVrms(inputFile);
+        inputSource = new SourceVrms(inputFile, numVrmsReaders);
     } else if (inputFileType == "video") {
         inputSource = new SourceVideo(inputFile);
+    } else if (inputFileType == "video-pair") {
+        inputSource = new SourceVideoPair(inputFile, videoSyncTimestamp);
+    } else if (inputFileType == "live") {
+        inputSource = new SourceLive(inputFile, liveFormat, liveDropFrames);
     } else {
         throw QString("Unhandled input source type: %1").arg(inputFileType);
     }
 
-    // Create rectitifaction and load stereo calibration
-    if (!stereoCalibrationFile.isEmpty()) {
-        qCDebug(mvlStereoProcessor) << "Setting up rectification:" << qPrintable(stereoCalibrationFile);
+    inputSource->setGrayscale(grayscale);
 
-        stereoRectification = new MVL::StereoToolbox::Pipeline::Rectification();
-        try {
-            stereoRectification->loadStereoCalibration(stereoCalibrationFile);
-        } catch (const QString &error) {
-            throw QString("Failed to load stereo calibration: %1").arg(error);
-        } catch (const std::exception &error) {
-            throw QString("Failed to load stereo calibration: %1").arg(error.what());
+    // Frame cache (not applicable to live streams)
+    if (!frameCacheDirectory.isEmpty() && !inputSource->isLive()) {
+        setupFrameCache();
+    }
+
+    // Create rectification and stereo method(s); if pipeline cache is
+    // available, reuse a warm pipeline with same configuration. With
+    // several method variants, only rectification is taken from the
+    // cache, as methods are reconfigured by parameter sweep
+    bool singleMethod = methodVariants.size() == 1 && methodVariants[0].parameters.isEmpty();
+
+    if (pipelineCache) {
+        cachedPipeline = pipelineCache->acquire(stereoCalibrationFile, singleMethod ? methodVariants[0].file : QString());
+        stereoRectification = cachedPipeline->rectification;
+        if (singleMethod) {
+            stereoMethods.append(cachedPipeline->stereoMethod);
         }
+    } else if (!stereoCalibrationFile.isEmpty()) {
+        stereoRectification = PipelineCache::createRectification(stereoCalibrationFile);
     }
 
-    // Create stereo method
-    if (!stereoMethodFile.isEmpty()) {
-        qCDebug(mvlStereoProcessor) << "Setting up stereo method:" << qPrintable(stereoMethodFile);
+    if (stereoMethods.isEmpty()) {
+        for (const MethodVariant &variant : methodVariants) {
+            QObject *method = PipelineCache::createStereoMethod(variant.file);
+            stereoMethods.append(method);
 
-        // Open config file
-        cv::FileStorage storage(stereoMethodFile.toStdString(), cv::FileStorage::READ);
-        if (!storage.isOpened()) {
-            throw QString("Failed to open OpenCV file storage on '%1'").arg(stereoMethodFile);
+            applyMethodParameters(method, variant.parameters);
         }
+    }
 
-        std::string methodName;
-        storage["MethodName"] >> methodName;
+    for (const MethodVariant &variant : methodVariants) {
+        stereoMethodLabels.append(variant.label);
+    }
 
-        // Traverse list of plugins and try to find stereo method based
-        // on its name
-        MVL::StereoToolbox::Pipeline::PluginManager pluginManager;
-        for (QObject *pluginFactoryObject : pluginManager.getAvailablePlugins()) {
-            MVL::StereoToolbox::Pipeline::PluginFactory *pluginFactory = qobject_cast<MVL::StereoToolbox::Pipeline::PluginFactory *>(pluginFactoryObject);
-            if (pluginFactory->getPluginType() == MVL::StereoToolbox::Pipeline::PluginFactory::PluginStereoMethod) {
-                if (pluginFactory->getShortName().toStdString() == methodName) {
-                    stereoMethod = pluginFactory->createObject();
-                    break;
-                }
+    // Tiled disparity with default overlap needs the method's window size
+    if (disparityBandHeight > 0 && disparityBandOverlap < 0) {
+        for (int m = 0; m < stereoMethods.size(); m++) {
+            if (getMethodWindowSize(stereoMethods[m]) <= 0) {
+                qCWarning(mvlStereoProcessor) << "Stereo method" << stereoMethodLabels[m] << "does not expose its window size; using default disparity band overlap of" << getDisparityBandOverlap(stereoMethods[m]) << "rows, which may be too small! Use --disparity-band-overlap to set it explicitly.";
             }
         }
+    }
 
-        if (!stereoMethod) {
-            throw QString("Plugin for stereo method '%1' not found!").arg(QString::fromStdString(methodName));
-        }
-
-        // Load config
-        try {
-            qobject_cast<MVL::StereoToolbox::Pipeline::StereoMethod *>(stereoMethod)->loadParameters(stereoMethodFile);
-        } catch (const QString &error) {
-            throw QString("Failed to load method parameters: %1").arg(error);
-        }
+    // Parallel rectification
+    if (stereoRectification && !serialRectification) {
+        parallelRectification = new ParallelRectification(stereoRectification, 0);
     }
 
     // Create reprojection (only if we have rectification available!)
     if (stereoRectification) {
         qCDebug(mvlStereoProcessor) << "Setting up reprojection object...";
         stereoReprojection = new MVL::StereoToolbox::Pipeline::Reprojection();
-        stereoReprojection->setReprojectionMatrix(stereoRectification->getReprojectionMatrix());
+        stereoRectification->getReprojectionMatrix().convertTo(reprojectionMatrix, CV_64F);
+        stereoReprojection->setReprojectionMatrix(reprojectionMatrix);
+    }
+}
+
+
+void Processor::setupFrameCache ()
+{
+    frameCache = new FrameCache(frameCacheDirectory, frameCacheSize);
+
+    // Identity of input; path, size and modification time of the input
+    // file. Inputs that consist of several files (image sequences, pairs
+    // of videos) are identified by their path pattern, and each frame
+    // additionally by the files it is read from (see Source::getFrameIdentity())
+    QFileInfo inputInfo(inputFile);
+    QStringList inputIdentity;
+    if (inputInfo.exists()) {
+        inputIdentity << QString::number(inputInfo.size()) << QString::number(inputInfo.lastModified().toMSecsSinceEpoch());
+    }
+
+    decodedCacheKeyBase = FrameCache::makeKey(QStringList()
+        << "decoded"
+        << inputFileType
+        << inputInfo.absoluteFilePath()
+        << inputIdentity
+        << QString::number(videoSyncTimestamp)
+        << QString::number(grayscale));
+
+    // Rectified frames additionally depend on calibration, ROI, and the
+    // rectification implementation (parallel rectification uses fixed-
+    // point maps, whose results differ slightly from serial remapping)
+    rectifiedCacheKeyBase = FrameCache::makeKey(QStringList()
+        << "rectified"
+        << decodedCacheKeyBase
+        << (stereoCalibrationFile.isEmpty() ? QString() : FrameCache::hashFileContents(stereoCalibrationFile))
+        << rectifiedRoiString
+        << QString::number(serialRectification));
+}
+
+
+void Processor::applyMethodParameters (QObject *method, const QList<QPair<QString, QString>> &parameters)
+{
+    // Parameters are set via stereo method's Qt properties; the string
+    // value is converted to the property's type
+    for (const QPair<QString, QString> &parameter : parameters) {
+        QByteArray name = parameter.first.toLatin1();
+
+        int index = method->metaObject()->indexOfProperty(name.constData());
+        if (index < 0) {
+            throw QString("Stereo method '%1' has no parameter '%2'!").arg(method->metaObject()->className()).arg(parameter.first);
+        }
+
+        if (!method->metaObject()->property(index).write(method, parameter.second)) {
+            throw QString("Failed to set stereo method parameter '%1' to '%2'!").arg(parameter.first).arg(parameter.second);
+        }
+    }
+}
+
+
+void Processor::setupRectifiedRoi (const cv::Size &imageSize)
+{
+    if (cropRectifiedToValidRoi) {
+        // Rectify a pair of all-valid masks, and find the region that
+        // is valid in both rectified images
+        cv::Mat mask(imageSize, CV_8UC1, cv::Scalar(255));
+        cv::Mat maskLeft, maskRight;
+
+        stereoRectification->rectifyImagePair(mask, mask, maskLeft, maskRight);
+        rectifiedRoi = Utils::findValidRegion(maskLeft & maskRight);
+
+        if (rectifiedRoi.area() == 0) {
+            throw QString("Valid ROI of rectified images is empty!");
+        }
+    } else {
+        // Validate user-specified ROI
+        if ((rectifiedRoi & cv::Rect(0, 0, imageSize.width, imageSize.height)) != rectifiedRoi) {
+            throw QString("Rectified image ROI (%1, %2, %3, %4) exceeds image dimensions (%5x%6)!").arg(rectifiedRoi.x).arg(rectifiedRoi.y).arg(rectifiedRoi.width).arg(rectifiedRoi.height).arg(imageSize.width).arg(imageSize.height);
+        }
+    }
+
+    qCInfo(mvlStereoProcessor) << "Cropping rectified images to ROI:" << rectifiedRoi.x << rectifiedRoi.y << rectifiedRoi.width << rectifiedRoi.height;
+
+    // Shift principal point in reprojection matrix, so that the points
+    // reprojected from cropped disparity remain in the original camera
+    // coordinate system
+    if (stereoReprojection) {
+        stereoRectification->getReprojectionMatrix().convertTo(reprojectionMatrix, CV_64F);
+
+        reprojectionMatrix.at<double>(0, 3) += rectifiedRoi.x;
+        reprojectionMatrix.at<double>(1, 3) += rectifiedRoi.y;
+
+        stereoReprojection->setReprojectionMatrix(reprojectionMatrix);
+    }
+
+    rectifiedRoiInitialized = true;
+}
+
+void Processor::rectifyImagePair (const cv::Mat &imageLeft, const cv::Mat &imageRight, cv::Mat &rectifiedLeft, cv::Mat &rectifiedRight)
+{
+    if (parallelRectification) {
+        parallelRectification->rectifyImagePair(imageLeft, imageRight, rectifiedLeft, rectifiedRight);
+    } else {
+        stereoRectification->rectifyImagePair(imageLeft, imageRight, rectifiedLeft, rectifiedRight);
+    }
+}
+
+void Processor::rectifyLeftImage (const cv::Mat &imageLeft, cv::Mat &rectifiedLeft)
+{
+    if (parallelRectification) {
+        parallelRectification->rectifyImage(0, imageLeft, rectifiedLeft);
+    } else {
+        // Pipeline's rectification works on pairs only
+        cv::Mat rectifiedRight;
+        stereoRectification->rectifyImagePair(imageLeft, imageLeft, rectifiedLeft, rectifiedRight);
     }
 }
 
@@ -412,6 +1536,46 @@ Processor::FrameRange Processor::parseFrameRange (const QString &range) const
     return FrameRange({ start, step, end });
 }
 
+QList<Processor::OutputFormat> Processor::parseOutputFormats (const QStringList &formats) const
+{
+    // Optional stride is given as @N suffix
+    static const QRegularExpression strideRegExp("^(.+)@(\\d+)$");
+
+    QList<OutputFormat> outputs;
+
+    for (const QString &format : formats) {
+        OutputFormat output = { format, 1 };
+
+        QRegularExpressionMatch match = strideRegExp.match(format);
+        if (match.hasMatch()) {
+            output.format = match.captured(1);
+            output.stride = match.captured(2).toInt();
+            if (output.stride < 1) {
+                throw QString("Invalid output stride in '%1'").arg(format);
+            }
+        }
+
+        outputs.append(output);
+    }
+
+    return outputs;
+}
+
+bool Processor::isAnyOutputActive (const QList<OutputFormat> &outputs, int rangeIndex)
+{
+    for (const OutputFormat &output : outputs) {
+        if (output.isActive(rangeIndex)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int Processor::getRangeIndex (const FrameRange &range, int frame)
+{
+    return (frame - range.start) / range.step;
+}
+
 
 void Processor::parseCommandLine ()
 {
@@ -421,74 +1585,315 @@ void Processor::parseCommandLine ()
     parser.addHelpOption();
     parser.addVersionOption();
 
+    QList<QCommandLineOption> commandLineOptions;
+
     // Input file
     parser.addPositionalArgument("input-file", QCoreApplication::translate("main", "Input file."));
 
     // Input type
     QCommandLineOption optionInputType("input-type",
-        QCoreApplication::translate("main", "Input file type (image, video, vrms)."),
+        QCoreApplication::translate("main", "Input file type (image, video, video-pair, vrms, live)."),
         QCoreApplication::translate("main", "type"));
-    parser.addOption(optionInputType);
+    commandLineOptions.append(optionInputType);
+
+    // Video pair synchronization
+    QCommandLineOption optionVideoSync("video-sync",
+        QCoreApplication::translate("main", "Synchronization of separate left and right video files (frame, timestamp)."),
+        QCoreApplication::translate("main", "mode"));
+    commandLineOptions.append(optionVideoSync);
+
+    // VRMS readers
+    QCommandLineOption optionVrmsReaders("vrms-readers",
+        QCoreApplication::translate("main", "Number of concurrent VRMS readers (default: 1)."),
+        QCoreApplication::translate("main", "count"));
+    commandLineOptions.append(optionVrmsReaders);
+
+    // Live stream
+    QCommandLineOption optionLiveFormat("live-format",
+        QCoreApplication::translate("main", "Format of live stream read from standard input or FIFO (mjpeg, or raw:WIDTHxHEIGHT[:gray8|bgr24])."),
+        QCoreApplication::translate("main", "format"));
+    commandLineOptions.append(optionLiveFormat);
+
+    QCommandLineOption optionDropFrames("drop-frames",
+        QCoreApplication::translate("main", "Latency-bounded processing of live stream; if processing falls behind, stale frames are dropped in favor of the newest one."));
+    commandLineOptions.append(optionDropFrames);
+
+    // Watched image sequence input
+    QCommandLineOption optionWatch("watch",
+        QCoreApplication::translate("main", "Watch the directory of image sequence input, and process image pairs as soon as they are completely written."));
+    commandLineOptions.append(optionWatch);
+
+    QCommandLineOption optionWatchTimeout("watch-timeout",
+        QCoreApplication::translate("main", "Stop watching once no new image pair arrives within given number of seconds; 0 to watch indefinitely (default: 60)."),
+        QCoreApplication::translate("main", "seconds"));
+    commandLineOptions.append(optionWatchTimeout);
 
     // Stereo calibration
     QCommandLineOption optionStereoCalibration("stereo-calibration",
         QCoreApplication::translate("main", "Stereo calibration file."),
         QCoreApplication::translate("main", "file"));
-    parser.addOption(optionStereoCalibration);
+    commandLineOptions.append(optionStereoCalibration);
 
     // Stereo method
     QCommandLineOption optionStereoMethod("stereo-method",
-        QCoreApplication::translate("main", "Stereo method configuration file."),
+        QCoreApplication::translate("main", "Stereo method configuration file; may be given multiple times, in which case all methods are run on the same rectified frames."),
         QCoreApplication::translate("main", "file"));
-    parser.addOption(optionStereoMethod);
+    commandLineOptions.append(optionStereoMethod);
+
+    QCommandLineOption optionStereoMethodSweep("stereo-method-sweep",
+        QCoreApplication::translate("main", "Sweep over values of stereo method parameter, given as name=value1,value2,...; may be given multiple times to sweep over a parameter grid."),
+        QCoreApplication::translate("main", "sweep"));
+    commandLineOptions.append(optionStereoMethodSweep);
+
+    // Rectified image ROI
+    QCommandLineOption optionRectifiedRoi("rectified-roi",
+        QCoreApplication::translate("main", "Crop rectified images to region of interest before computing disparity; either 'valid' for valid ROI from calibration, or x,y,width,height."),
+        QCoreApplication::translate("main", "roi"));
+    commandLineOptions.append(optionRectifiedRoi);
+
+    // Tiled disparity
+    QCommandLineOption optionDisparityBandHeight("disparity-band-height",
+        QCoreApplication::translate("main", "Compute disparity in horizontal bands of given height (in rows), to bound the working memory of the stereo method on very large frames (full-size images are still kept in memory, and the result is approximate near band boundaries); 0 to disable (default)."),
+        QCoreApplication::translate("main", "rows"));
+    commandLineOptions.append(optionDisparityBandHeight);
+
+    QCommandLineOption optionDisparityBandOverlap("disparity-band-overlap",
+        QCoreApplication::translate("main", "Number of rows by which disparity bands are extended on each side; by default, derived from the stereo method's window size."),
+        QCoreApplication::translate("main", "rows"));
+    commandLineOptions.append(optionDisparityBandOverlap);
+
+    QCommandLineOption optionSerialRectification("serial-rectification",
+        QCoreApplication::translate("main", "Rectify using stereo pipeline's own implementation, instead of parallel stripe-split remapping."));
+    commandLineOptions.append(optionSerialRectification);
+
+    // Grayscale processing
+    QCommandLineOption optionGrayscale("grayscale",
+        QCoreApplication::translate("main", "Decode, rectify and process single-channel images; colour images are retrieved only for colour-dependent outputs (frames, PCD point clouds)."));
+    commandLineOptions.append(optionGrayscale);
+
+    // Change detection
+    QCommandLineOption optionChangeThreshold("change-threshold",
+        QCoreApplication::translate("main", "Enable incremental mode; reuse disparity and points of the last processed frame if mean absolute intensity difference of downsampled frames is below threshold."),
+        QCoreApplication::translate("main", "threshold"));
+    commandLineOptions.append(optionChangeThreshold);
+
+    QCommandLineOption optionChangeDownsample("change-downsample",
+        QCoreApplication::translate("main", "Downsampling factor for change detection (default: 8)."),
+        QCoreApplication::translate("main", "factor"));
+    commandLineOptions.append(optionChangeDownsample);
+
+    // Frame cache
+    QCommandLineOption optionFrameCache("frame-cache",
+        QCoreApplication::translate("main", "Directory of on-disk cache of decoded and rectified frames, shared between runs."),
+        QCoreApplication::translate("main", "directory"));
+    commandLineOptions.append(optionFrameCache);
+
+    QCommandLineOption optionFrameCacheSize("frame-cache-size",
+        QCoreApplication::translate("main", "Size limit of frame cache, in megabytes (default: 10240)."),
+        QCoreApplication::translate("main", "size"));
+    commandLineOptions.append(optionFrameCacheSize);
+
+    QCommandLineOption optionFrameCacheMode("frame-cache-mode",
+        QCoreApplication::translate("main", "Comma-separated list of frame types to cache (decoded, rectified; default: both)."),
+        QCoreApplication::translate("main", "mode"));
+    commandLineOptions.append(optionFrameCacheMode);
+
+    // Threading
+    QCommandLineOption optionThreads("threads",
+        QCoreApplication::translate("main", "Total number of threads to use (default: number of cores)."),
+        QCoreApplication::translate("main", "count"));
+    commandLineOptions.append(optionThreads);
+
+    QCommandLineOption optionThreadStages("thread-stages",
+        QCoreApplication::translate("main", "Per-stage thread assignment, as comma-separated list of stage=count[@cpus] (stages: decode, rectify, method, write; cpus: CPU list such as 0-3,8, or NUMA node such as node1)."),
+        QCoreApplication::translate("main", "assignment"));
+    commandLineOptions.append(optionThreadStages);
+
+    QCommandLineOption optionPinThreads("pin-threads",
+        QCoreApplication::translate("main", "Pin threads of each stage to their own block of CPU cores."));
+    commandLineOptions.append(optionPinThreads);
+
+    // Dry-run estimation
+    QCommandLineOption optionEstimate("estimate",
+        QCoreApplication::translate("main", "Dry run; process a few sample frames without writing outputs, and estimate total processing time and disk usage."));
+    commandLineOptions.append(optionEstimate);
+
+    QCommandLineOption optionEstimateSamples("estimate-samples",
+        QCoreApplication::translate("main", "Number of frames sampled in dry run (default: 5)."),
+        QCoreApplication::translate("main", "count"));
+    commandLineOptions.append(optionEstimateSamples);
+
+    QCommandLineOption optionEstimateJobs("estimate-jobs",
+        QCoreApplication::translate("main", "Number of jobs (shards) the run is split into, for per-job estimates in dry run."),
+        QCoreApplication::translate("main", "count"));
+    commandLineOptions.append(optionEstimateJobs);
 
     // Frame range
     QCommandLineOption optionFrameRange(QStringList() << "f" << "frame-range",
         QCoreApplication::translate("main", "Frame range to process."),
         QCoreApplication::translate("main", "start:step:end"));
     optionFrameRange.setDefaultValue("0:1:-1");
-    parser.addOption(optionFrameRange);
+    commandLineOptions.append(optionFrameRange);
 
     // Output: frames
     QCommandLineOption optionOutputFrames("output-frames",
-        QCoreApplication::translate("main", "Output format for extracted frames."),
+        QCoreApplication::translate("main", "Output format for extracted frames; optional ?key=value&... suffix gives encoder options, and optional @N suffix limits output to every N-th frame of each frame range."),
         QCoreApplication::translate("main", "format"));
-    parser.addOption(optionOutputFrames);
+    commandLineOptions.append(optionOutputFrames);
 
     // Output: rectified
     QCommandLineOption optionOutputRectified("output-rectified",
-        QCoreApplication::translate("main", "Output format for rectified frames."),
+        QCoreApplication::translate("main", "Output format for rectified frames; optional ?key=value&... suffix gives encoder options, and optional @N suffix limits output to every N-th frame of each frame range."),
         QCoreApplication::translate("main", "format"));
-    parser.addOption(optionOutputRectified);
+    commandLineOptions.append(optionOutputRectified);
+
+    QCommandLineOption optionFastIntermediate("fast-intermediate",
+        QCoreApplication::translate("main", "Use cheapest lossless encoding (uncompressed PNG or TIFF) for frames and rectified images that have no explicit encoder options."));
+    commandLineOptions.append(optionFastIntermediate);
 
     // Output: disparity
     QCommandLineOption optionOutputDisparity("output-disparity",
-        QCoreApplication::translate("main", "Output format for disparity."),
+        QCoreApplication::translate("main", "Output format for disparity; optional ?key=value&... suffix gives encoder options (image formats), and optional @N suffix limits output to every N-th frame of each frame range."),
         QCoreApplication::translate("main", "format"));
-    parser.addOption(optionOutputDisparity);
+    commandLineOptions.append(optionOutputDisparity);
 
     // Output: points
     QCommandLineOption optionOutputPoints("output-points",
-        QCoreApplication::translate("main", "Output format for point cloud."),
+        QCoreApplication::translate("main", "Output format for point cloud; optional @N suffix limits output to every N-th frame of each frame range."),
         QCoreApplication::translate("main", "format"));
-    parser.addOption(optionOutputPoints);
+    commandLineOptions.append(optionOutputPoints);
+
+    // Point cloud decimation
+    QCommandLineOption optionPointsDecimation("points-decimation",
+        QCoreApplication::translate("main", "Decimation of output point clouds; stride:N for subsampling every N-th row and column, or voxel:SIZE for voxel grid with given voxel size."),
+        QCoreApplication::translate("main", "decimation"));
+    commandLineOptions.append(optionPointsDecimation);
+
+    QCommandLineOption optionPointsRange("points-range",
+        QCoreApplication::translate("main", "Clip output point clouds to given range of depth (either bound may be omitted)."),
+        QCoreApplication::translate("main", "min:max"));
+    commandLineOptions.append(optionPointsRange);
+
+    // Output: depth
+    QCommandLineOption optionOutputDepth("output-depth",
+        QCoreApplication::translate("main", "Output format for depth map; optional ?key=value&... suffix gives encoder options (image formats), and optional @N suffix limits output to every N-th frame of each frame range."),
+        QCoreApplication::translate("main", "format"));
+    commandLineOptions.append(optionOutputDepth);
+
+    QCommandLineOption optionDepthScale("depth-scale",
+        QCoreApplication::translate("main", "Scale factor applied to depth (in units of stereo calibration) when stored as 16-bit image (default: 1)."),
+        QCoreApplication::translate("main", "scale"));
+    commandLineOptions.append(optionDepthScale);
+
+    // Output: summary statistics
+    QCommandLineOption optionOutputStats("output-stats",
+        QCoreApplication::translate("main", "Output file for per-frame disparity statistics of the whole run (csv or jsonl); optional @N suffix limits output to every N-th frame of each frame range."),
+        QCoreApplication::translate("main", "file"));
+    commandLineOptions.append(optionOutputStats);
+
+    QCommandLineOption optionStatsBins("stats-bins",
+        QCoreApplication::translate("main", "Number of bins of disparity histogram in statistics output (default: 16)."),
+        QCoreApplication::translate("main", "count"));
+    commandLineOptions.append(optionStatsBins);
+
+    QCommandLineOption optionStatsNearDistance("stats-near-distance",
+        QCoreApplication::translate("main", "Distance (in units of stereo calibration) below which pixels are counted as near obstacles in statistics output (default: disabled)."),
+        QCoreApplication::translate("main", "distance"));
+    commandLineOptions.append(optionStatsNearDistance);
+
+    // Output: archives
+    QCommandLineOption optionArchiveShardSize("archive-shard-size",
+        QCoreApplication::translate("main", "Size of shards of tar archive outputs (archive.tar#member formats), in megabytes (default: 0, single archive)."),
+        QCoreApplication::translate("main", "size"));
+    commandLineOptions.append(optionArchiveShardSize);
+
+    // Memory budget
+    QCommandLineOption optionMaxMemory("max-memory",
+        QCoreApplication::translate("main", "Memory budget for frames in flight (decoded, processed, and waiting to be written), in megabytes; the number of concurrently processed frames adapts to it (default: 0, unlimited)."),
+        QCoreApplication::translate("main", "size"));
+    commandLineOptions.append(optionMaxMemory);
+
+    // Progress reporting
+    QCommandLineOption optionProgressInterval("progress-interval",
+        QCoreApplication::translate("main", "Interval of progress reports, in seconds; 0 to disable (default, unless progress metrics outputs are requested, in which case it is 10)."),
+        QCoreApplication::translate("main", "seconds"));
+    commandLineOptions.append(optionProgressInterval);
+
+    QCommandLineOption optionProgressPrometheus("progress-prometheus",
+        QCoreApplication::translate("main", "Write progress metrics to given file in Prometheus text format (for node exporter's textfile collector) at each report."),
+        QCoreApplication::translate("main", "file"));
+    commandLineOptions.append(optionProgressPrometheus);
+
+    QCommandLineOption optionProgressJsonFd("progress-json-fd",
+        QCoreApplication::translate("main", "Write progress reports as JSON lines to given (already open) file descriptor."),
+        QCoreApplication::translate("main", "fd"));
+    commandLineOptions.append(optionProgressJsonFd);
+
+    // Server mode
+    QCommandLineOption optionServe("serve",
+        QCoreApplication::translate("main", "Run as server, accepting JSON processing requests on given local socket."),
+        QCoreApplication::translate("main", "socket"));
+    commandLineOptions.append(optionServe);
+
+    QCommandLineOption optionServeWorkers("serve-workers",
+        QCoreApplication::translate("main", "Number of concurrently processed requests in server mode (default: number of cores)."),
+        QCoreApplication::translate("main", "count"));
+    commandLineOptions.append(optionServeWorkers);
+
+    QCommandLineOption optionServeCacheSize("serve-cache-size",
+        QCoreApplication::translate("main", "Maximum number of idle pipelines kept in the pipeline cache in server mode; least recently used ones are evicted (default: 8)."),
+        QCoreApplication::translate("main", "count"));
+    commandLineOptions.append(optionServeCacheSize);
+
+    parser.addOptions(commandLineOptions);
 
     // *** Process ***
     parser.process(*qApp);
 
-    // *** Gather options ***
-    inputFileType = parser.value(optionInputType);
-    stereoCalibrationFile = parser.value(optionStereoCalibration);
-    stereoMethodFile = parser.value(optionStereoMethod);
+    // *** Server mode ***
+    // Processing options are provided by individual requests
+    if (parser.isSet(optionServe)) {
+        serverSocket = parser.value(optionServe);
+        numServerWorkers = QThread::idealThreadCount();
+
+        if (parser.isSet(optionServeWorkers)) {
+            bool ok;
+            numServerWorkers = parser.value(optionServeWorkers).toInt(&ok);
+            if (!ok || numServerWorkers < 1) {
+                throw QString("Invalid number of server workers: '%1'").arg(parser.value(optionServeWorkers));
+            }
+        }
 
-    outputFrames = parser.values(optionOutputFrames);
-    outputRectified = parser.values(optionOutputRectified);
-    outputDisparity = parser.values(optionOutputDisparity);
-    outputPoints = parser.values(optionOutputPoints);
+        if (parser.isSet(optionServeCacheSize)) {
+            bool ok;
+            serverCacheSize = parser.value(optionServeCacheSize).toInt(&ok);
+            if (!ok || serverCacheSize < 0) {
+                throw QString("Invalid pipeline cache size: '%1'").arg(parser.value(optionServeCacheSize));
+            }
+        }
 
-    // Parse frame range(s)
-    for (const QString &range : parser.values(optionFrameRange)) {
-        frameRanges.append(parseFrameRange(range));
+        // Thread budget is process-wide, and shared by all requests
+        if (parser.isSet(optionThreads)) {
+            bool ok;
+            numThreads = parser.value(optionThreads).toInt(&ok);
+            if (!ok || numThreads < 1) {
+                throw QString("Invalid number of threads: '%1'").arg(parser.value(optionThreads));
+            }
+        }
+        threadStages = parser.value(optionThreadStages);
+        pinThreads = parser.isSet(optionPinThreads);
+
+        return;
+    }
+
+    // *** Gather options ***
+    // Options are collected in a map, keyed by their long name, so that
+    // the same code path is used for requests received in server mode
+    QHash<QString, QStringList> options;
+    for (const QCommandLineOption &option : commandLineOptions) {
+        if (parser.isSet(option)) {
+            options[option.names().last()] = parser.values(option);
+        }
     }
 
     // We require exactly one positional argument
@@ -497,7 +1902,225 @@ void Processor::parseCommandLine ()
         throw QString("Exactly one positional argument (input-file) is required; %1 were provided!").arg(positionalArguments.size());
     }
 
-    inputFile = positionalArguments[0];
+    options["input-file"] = positionalArguments;
+
+    loadOptions(options);
+}
+
+
+static QString optionValue (const QHash<QString, QStringList> &options, const QString &name)
+{
+    QStringList values = options.value(name);
+    return values.isEmpty() ? QString() : values.last();
+}
+
+void Processor::loadOptions (const QHash<QString, QStringList> &options)
+{
+    inputFile = optionValue(options, "input-file");
+    if (inputFile.isEmpty()) {
+        throw QString("Input file is required!");
+    }
+
+    inputFileType = optionValue(options, "input-type");
+
+    QString videoSync = optionValue(options, "video-sync");
+    if (videoSync.isEmpty() || videoSync == "frame") {
+        videoSyncTimestamp = false;
+    } else if (videoSync == "timestamp") {
+        videoSyncTimestamp = true;
+    } else {
+        throw QString("Invalid video synchronization mode: '%1'").arg(videoSync);
+    }
+
+    if (options.contains("vrms-readers")) {
+        bool ok;
+        numVrmsReaders = optionValue(options, "vrms-readers").toInt(&ok);
+        if (!ok || numVrmsReaders < 1) {
+            throw QString("Invalid number of VRMS readers: '%1'").arg(optionValue(options, "vrms-readers"));
+        }
+    }
+
+    liveFormat = optionValue(options, "live-format");
+    liveDropFrames = options.contains("drop-frames");
+
+    watchInput = options.contains("watch");
+    if (options.contains("watch-timeout")) {
+        bool ok;
+        watchTimeout = optionValue(options, "watch-timeout").toInt(&ok);
+        if (!ok || watchTimeout < 0) {
+            throw QString("Invalid watch timeout: '%1'").arg(optionValue(options, "watch-timeout"));
+        }
+    }
+
+    stereoCalibrationFile = optionValue(options, "stereo-calibration");
+    stereoMethodFiles = options.value("stereo-method");
+    stereoMethodSweeps = options.value("stereo-method-sweep");
+    rectifiedRoiString = optionValue(options, "rectified-roi");
+    serialRectification = options.contains("serial-rectification");
+
+    if (options.contains("disparity-band-height")) {
+        bool ok;
+        disparityBandHeight = optionValue(options, "disparity-band-height").toInt(&ok);
+        if (!ok || disparityBandHeight < 0) {
+            throw QString("Invalid disparity band height: '%1'").arg(optionValue(options, "disparity-band-height"));
+        }
+    }
+    if (options.contains("disparity-band-overlap")) {
+        bool ok;
+        disparityBandOverlap = optionValue(options, "disparity-band-overlap").toInt(&ok);
+        if (!ok || disparityBandOverlap < 0) {
+            throw QString("Invalid disparity band overlap: '%1'").arg(optionValue(options, "disparity-band-overlap"));
+        }
+    }
+    grayscale = options.contains("grayscale");
+
+    if (options.contains("change-threshold")) {
+        bool ok;
+        changeThreshold = optionValue(options, "change-threshold").toDouble(&ok);
+        if (!ok || changeThreshold < 0) {
+            throw QString("Invalid change detection threshold: '%1'").arg(optionValue(options, "change-threshold"));
+        }
+    }
+    if (options.contains("change-downsample")) {
+        bool ok;
+        changeDownsampleFactor = optionValue(options, "change-downsample").toInt(&ok);
+        if (!ok || changeDownsampleFactor < 1) {
+            throw QString("Invalid change detection downsampling factor: '%1'").arg(optionValue(options, "change-downsample"));
+        }
+    }
+
+    frameCacheDirectory = optionValue(options, "frame-cache");
+    if (options.contains("frame-cache-size")) {
+        bool ok;
+        frameCacheSize = optionValue(options, "frame-cache-size").toLongLong(&ok) * 1024 * 1024;
+        if (!ok || frameCacheSize <= 0) {
+            throw QString("Invalid frame cache size: '%1'").arg(optionValue(options, "frame-cache-size"));
+        }
+    }
+    if (options.contains("frame-cache-mode")) {
+        QStringList modes = optionValue(options, "frame-cache-mode").split(",", QString::SkipEmptyParts);
+        for (const QString &mode : modes) {
+            if (mode != "decoded" && mode != "rectified") {
+                throw QString("Invalid frame cache mode: '%1'").arg(mode);
+            }
+        }
+        frameCacheDecoded = modes.contains("decoded");
+        frameCacheRectified = modes.contains("rectified");
+    }
+
+    if (options.contains("threads")) {
+        bool ok;
+        numThreads = optionValue(options, "threads").toInt(&ok);
+        if (!ok || numThreads < 1) {
+            throw QString("Invalid number of threads: '%1'").arg(optionValue(options, "threads"));
+        }
+    }
+    threadStages = optionValue(options, "thread-stages");
+    pinThreads = options.contains("pin-threads");
+
+    estimateOnly = options.contains("estimate");
+    if (options.contains("estimate-samples")) {
+        bool ok;
+        estimateSamples = optionValue(options, "estimate-samples").toInt(&ok);
+        if (!ok || estimateSamples < 1) {
+            throw QString("Invalid number of estimation samples: '%1'").arg(optionValue(options, "estimate-samples"));
+        }
+    }
+    if (options.contains("estimate-jobs")) {
+        bool ok;
+        estimateJobs = optionValue(options, "estimate-jobs").toInt(&ok);
+        if (!ok || estimateJobs < 1) {
+            throw QString("Invalid number of estimation jobs: '%1'").arg(optionValue(options, "estimate-jobs"));
+        }
+    }
+
+    outputFrames = parseOutputFormats(options.value("output-frames"));
+    outputRectified = parseOutputFormats(options.value("output-rectified"));
+    outputDisparity = parseOutputFormats(options.value("output-disparity"));
+    outputPoints = parseOutputFormats(options.value("output-points"));
+    outputDepth = parseOutputFormats(options.value("output-depth"));
+    outputStats = parseOutputFormats(options.value("output-stats"));
+
+    pointCloudFilter.configure(optionValue(options, "points-decimation"), optionValue(options, "points-range"));
+
+    fastIntermediate = options.contains("fast-intermediate");
+
+    if (options.contains("depth-scale")) {
+        bool ok;
+        depthScale = optionValue(options, "depth-scale").toDouble(&ok);
+        if (!ok || depthScale <= 0) {
+            throw QString("Invalid depth scale: '%1'").arg(optionValue(options, "depth-scale"));
+        }
+    }
+
+    if (options.contains("stats-bins")) {
+        bool ok;
+        statsBins = optionValue(options, "stats-bins").toInt(&ok);
+        if (!ok || statsBins < 1) {
+            throw QString("Invalid number of statistics histogram bins: '%1'").arg(optionValue(options, "stats-bins"));
+        }
+    }
+    if (options.contains("stats-near-distance")) {
+        bool ok;
+        statsNearDistance = optionValue(options, "stats-near-distance").toDouble(&ok);
+        if (!ok || statsNearDistance < 0) {
+            throw QString("Invalid statistics near distance: '%1'").arg(optionValue(options, "stats-near-distance"));
+        }
+    }
+
+    if (options.contains("archive-shard-size")) {
+        bool ok;
+        archiveShardSize = optionValue(options, "archive-shard-size").toLongLong(&ok) * 1024 * 1024;
+        if (!ok || archiveShardSize < 0) {
+            throw QString("Invalid archive shard size: '%1'").arg(optionValue(options, "archive-shard-size"));
+        }
+    }
+
+    if (options.contains("max-memory")) {
+        bool ok;
+        maxMemory = optionValue(options, "max-memory").toLongLong(&ok) * 1024 * 1024;
+        if (!ok || maxMemory < 0) {
+            throw QString("Invalid memory budget: '%1'").arg(optionValue(options, "max-memory"));
+        }
+    }
+
+    if (options.contains("progress-interval")) {
+        bool ok;
+        progressInterval = optionValue(options, "progress-interval").toInt(&ok);
+        if (!ok || progressInterval < 0) {
+            throw QString("Invalid progress report interval: '%1'").arg(optionValue(options, "progress-interval"));
+        }
+    }
+    progressPrometheusFile = optionValue(options, "progress-prometheus");
+    if (options.contains("progress-json-fd")) {
+        bool ok;
+        progressJsonFd = optionValue(options, "progress-json-fd").toInt(&ok);
+        if (!ok || progressJsonFd < 0) {
+            throw QString("Invalid progress report file descriptor: '%1'").arg(optionValue(options, "progress-json-fd"));
+        }
+    }
+    if (progressInterval == 0 && (!progressPrometheusFile.isEmpty() || progressJsonFd >= 0)) {
+        if (options.contains("progress-interval")) {
+            throw QString("Progress metrics outputs require non-zero progress report interval!");
+        }
+        progressInterval = 10;
+    }
+
+    // Parse frame range(s)
+    frameRanges.clear();
+    for (const QString &range : options.value("frame-range", QStringList() << "0:1:-1")) {
+        frameRanges.append(parseFrameRange(range));
+    }
+}
+
+void Processor::setPipelineCache (PipelineCache *cache)
+{
+    pipelineCache = cache;
+}
+
+void Processor::setThreadBudget (ThreadBudget *budget)
+{
+    threadBudget = budget;
 }
 
 void Processor::validateOptions ()
@@ -506,9 +2129,15 @@ void Processor::validateOptions ()
     if (!inputFileType.isEmpty()) {
         if (inputFileType != "image" &&
             inputFileType != "video" &&
-            inputFileType != "vrms") {
+            inputFileType != "vrms" &&
+            inputFileType != "video-pair" &&
+            inputFileType != "live") {
             throw QString("Invalid input file type specified: '%1'").arg(inputFileType);
         }
+    } else if (inputFile == "-" || inputFile.contains("://") || inputFile.contains(" ! ") || inputFile.startsWith("/dev/video")) {
+        // Standard input, URL, GStreamer pipeline or capture device
+        inputFileType = "live";
+        qCDebug(mvlStereoProcessor) << "Auto-determined input type:" << inputFileType;
     } else {
         QString suffix = QFileInfo(inputFile).suffix();
         if (suffix == "jpeg" || suffix == "jpg" || suffix == "png" || suffix == "ppm" || suffix == "bmp") {
@@ -516,16 +2145,24 @@ void Processor::validateOptions ()
         } else if (suffix == "vrms") {
             inputFileType = "vrms";
         } else if (suffix == "avi" || suffix == "mp4" || suffix == "mkv" || suffix == "mpg") {
-            inputFileType = "video";
+            // Separate left and right video files, or a single
+            // side-by-side video
+            inputFileType = inputFile.contains("%{s}") ? "video-pair" : "video";
         } else {
             throw QString("Unrecognized input file type; unhandled suffix '%1'").arg(suffix);
         }
         qCDebug(mvlStereoProcessor) << "Auto-determined input type:" << inputFileType;
     }
 
+    // Watch mode is supported only by image sequences
+    if (watchInput && inputFileType != "image") {
+        throw QString("Watch mode requires image sequence input!");
+    }
+
     // Is some output required?
     if (outputFrames.isEmpty() && outputRectified.isEmpty() &&
-        outputDisparity.isEmpty() && outputPoints.isEmpty()) {
+        outputDisparity.isEmpty() && outputPoints.isEmpty() &&
+        outputDepth.isEmpty() && outputStats.isEmpty()) {
         throw QString("No output formats specified; nothing to do!");
     }
 
@@ -542,16 +2179,163 @@ void Processor::validateOptions ()
         if (!outputPoints.isEmpty()) {
             throw QString("Reprojected points output requires stereo calibration!");
         }
+        if (!outputDepth.isEmpty()) {
+            throw QString("Depth output requires stereo calibration!");
+        }
     }
 
     // Stereo method is needed for disparity image and reprojected points
-    if (stereoMethodFile.isEmpty()) {
+    if (stereoMethodFiles.isEmpty()) {
         if (!outputDisparity.isEmpty()) {
             throw QString("Disparity output requires stereo method!");
         }
         if (!outputPoints.isEmpty()) {
             throw QString("Reprojected points output requires stereo method!");
         }
+        if (!outputDepth.isEmpty()) {
+            throw QString("Depth output requires stereo method!");
+        }
+        if (!outputStats.isEmpty()) {
+            throw QString("Statistics output requires stereo method!");
+        }
+    }
+
+    // Stereo method variants; each configuration file, combined with
+    // each point of the parameter grid
+    setupMethodVariants();
+
+    if (methodVariants.size() > 1) {
+        for (const QList<OutputFormat> *outputs : { &outputDisparity, &outputPoints, &outputDepth }) {
+            for (const OutputFormat &output : *outputs) {
+                if (!output.format.contains("%{m}")) {
+                    throw QString("With multiple stereo methods, output format '%1' must contain %{m} placeholder!").arg(output.format);
+                }
+            }
+        }
+    }
+
+    // Output sinks; this also validates output formats
+    setupOutputSinks();
+
+    // Rectified image ROI
+    if (!rectifiedRoiString.isEmpty()) {
+        cropRectified = true;
+
+        if (rectifiedRoiString == "valid") {
+            // Valid ROI requires stereo calibration
+            if (stereoCalibrationFile.isEmpty()) {
+                throw QString("Cropping to valid ROI requires stereo calibration!");
+            }
+            cropRectifiedToValidRoi = true;
+        } else {
+            QStringList tokens = rectifiedRoiString.split(",");
+            if (tokens.size() != 4) {
+                throw QString("Invalid rectified image ROI string '%1'").arg(rectifiedRoiString);
+            }
+
+            int values[4];
+            for (int i = 0; i < 4; i++) {
+                bool ok;
+                values[i] = tokens[i].toInt(&ok);
+                if (!ok || values[i] < 0) {
+                    throw QString("Invalid number token in rectified image ROI: '%1'").arg(tokens[i]);
+                }
+            }
+
+            rectifiedRoi = cv::Rect(values[0], values[1], values[2], values[3]);
+            if (rectifiedRoi.area() == 0) {
+                throw QString("Rectified image ROI must not be empty!");
+            }
+        }
+    }
+}
+
+
+void Processor::setupMethodVariants ()
+{
+    methodVariants.clear();
+
+    // Parse parameter sweeps
+    QList<QPair<QString, QStringList>> sweeps;
+    for (const QString &sweep : stereoMethodSweeps) {
+        QString name = sweep.section('=', 0, 0).trimmed();
+        QStringList values = sweep.section('=', 1).split(",", QString::SkipEmptyParts);
+
+        if (name.isEmpty() || values.isEmpty()) {
+            throw QString("Invalid stereo method parameter sweep: '%1'").arg(sweep);
+        }
+
+        sweeps.append(qMakePair(name, values));
+    }
+
+    if (!sweeps.isEmpty() && stereoMethodFiles.isEmpty()) {
+        throw QString("Stereo method parameter sweep requires stereo method!");
+    }
+
+    // Cartesian product of configuration files and parameter values
+    for (int i = 0; i < stereoMethodFiles.size(); i++) {
+        MethodVariant base;
+        base.file = stereoMethodFiles[i];
+        base.label = QFileInfo(base.file).completeBaseName();
+        for (int j = 0; j < stereoMethodFiles.size(); j++) {
+            if (j != i && QFileInfo(stereoMethodFiles[j]).completeBaseName() == base.label) {
+                base.label += QString("-%1").arg(i);
+                break;
+            }
+        }
+
+        QList<MethodVariant> variants({ base });
+        for (const QPair<QString, QStringList> &sweep : sweeps) {
+            QList<MethodVariant> expanded;
+            for (const MethodVariant &variant : variants) {
+                for (const QString &value : sweep.second) {
+                    MethodVariant newVariant = variant;
+                    newVariant.parameters.append(qMakePair(sweep.first, value));
+                    newVariant.label += QString("-%1=%2").arg(sweep.first).arg(value);
+                    expanded.append(newVariant);
+                }
+            }
+            variants = expanded;
+        }
+
+        methodVariants += variants;
+    }
+}
+
+
+OutputSink::Options Processor::getSinkOptions () const
+{
+    OutputSink::Options options;
+    options.depthScale = depthScale;
+    options.archiveShardSize = archiveShardSize;
+    options.archiveRegistry = archiveRegistry;
+    options.statsBins = statsBins;
+    options.statsNearDistance = statsNearDistance;
+    options.fastIntermediate = fastIntermediate;
+
+    return options;
+}
+
+void Processor::setupOutputSinks ()
+{
+    qDeleteAll(outputSinks);
+    outputSinks.clear();
+
+    OutputSink::Options options = getSinkOptions();
+
+    const QList<QPair<OutputSink::Kind, const QList<OutputFormat> *>> outputs = {
+        { OutputSink::KindFrames, &outputFrames },
+        { OutputSink::KindRectified, &outputRectified },
+        { OutputSink::KindDisparity, &outputDisparity },
+        { OutputSink::KindPoints, &outputPoints },
+        { OutputSink::KindDepth, &outputDepth },
+        { OutputSink::KindStats, &outputStats },
+    };
+
+    for (const auto &output : outputs) {
+        for (const OutputFormat &format : *output.second) {
+            outputSinks.append(OutputSink::create(output.first, format.format, format.stride, options));
+        }
     }
 }
 
@@ -22,6 +22,13 @@
 
 #include <QtCore>
 
+#include <functional>
+
+#include "memory_budget.h"
+#include "output_sink.h"
+#include "point_cloud_filter.h"
+#include "thread_budget.h"
+
 #include <stereo-pipeline/rectification.h>
 #include <stereo-pipeline/reprojection.h>
 #include <stereo-pipeline/stereo_method.h>
@@ -31,7 +38,13 @@ namespace MVL {
 namespace StereoProcessor {
 
 
+class AsyncWriter;
+class FrameCache;
+class ParallelRectification;
 class Source;
+class PipelineCache;
+class ProgressReporter;
+struct CachedPipeline;
 
 class Processor
 {
@@ -39,8 +52,33 @@ public:
     Processor ();
     virtual ~Processor ();
 
+    // Parse command-line and either process input, or run server
     void run ();
 
+    // Load processing options, given as map of values keyed by long
+    // command-line option names
+    void loadOptions (const QHash<QString, QStringList> &options);
+
+    // Use warm pipeline elements from the given cache
+    void setPipelineCache (PipelineCache *cache);
+
+    // Use the given (shared, already configured) thread budget instead
+    // of configuring our own from the threading options
+    void setThreadBudget (ThreadBudget *budget);
+
+    // Process input with currently loaded options
+    void process ();
+
+    struct Statistics {
+        Statistics () : numFrames(0), numFramesReused(0), setupTime(0), processingTime(0) {}
+
+        int numFrames;
+        int numFramesReused;
+        qint64 setupTime; // ms
+        qint64 processingTime; // ms
+    };
+    const Statistics &getStatistics () const;
+
 protected:
     struct FrameRange {
         int start;
@@ -49,38 +87,207 @@ protected:
     };
     FrameRange parseFrameRange (const QString &range) const;
 
+    // Frame in flight; shared by the processing loop and all pending
+    // tasks that use the frame's data, and destroyed once the last of
+    // them finishes, which releases the frame's memory reservation and
+    // invokes the (optional) completion callback
+    struct FrameInFlight {
+        ~FrameInFlight () { if (finished) finished(); }
+
+        QSharedPointer<MemoryBudget::Reservation> reservation;
+        std::function<void ()> finished;
+    };
+
+    // Output format, produced for every stride-th frame of each frame
+    // range (i.e., frames whose index within the range, counted in range
+    // steps from its start, is a multiple of stride)
+    struct OutputFormat {
+        QString format;
+        int stride;
+
+        bool isActive (int rangeIndex) const { return rangeIndex % stride == 0; }
+    };
+    QList<OutputFormat> parseOutputFormats (const QStringList &formats) const;
+    static bool isAnyOutputActive (const QList<OutputFormat> &outputs, int rangeIndex);
+    static int getRangeIndex (const FrameRange &range, int frame);
+
     void parseCommandLine ();
     void validateOptions ();
+    void setupMethodVariants ();
+    void setupOutputSinks ();
+    OutputSink::Options getSinkOptions () const;
     void setupPipeline ();
+    void setupFrameCache ();
     void processFrameRange (const FrameRange &frameRange);
+    void estimate ();
+
+    void setupRectifiedRoi (const cv::Size &imageSize);
+    void rectifyImagePair (const cv::Mat &imageLeft, const cv::Mat &imageRight, cv::Mat &rectifiedLeft, cv::Mat &rectifiedRight);
+    void rectifyLeftImage (const cv::Mat &imageLeft, cv::Mat &rectifiedLeft);
+
+    cv::Mat computeChangeSignature (const cv::Mat &imageLeft, const cv::Mat &imageRight) const;
+    void computeDisparities (const cv::Mat &rectifiedLeft, const cv::Mat &rectifiedRight, QVector<cv::Mat> &disparities, QVector<int> &numDisparities);
+    void computeMethodDisparity (MVL::StereoToolbox::Pipeline::StereoMethod *method, const cv::Mat &rectifiedLeft, const cv::Mat &rectifiedRight, cv::Mat &disparity, int &numDisparities) const;
+    int getDisparityBandOverlap (const QObject *method) const;
+    static int getMethodWindowSize (const QObject *method);
+
+    static void applyMethodParameters (QObject *method, const QList<QPair<QString, QString>> &parameters);
+
+    bool isColorRequired () const;
+    bool isPointColorRequired (int rangeIndex) const;
+    qint64 submitOutputs (AsyncWriter &writer, OutputSink::Kind kind, int rangeIndex, const OutputFrame &data, const QSharedPointer<FrameInFlight> &frameInFlight) const;
+    static qint64 getMatrixFootprint (const QVector<cv::Mat> &matrices);
 
 protected:
     QCommandLineParser parser;
 
+    // Server mode
+    QString serverSocket;
+    int numServerWorkers;
+    int serverCacheSize;
+
     // Input
     QString inputFile;
     QString inputFileType;
 
+    // Video pair input
+    bool videoSyncTimestamp;
+
+    // VRMS input
+    int numVrmsReaders;
+
+    // Live stream input
+    QString liveFormat;
+    bool liveDropFrames;
+
+    // Watched image sequence input
+    bool watchInput;
+    int watchTimeout;
+
     // Config files
     QString stereoCalibrationFile;
-    QString stereoMethodFile;
+    QStringList stereoMethodFiles;
+    QStringList stereoMethodSweeps;
+
+    // Stereo method variants (configuration file and swept parameter
+    // values), and their labels used for %{m} placeholder
+    struct MethodVariant {
+        QString file;
+        QList<QPair<QString, QString>> parameters;
+        QString label;
+    };
+    QList<MethodVariant> methodVariants;
 
     // Ranges of frames to process
     QVector<FrameRange> frameRanges;
 
+    // Cropping of rectified images; either valid ROI from calibration,
+    // or user-specified ROI
+    QString rectifiedRoiString;
+    bool cropRectified;
+    bool cropRectifiedToValidRoi;
+    bool rectifiedRoiInitialized;
+    cv::Rect rectifiedRoi;
+
+    // Tiled disparity; height of bands (0 to disable), and overlap of
+    // bands (-1 for automatic)
+    int disparityBandHeight;
+    int disparityBandOverlap;
+
+    // Rectification via pipeline's own (serial) implementation, instead
+    // of parallel stripe-split remapping
+    bool serialRectification;
+
+    // Grayscale processing
+    bool grayscale;
+
+    // Change detection (incremental mode); disabled if threshold is
+    // negative
+    double changeThreshold;
+    int changeDownsampleFactor;
+
+    // Frame cache; directory, size limit, and types of cached frames
+    QString frameCacheDirectory;
+    qint64 frameCacheSize;
+    bool frameCacheDecoded;
+    bool frameCacheRectified;
+
+    // Threading; total number of threads (0 for number of cores),
+    // per-stage assignment, and CPU pinning
+    int numThreads;
+    QString threadStages;
+    bool pinThreads;
+    ThreadBudget ownThreadBudget;
+    ThreadBudget *threadBudget;
+
+    // Dry-run estimation; number of sampled frames, and number of jobs
+    // (shards) to extrapolate for
+    bool estimateOnly;
+    int estimateSamples;
+    int estimateJobs;
+
     // Output formats
-    QStringList outputFrames;
-    QStringList outputRectified;
-    QStringList outputDisparity;
-    QStringList outputPoints;
+    QList<OutputFormat> outputFrames;
+    QList<OutputFormat> outputRectified;
+    QList<OutputFormat> outputDisparity;
+    QList<OutputFormat> outputPoints;
+    QList<OutputFormat> outputDepth;
+    QList<OutputFormat> outputStats;
+
+    // Scale of depth stored in 16-bit images
+    double depthScale;
+
+    // Cheapest lossless encoding of frames and rectified images (unless
+    // their templates specify encoder options)
+    bool fastIntermediate;
+
+    // Summary statistics; number of disparity histogram bins, and
+    // distance below which pixels are counted as near
+    int statsBins;
+    double statsNearDistance;
+
+    // Size of tar archive shards (0 for single archive), and archives
+    // opened by the sinks of this run
+    qint64 archiveShardSize;
+    QSharedPointer<ArchiveRegistry> archiveRegistry;
+
+    // Output sinks, created from output formats at setup
+    QList<OutputSink *> outputSinks;
+
+    // Progress reporting; interval in seconds (0 to disable), Prometheus
+    // textfile-collector file, and file descriptor for JSON lines (-1 if
+    // disabled)
+    int progressInterval;
+    QString progressPrometheusFile;
+    int progressJsonFd;
+    ProgressReporter *progressReporter;
+
+    // Memory budget for frames in flight, in bytes (0 for unlimited)
+    qint64 maxMemory;
+
+    // Decimation and range clipping of output point clouds
+    PointCloudFilter pointCloudFilter;
+
+    // Frame cache, and key bases for decoded and rectified frames
+    FrameCache *frameCache;
+    QString decodedCacheKeyBase;
+    QString rectifiedCacheKeyBase;
 
     // Pipeline
+    PipelineCache *pipelineCache;
+    CachedPipeline *cachedPipeline;
+
     QPointer<Source> inputSource;
 
     QPointer<MVL::StereoToolbox::Pipeline::Rectification> stereoRectification;
+    ParallelRectification *parallelRectification;
     QPointer<MVL::StereoToolbox::Pipeline::Reprojection> stereoReprojection;
+    cv::Mat reprojectionMatrix;
+
+    QList<QPointer<QObject>> stereoMethods;
+    QStringList stereoMethodLabels;
 
-    QPointer<QObject> stereoMethod;
+    Statistics statistics;
 };
 
 
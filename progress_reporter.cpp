@@ -0,0 +1,377 @@
+/*
+ * MVL Stereo Processor: progress reporter
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "progress_reporter.h"
+#include "async_writer.h"
+#include "debug.h"
+#include "frame_prefetcher.h"
+#include "output_sink.h"
+#include "utils.h"
+
+#include <algorithm>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+class ProgressReporter::ReporterThread : public QThread
+{
+public:
+    ReporterThread (ProgressReporter *reporter)
+        : QThread(), reporter(reporter)
+    {
+    }
+
+protected:
+    virtual void run ()
+    {
+        reporter->reporterLoop();
+    }
+
+protected:
+    ProgressReporter *reporter;
+};
+
+
+static QString formatSize (double bytes)
+{
+    const char *units[] = { "B", "kB", "MB", "GB", "TB" };
+    int unit = 0;
+    while (bytes >= 1024 && unit < 4) {
+        bytes /= 1024;
+        unit++;
+    }
+    return QString("%1 %2").arg(bytes, 0, 'f', 1).arg(units[unit]);
+}
+
+static QString formatDuration (qint64 seconds)
+{
+    return QString("%1:%2:%3").arg(seconds / 3600).arg(seconds / 60 % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+}
+
+static QString escapeLabel (const QString &value)
+{
+    QString escaped = value;
+    escaped.replace("\\", "\\\\").replace("\"", "\\\"").replace("\n", "\\n");
+    return escaped;
+}
+
+
+ProgressReporter::ProgressReporter (int interval, const QString &prometheusFile, int jsonFd, const QList<OutputSink *> &sinks)
+    : reporterThread(0),
+      interval(interval),
+      prometheusFile(prometheusFile),
+      jsonFd(jsonFd),
+      sinks(sinks),
+      stopRequested(false),
+      prefetcher(0),
+      writer(0),
+      numFramesDone(0),
+      numFramesSkipped(0),
+      numFramesTotal(-1),
+      previousFramesDone(0),
+      previousElapsed(0)
+{
+}
+
+ProgressReporter::~ProgressReporter ()
+{
+    if (reporterThread) {
+        {
+            QMutexLocker locker(&mutex);
+            stopRequested = true;
+            wakeup.wakeAll();
+        }
+        reporterThread->wait();
+        delete reporterThread;
+    }
+}
+
+
+// *********************************************************************
+// *                          Start and stop                           *
+// *********************************************************************
+void ProgressReporter::start (qint64 total)
+{
+    if (jsonFd >= 0 && !jsonFile.isOpen()) {
+        if (!jsonFile.open(jsonFd, QIODevice::WriteOnly | QIODevice::Text, QFileDevice::DontCloseHandle)) {
+            throw QString("Failed to open file descriptor %1 for progress reports: %2").arg(jsonFd).arg(jsonFile.errorString());
+        }
+    }
+
+    numFramesTotal = total;
+    numFramesDone.store(0);
+    numFramesSkipped.store(0);
+    previousFramesDone = 0;
+    previousElapsed = 0;
+    stopRequested = false;
+    timer.start();
+
+    reporterThread = new ReporterThread(this);
+    reporterThread->start(QThread::LowPriority);
+}
+
+void ProgressReporter::stop ()
+{
+    if (!reporterThread) {
+        return;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        stopRequested = true;
+        wakeup.wakeAll();
+    }
+
+    reporterThread->wait();
+    delete reporterThread;
+    reporterThread = 0;
+
+    try {
+        report(true);
+    } catch (const QString &error) {
+        qCWarning(mvlStereoProcessor) << "Failed to write progress report:" << error;
+    }
+}
+
+
+void ProgressReporter::attachQueues (const FramePrefetcher *framePrefetcher, const AsyncWriter *asyncWriter)
+{
+    QMutexLocker locker(&mutex);
+    prefetcher = framePrefetcher;
+    writer = asyncWriter;
+}
+
+void ProgressReporter::detachQueues ()
+{
+    QMutexLocker locker(&mutex);
+    prefetcher = 0;
+    writer = 0;
+}
+
+void ProgressReporter::addFrame ()
+{
+    numFramesDone.fetchAndAddRelaxed(1);
+}
+
+void ProgressReporter::addSkippedFrame ()
+{
+    numFramesSkipped.fetchAndAddRelaxed(1);
+}
+
+
+// *********************************************************************
+// *                             Reporting                             *
+// *********************************************************************
+void ProgressReporter::reporterLoop ()
+{
+    QMutexLocker locker(&mutex);
+
+    while (!stopRequested) {
+        wakeup.wait(&mutex, interval * 1000UL);
+        if (stopRequested) {
+            break;
+        }
+
+        locker.unlock();
+        try {
+            report(false);
+        } catch (const QString &error) {
+            qCWarning(mvlStereoProcessor) << "Failed to write progress report:" << error;
+        }
+        locker.relock();
+    }
+}
+
+void ProgressReporter::report (bool final)
+{
+    qint64 elapsed = timer.elapsed();
+    qint64 framesDone = numFramesDone.load();
+    qint64 framesSkipped = numFramesSkipped.load();
+
+    // Frame rates count processed frames only; completion and ETA also
+    // account for skipped ones, as they are part of the total
+    qint64 framesHandled = framesDone + framesSkipped;
+
+    // Instantaneous rate over the last interval, and average over the
+    // whole run
+    double fps = elapsed > previousElapsed ? 1000.0 * (framesDone - previousFramesDone) / (elapsed - previousElapsed) : 0.0;
+    double averageFps = elapsed > 0 ? 1000.0 * framesDone / elapsed : 0.0;
+    double handledRate = elapsed > 0 ? 1000.0 * framesHandled / elapsed : 0.0;
+
+    previousFramesDone = framesDone;
+    previousElapsed = elapsed;
+
+    qint64 eta = -1;
+    if (final) {
+        eta = 0;
+    } else if (numFramesTotal >= 0 && handledRate > 0) {
+        eta = static_cast<qint64>(std::max<qint64>(numFramesTotal - framesHandled, 0) / handledRate + 0.5);
+    }
+
+    int decodeQueue = 0;
+    int writeQueue = 0;
+    {
+        QMutexLocker locker(&mutex);
+        if (prefetcher) {
+            decodeQueue = prefetcher->getNumReady();
+        }
+        if (writer) {
+            writeQueue = writer->getNumPending();
+        }
+    }
+
+    // Bytes written, per sink and per output kind
+    QVector<qint64> bytesWritten;
+    QMap<QString, qint64> bytesPerKind;
+    qint64 totalBytes = 0;
+    for (const OutputSink *sink : sinks) {
+        qint64 bytes = sink->getBytesWritten();
+        bytesWritten.append(bytes);
+        bytesPerKind[OutputSink::getKindName(sink->getKind())] += bytes;
+        totalBytes += bytes;
+    }
+
+    // *** Status line ***
+    QString line = QString("Progress: %1").arg(framesHandled);
+    if (numFramesTotal >= 0) {
+        line += QString("/%1 frames (%2%)").arg(numFramesTotal).arg(numFramesTotal ? 100.0 * framesHandled / numFramesTotal : 100.0, 0, 'f', 1);
+    } else {
+        line += " frames";
+    }
+    if (framesSkipped) {
+        line += QString(", %1 skipped").arg(framesSkipped);
+    }
+    line += QString("; %1 fps (average %2 fps)").arg(fps, 0, 'f', 1).arg(averageFps, 0, 'f', 1);
+    if (eta >= 0) {
+        line += QString("; ETA %1").arg(formatDuration(eta));
+    }
+    line += QString("; queues: decode %1, write %2").arg(decodeQueue).arg(writeQueue);
+    if (!sinks.isEmpty()) {
+        QStringList kinds;
+        for (auto it = bytesPerKind.constBegin(); it != bytesPerKind.constEnd(); ++it) {
+            kinds.append(QString("%1 %2").arg(it.key()).arg(formatSize(it.value())));
+        }
+        line += QString("; written: %1 (%2)").arg(formatSize(totalBytes)).arg(kinds.join(", "));
+    }
+
+    qCInfo(mvlStereoProcessor) << qPrintable(line);
+
+    // *** Prometheus textfile ***
+    if (!prometheusFile.isEmpty()) {
+        const QString prefix = "mvl_stereo_processor_";
+        QString contents;
+        QTextStream stream(&contents);
+
+        auto metric = [&] (const QString &name, const QString &type, const QString &help) {
+            stream << "# HELP " << prefix << name << " " << help << "\n";
+            stream << "# TYPE " << prefix << name << " " << type << "\n";
+        };
+
+        metric("frames_done", "counter", "Number of processed frames.");
+        stream << prefix << "frames_done " << framesDone << "\n";
+        metric("frames_skipped", "counter", "Number of frames skipped because they were not available.");
+        stream << prefix << "frames_skipped " << framesSkipped << "\n";
+        if (numFramesTotal >= 0) {
+            metric("frames_total", "gauge", "Total number of frames to process.");
+            stream << prefix << "frames_total " << numFramesTotal << "\n";
+        }
+        metric("fps", "gauge", "Frame rate over the last reporting interval.");
+        stream << prefix << "fps " << fps << "\n";
+        metric("fps_average", "gauge", "Average frame rate since start of processing.");
+        stream << prefix << "fps_average " << averageFps << "\n";
+        if (eta >= 0) {
+            metric("eta_seconds", "gauge", "Estimated time to completion.");
+            stream << prefix << "eta_seconds " << eta << "\n";
+        }
+        metric("queue_depth", "gauge", "Number of items in processing queues.");
+        stream << prefix << "queue_depth{queue=\"decode\"} " << decodeQueue << "\n";
+        stream << prefix << "queue_depth{queue=\"write\"} " << writeQueue << "\n";
+        if (!sinks.isEmpty()) {
+            metric("bytes_written", "counter", "Number of bytes written by output.");
+            for (int i = 0; i < sinks.size(); i++) {
+                stream << prefix << "bytes_written{kind=\"" << OutputSink::getKindName(sinks[i]->getKind()) << "\",output=\"" << escapeLabel(sinks[i]->getFormat()) << "\"} " << bytesWritten[i] << "\n";
+            }
+        }
+        metric("done", "gauge", "Whether processing has finished.");
+        stream << prefix << "done " << (final ? 1 : 0) << "\n";
+        metric("last_report_timestamp_seconds", "gauge", "Time of the last progress report.");
+        stream << prefix << "last_report_timestamp_seconds " << QDateTime::currentMSecsSinceEpoch() / 1000 << "\n";
+
+        stream.flush();
+        writePrometheusFile(contents);
+    }
+
+    // *** JSON lines ***
+    if (jsonFile.isOpen()) {
+        QJsonObject queues;
+        queues["decode"] = decodeQueue;
+        queues["write"] = writeQueue;
+
+        QJsonArray outputs;
+        for (int i = 0; i < sinks.size(); i++) {
+            QJsonObject output;
+            output["kind"] = OutputSink::getKindName(sinks[i]->getKind());
+            output["format"] = sinks[i]->getFormat();
+            output["bytes"] = static_cast<double>(bytesWritten[i]);
+            outputs.append(output);
+        }
+
+        QJsonObject object;
+        object["timestamp"] = static_cast<double>(QDateTime::currentMSecsSinceEpoch()) / 1000.0;
+        object["elapsed"] = elapsed / 1000.0;
+        object["frames_done"] = static_cast<double>(framesDone);
+        object["frames_skipped"] = static_cast<double>(framesSkipped);
+        object["frames_total"] = numFramesTotal >= 0 ? QJsonValue(static_cast<double>(numFramesTotal)) : QJsonValue();
+        object["fps"] = fps;
+        object["fps_average"] = averageFps;
+        object["eta"] = eta >= 0 ? QJsonValue(static_cast<double>(eta)) : QJsonValue();
+        object["queues"] = queues;
+        object["outputs"] = outputs;
+        object["done"] = final;
+
+        QByteArray data = QJsonDocument(object).toJson(QJsonDocument::Compact) + "\n";
+        if (jsonFile.write(data) != data.size() || !jsonFile.flush()) {
+            throw QString("Failed to write to file descriptor %1: %2").arg(jsonFd).arg(jsonFile.errorString());
+        }
+    }
+}
+
+void ProgressReporter::writePrometheusFile (const QString &contents) const
+{
+    // Textfile collector may read the file at any time, so it is
+    // replaced atomically
+    Utils::ensureParentDirectoryExists(prometheusFile);
+
+    QSaveFile file(prometheusFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        throw QString("Failed to open '%1': %2").arg(prometheusFile).arg(file.errorString());
+    }
+
+    file.write(contents.toUtf8());
+
+    if (!file.commit()) {
+        throw QString("Failed to write '%1': %2").arg(prometheusFile).arg(file.errorString());
+    }
+}
+
+
+} // StereoProcessor
+} // MVL
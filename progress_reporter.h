@@ -0,0 +1,104 @@
+/*
+ * MVL Stereo Processor: progress reporter
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__PROGRESS_REPORTER_H
+#define MVL_STEREO_PROCESSOR__PROGRESS_REPORTER_H
+
+#include <QtCore>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+class AsyncWriter;
+class FramePrefetcher;
+class OutputSink;
+
+
+// Periodic progress reporting for long runs; a background thread wakes
+// up at fixed interval and reports the number of processed frames,
+// instantaneous and average frame rate, estimated time to completion,
+// depths of decode and write queues, and bytes written by each output
+// sink. Frames that are not available (gaps in the sequence) are counted
+// separately as skipped. The report is logged as a compact status line,
+// and optionally written as Prometheus textfile-collector file (replaced
+// atomically) and as JSON lines to a file descriptor. The processing
+// thread only bumps atomic frame counters.
+class ProgressReporter
+{
+public:
+    // Interval is given in seconds; Prometheus file may be empty, and
+    // JSON file descriptor may be -1 to disable the respective output
+    ProgressReporter (int interval, const QString &prometheusFile, int jsonFd, const QList<OutputSink *> &sinks);
+    virtual ~ProgressReporter ();
+
+    // Start reporting; total number of frames is -1 if unknown
+    void start (qint64 numFramesTotal);
+
+    // Stop reporting, and emit the final report
+    void stop ();
+
+    // Queues of the frame range that is being processed
+    void attachQueues (const FramePrefetcher *prefetcher, const AsyncWriter *writer);
+    void detachQueues ();
+
+    void addFrame ();
+    void addSkippedFrame ();
+
+protected:
+    void reporterLoop ();
+    void report (bool final);
+
+    void writePrometheusFile (const QString &contents) const;
+
+protected:
+    class ReporterThread;
+    ReporterThread *reporterThread;
+
+    const int interval;
+    const QString prometheusFile;
+    const int jsonFd;
+    const QList<OutputSink *> sinks;
+
+    QFile jsonFile;
+
+    QMutex mutex;
+    QWaitCondition wakeup;
+    bool stopRequested;
+
+    const FramePrefetcher *prefetcher;
+    const AsyncWriter *writer;
+
+    QAtomicInteger<qint64> numFramesDone;
+    QAtomicInteger<qint64> numFramesSkipped;
+    qint64 numFramesTotal;
+
+    // State at previous report, for instantaneous frame rate
+    QElapsedTimer timer;
+    qint64 previousFramesDone;
+    qint64 previousElapsed;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
@@ -0,0 +1,301 @@
+/*
+ * MVL Stereo Processor: server
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "server.h"
+#include "debug.h"
+#include "processor.h"
+
+#include <opencv2/core.hpp>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// *********************************************************************
+// *                            Server job                             *
+// *********************************************************************
+class ServerJob : public QRunnable
+{
+public:
+    ServerJob (QObject *server, PipelineCache *pipelineCache, ThreadBudget *threadBudget, quint64 id, const QJsonValue &requestId, const QJsonObject &options)
+        : server(server), pipelineCache(pipelineCache), threadBudget(threadBudget), id(id), requestId(requestId), options(options)
+    {
+        queueTimer.start();
+    }
+
+    virtual void run ()
+    {
+        QJsonObject response;
+        response["id"] = requestId;
+
+        qint64 queueTime = queueTimer.elapsed();
+
+        try {
+            Processor processor;
+            processor.setPipelineCache(pipelineCache);
+            processor.setThreadBudget(threadBudget);
+            processor.loadOptions(convertOptions(options));
+            processor.process();
+
+            const Processor::Statistics &statistics = processor.getStatistics();
+
+            response["status"] = QString("ok");
+            response["frames"] = statistics.numFrames;
+            response["framesReused"] = statistics.numFramesReused;
+
+            QJsonObject timings;
+            timings["queue"] = queueTime;
+            timings["setup"] = statistics.setupTime;
+            timings["processing"] = statistics.processingTime;
+            timings["total"] = queueTimer.elapsed();
+            response["timings"] = timings;
+        } catch (const QString &error) {
+            response["status"] = QString("error");
+            response["error"] = error;
+        } catch (const std::exception &error) {
+            response["status"] = QString("error");
+            response["error"] = QString::fromStdString(error.what());
+        }
+
+        QMetaObject::invokeMethod(server, "handleJobFinished", Qt::QueuedConnection,
+            Q_ARG(quint64, id),
+            Q_ARG(QByteArray, QJsonDocument(response).toJson(QJsonDocument::Compact)));
+    }
+
+protected:
+    // Convert JSON options object into map of option values; strings
+    // and numbers are single values, arrays are lists of values, and
+    // booleans denote flags
+    static QHash<QString, QStringList> convertOptions (const QJsonObject &object)
+    {
+        QHash<QString, QStringList> options;
+
+        for (auto it = object.begin(); it != object.end(); ++it) {
+            QStringList values;
+            const QJsonValue &value = it.value();
+
+            if (value.isBool()) {
+                if (!value.toBool()) {
+                    continue;
+                }
+            } else if (value.isArray()) {
+                for (const QJsonValue &element : value.toArray()) {
+                    values.append(element.isDouble() ? QString::number(element.toDouble()) : element.toString());
+                }
+            } else if (value.isDouble()) {
+                values.append(QString::number(value.toDouble()));
+            } else if (value.isString()) {
+                values.append(value.toString());
+            } else {
+                throw QString("Invalid value for option '%1'").arg(it.key());
+            }
+
+            options[it.key()] = values;
+        }
+
+        return options;
+    }
+
+protected:
+    QObject *server;
+    PipelineCache *pipelineCache;
+    ThreadBudget *threadBudget;
+
+    quint64 id;
+    QJsonValue requestId;
+    QJsonObject options;
+
+    QElapsedTimer queueTimer;
+};
+
+
+// *********************************************************************
+// *                              Server                               *
+// *********************************************************************
+Server::Server (const QString &socketName, int numWorkers, int cacheSize, int numThreads, const QString &threadStages, bool pinThreads, QObject *parent)
+    : QObject(parent),
+      socketName(socketName),
+      pipelineCache(cacheSize),
+      nextJobId(0),
+      numJobsCompleted(0),
+      numJobsFailed(0),
+      shuttingDown(false)
+{
+    server = new QLocalServer(this);
+    connect(server, &QLocalServer::newConnection, this, &Server::handleNewConnection);
+
+    workerPool.setMaxThreadCount(numWorkers);
+
+    // Threads are budgeted for the whole process; OpenCV's thread count
+    // is global, so it is set here once, rather than by each job
+    threadBudget.configure(numThreads, threadStages, pinThreads);
+    threadBudget.setNumJobs(numWorkers);
+    threadBudget.print();
+    threadBudget.applyGlobalSettings();
+}
+
+Server::~Server ()
+{
+    workerPool.waitForDone();
+}
+
+
+void Server::start ()
+{
+    // Remove stale socket left behind by previous instance
+    QLocalServer::removeServer(socketName);
+
+    if (!server->listen(socketName)) {
+        throw QString("Failed to listen on local socket '%1': %2").arg(socketName).arg(server->errorString());
+    }
+
+    qCInfo(mvlStereoProcessor) << "Listening on" << qPrintable(server->fullServerName()) << "with" << workerPool.maxThreadCount() << "worker(s)";
+}
+
+
+void Server::handleNewConnection ()
+{
+    while (server->hasPendingConnections()) {
+        QLocalSocket *socket = server->nextPendingConnection();
+
+        connect(socket, &QLocalSocket::readyRead, this, &Server::handleReadyRead);
+        connect(socket, &QLocalSocket::disconnected, socket, &QLocalSocket::deleteLater);
+    }
+}
+
+void Server::handleReadyRead ()
+{
+    QLocalSocket *socket = qobject_cast<QLocalSocket *>(sender());
+
+    // Requests are newline-delimited
+    while (socket->canReadLine()) {
+        QByteArray data = socket->readLine().trimmed();
+        if (!data.isEmpty()) {
+            handleRequest(socket, data);
+        }
+    }
+}
+
+
+void Server::handleRequest (QLocalSocket *socket, const QByteArray &data)
+{
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(data, &parseError);
+
+    if (!document.isObject()) {
+        QJsonObject response;
+        response["status"] = QString("error");
+        response["error"] = QString("Invalid request: %1").arg(parseError.errorString());
+        sendResponse(socket, response);
+        return;
+    }
+
+    QJsonObject request = document.object();
+    QString command = request.value("command").toString("process");
+
+    if (command == "status") {
+        QJsonObject response = getStatus();
+        response["id"] = request.value("id");
+        response["status"] = QString("ok");
+        sendResponse(socket, response);
+    } else if (command == "shutdown") {
+        qCInfo(mvlStereoProcessor) << "Shutdown requested; waiting for" << pendingJobs.size() << "pending job(s)";
+
+        shuttingDown = true;
+        server->close();
+
+        QJsonObject response;
+        response["id"] = request.value("id");
+        response["status"] = QString("ok");
+        sendResponse(socket, response);
+
+        if (pendingJobs.isEmpty()) {
+            QCoreApplication::quit();
+        }
+    } else if (command == "process") {
+        if (shuttingDown) {
+            QJsonObject response;
+            response["id"] = request.value("id");
+            response["status"] = QString("error");
+            response["error"] = QString("Server is shutting down");
+            sendResponse(socket, response);
+            return;
+        }
+
+        quint64 job = nextJobId++;
+        pendingJobs.insert(job, socket);
+
+        workerPool.start(new ServerJob(this, &pipelineCache, &threadBudget, job, request.value("id"), request.value("options").toObject()));
+    } else {
+        QJsonObject response;
+        response["id"] = request.value("id");
+        response["status"] = QString("error");
+        response["error"] = QString("Unknown command '%1'").arg(command);
+        sendResponse(socket, response);
+    }
+}
+
+void Server::handleJobFinished (quint64 job, const QByteArray &response)
+{
+    QPointer<QLocalSocket> socket = pendingJobs.take(job);
+
+    QJsonObject object = QJsonDocument::fromJson(response).object();
+    if (object.value("status").toString() == "ok") {
+        numJobsCompleted++;
+    } else {
+        numJobsFailed++;
+    }
+
+    // Client may have disconnected in the meantime
+    if (socket) {
+        sendResponse(socket, object);
+    }
+
+    if (shuttingDown && pendingJobs.isEmpty()) {
+        QCoreApplication::quit();
+    }
+}
+
+void Server::sendResponse (QLocalSocket *socket, const QJsonObject &response)
+{
+    socket->write(QJsonDocument(response).toJson(QJsonDocument::Compact));
+    socket->write("\n");
+    socket->flush();
+}
+
+
+QJsonObject Server::getStatus () const
+{
+    QJsonObject status;
+
+    status["jobsPending"] = pendingJobs.size();
+    status["jobsActive"] = workerPool.activeThreadCount();
+    status["jobsCompleted"] = numJobsCompleted;
+    status["jobsFailed"] = numJobsFailed;
+    status["workers"] = workerPool.maxThreadCount();
+    status["pipelines"] = pipelineCache.getNumPipelines();
+    status["pipelinesIdle"] = pipelineCache.getNumIdlePipelines();
+
+    return status;
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,85 @@
+/*
+ * MVL Stereo Processor: server
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__SERVER_H
+#define MVL_STEREO_PROCESSOR__SERVER_H
+
+#include <QtCore>
+#include <QtNetwork>
+
+#include "pipeline_cache.h"
+#include "thread_budget.h"
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Long-running server that accepts processing requests over a local
+// socket. Requests and responses are newline-delimited JSON objects;
+// requests are processed on a worker pool, using warm pipelines from
+// a shared pipeline cache. The thread budget is process-wide; it is
+// configured once, and divided between concurrently processed requests.
+class Server : public QObject
+{
+    Q_OBJECT
+
+public:
+    Server (const QString &socketName, int numWorkers, int cacheSize, int numThreads, const QString &threadStages, bool pinThreads, QObject *parent = 0);
+    virtual ~Server ();
+
+    void start ();
+
+protected:
+    void handleRequest (QLocalSocket *socket, const QByteArray &data);
+    void sendResponse (QLocalSocket *socket, const QJsonObject &response);
+
+    QJsonObject getStatus () const;
+
+protected slots:
+    void handleNewConnection ();
+    void handleReadyRead ();
+
+    void handleJobFinished (quint64 job, const QByteArray &response);
+
+protected:
+    QString socketName;
+
+    QLocalServer *server;
+
+    QThreadPool workerPool;
+    PipelineCache pipelineCache;
+    ThreadBudget threadBudget;
+
+    // Sockets of pending jobs
+    quint64 nextJobId;
+    QHash<quint64, QPointer<QLocalSocket> > pendingJobs;
+
+    int numJobsCompleted;
+    int numJobsFailed;
+
+    bool shuttingDown;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
@@ -24,7 +24,7 @@ namespace StereoProcessor {
 
 
 Source::Source (const QString &filename)
-    : QObject(), filename(filename)
+    : QObject(), filename(filename), grayscale(false)
 {
 }
 
@@ -33,5 +33,61 @@ Source::~Source ()
 }
 
 
+void Source::setGrayscale (bool grayscale)
+{
+    this->grayscale = grayscale;
+}
+
+bool Source::getGrayscale () const
+{
+    return grayscale;
+}
+
+
+bool Source::supportsConcurrentAccess () const
+{
+    return false;
+}
+
+
+int Source::getNumFrames () const
+{
+    return -1;
+}
+
+int Source::getLastFrame () const
+{
+    return -1;
+}
+
+bool Source::isFrameAvailable (int frame) const
+{
+    Q_UNUSED(frame)
+    return true;
+}
+
+
+bool Source::isLive () const
+{
+    return false;
+}
+
+int Source::getNumDroppedFrames () const
+{
+    return 0;
+}
+
+QString Source::getFrameIdentity (int frame) const
+{
+    Q_UNUSED(frame)
+    return QString();
+}
+
+bool Source::isBuffered () const
+{
+    return false;
+}
+
+
 } // StereoProcessor
 } // MVL
@@ -36,10 +36,52 @@ public:
     Source (const QString &filename);
     virtual ~Source ();
 
-    virtual void getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight) = 0;
+    // Retrieve given frame; returns the timestamp (in milliseconds since
+    // epoch) at which the frame was acquired, or -1 if not known. The
+    // timestamp is returned together with the frame, so that it cannot
+    // be mixed up with the one of a frame retrieved by another thread
+    virtual qint64 getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight) = 0;
+
+    // Grayscale mode; getFrame() returns single-channel images, and
+    // colour images are retrieved on demand via getColorFrame(). The
+    // mode is set once, before frames are retrieved; getColorFrame()
+    // must not change it, as frames may be retrieved concurrently.
+    void setGrayscale (bool grayscale);
+    bool getGrayscale () const;
+
+    virtual void getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight) = 0;
+
+    // Whether getFrame() and getColorFrame() may be called from several
+    // threads at once (e.g., by concurrent frame prefetching)
+    virtual bool supportsConcurrentAccess () const;
+
+    // Frame index; number of available frames and last available frame
+    // (-1 if not known), and availability of given frame (for sequences
+    // with gaps)
+    virtual int getNumFrames () const;
+    virtual int getLastFrame () const;
+    virtual bool isFrameAvailable (int frame) const;
+
+    // Live sources; number of frames that were dropped because
+    // processing did not keep up
+    virtual bool isLive () const;
+    virtual int getNumDroppedFrames () const;
+
+    // Identity of the data of given frame, for keying cached frames;
+    // e.g., size and modification time of the files the frame is read
+    // from, if these are not covered by the input file itself. Empty by
+    // default
+    virtual QString getFrameIdentity (int frame) const;
+
+    // Whether the source buffers frames on its own (e.g., a live stream
+    // read by a background thread), in which case frames should be
+    // pulled straight through rather than prefetched
+    virtual bool isBuffered () const;
 
 protected:
     const QString filename;
+
+    bool grayscale;
 };
 
 
@@ -18,49 +18,507 @@
  */
 
 #include "source_image.h"
+#include "debug.h"
 #include "utils.h"
 
 #include <opencv2/imgcodecs.hpp>
 
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
 
 namespace MVL {
 namespace StereoProcessor {
 
 
-SourceImage::SourceImage (const QString &filename)
-    : Source(filename)
+class SourceImage::WatcherThread : public QThread
+{
+public:
+    WatcherThread (SourceImage *source)
+        : QThread(), source(source)
+    {
+    }
+
+protected:
+    virtual void run ()
+    {
+        source->watchDirectory();
+    }
+
+protected:
+    SourceImage *source;
+};
+
+
+SourceImage::SourceImage (const QString &filename, bool watch, int watchTimeout)
+    : Source(filename),
+      indexValid(false),
+      frameGroup(0),
+      sideGroup(0),
+      watcherThread(0),
+      watch(watch),
+      watchTimeout(watchTimeout),
+      inotifyFd(-1),
+      stopRequested(0),
+      readAheadFrames(4),
+      previousFrame(-1)
 {
+    // In watch mode, the directory watch is set up before the directory
+    // is scanned, so that no file can slip between the two
+    if (watch) {
+        startWatching();
+    }
+
+    buildFrameIndex();
+
+    if (watch) {
+        if (!indexValid) {
+            ::close(inotifyFd);
+            throw QString("Watch mode requires image sequence with %{f} and %{s} placeholders in file name!");
+        }
+
+        lastArrival.start();
+
+        watcherThread = new WatcherThread(this);
+        watcherThread->start();
+    }
 }
 
 SourceImage::~SourceImage ()
 {
+    // Stop watcher thread
+    if (watcherThread) {
+        stopRequested.store(1);
+        watcherThread->wait();
+        delete watcherThread;
+    }
+
+    if (inotifyFd >= 0) {
+        ::close(inotifyFd);
+    }
 }
 
 
-void SourceImage::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+// *********************************************************************
+// *                            Frame index                            *
+// *********************************************************************
+void SourceImage::buildFrameIndex ()
+{
+    QFileInfo fileInfo(filename);
+    directory = fileInfo.path();
+    pattern = fileInfo.fileName();
+
+    if (directory.contains("%{")) {
+        qCDebug(mvlStereoProcessor) << "Placeholders in directory name; not indexing image sequence.";
+        return;
+    }
+
+    // Convert file name pattern into regular expression, capturing the
+    // frame number and side label
+    QRegularExpression placeholder("\\%\\{(?<type>\\w+)(?:\\|(?<format>\\w+))?\\}");
+    QString expression = "^";
+    int index = 0;
+    int group = 0;
+
+    QRegularExpressionMatchIterator m = placeholder.globalMatch(pattern);
+    while (m.hasNext()) {
+        QRegularExpressionMatch match = m.next();
+
+        expression += QRegularExpression::escape(pattern.mid(index, match.capturedStart() - index));
+
+        QString type = match.captured(1);
+        if (type == "f") {
+            expression += "(-?\\d+)";
+            group++;
+            if (!frameGroup) {
+                frameGroup = group;
+            }
+        } else if (type == "s") {
+            expression += "([LR])";
+            group++;
+            if (!sideGroup) {
+                sideGroup = group;
+            }
+        } else {
+            qCDebug(mvlStereoProcessor) << "Unsupported placeholder" << match.captured() << "; not indexing image sequence.";
+            return;
+        }
+
+        index = match.capturedEnd();
+    }
+    expression += QRegularExpression::escape(pattern.mid(index)) + "$";
+
+    if (!frameGroup || !sideGroup) {
+        qCDebug(mvlStereoProcessor) << "No frame number or side placeholder; not indexing image sequence.";
+        return;
+    }
+
+    filenameExpression.setPattern(expression);
+
+    // Scan directory
+    QMutexLocker locker(&indexMutex);
+
+    QDirIterator it(directory, QDir::Files);
+    while (it.hasNext()) {
+        it.next();
+
+        // Modification time is needed only for latency in watch mode
+        addFileToIndex(it.fileName(), watch ? it.fileInfo().lastModified().toMSecsSinceEpoch() : -1);
+    }
+
+    // Incomplete pairs are kept pending in watch mode, as their other
+    // half may still arrive
+    int numIncomplete = incompleteEntries.size();
+    if (!watch) {
+        incompleteEntries.clear();
+    }
+
+    indexValid = true;
+
+    if (frameIndex.isEmpty()) {
+        qCInfo(mvlStereoProcessor) << "Image sequence index: no frames found!";
+    } else {
+        int first = frameIndex.firstKey();
+        int last = frameIndex.lastKey();
+        qCInfo(mvlStereoProcessor) << "Image sequence index:" << frameIndex.size() << "frames, from" << first << "to" << last << ";" << (last - first + 1 - frameIndex.size()) << "missing frame number(s)," << numIncomplete << "incomplete pair(s)";
+    }
+}
+
+// Add file to frame index, if it matches the pattern; a pair enters
+// the index once both of its files have been added. Must be called with
+// index mutex held.
+bool SourceImage::addFileToIndex (const QString &name, qint64 timestamp)
 {
+    QRegularExpressionMatch match = filenameExpression.match(name);
+    if (!match.hasMatch()) {
+        return false;
+    }
+
+    int frame = match.captured(frameGroup).toInt();
+    QString side = match.captured(sideGroup);
+
+    // Make sure the name is what we would have formatted; this takes
+    // care of zero-padding and repeated placeholders
     QHash<QString, QVariant> variableMap;
     variableMap["f"] = frame;
+    variableMap["s"] = side;
+    if (Utils::formatString(pattern, variableMap) != name) {
+        return false;
+    }
 
-    // Left image
-    variableMap["s"] = "L";
-    QString filenameLeft = Utils::formatString(filename, variableMap);
+    IndexEntry &entry = incompleteEntries[frame];
+    if (side == "L") {
+        entry.filenameLeft = QDir(directory).filePath(name);
+    } else {
+        entry.filenameRight = QDir(directory).filePath(name);
+    }
+    entry.timestamp = std::max(entry.timestamp, timestamp);
+
+    if (entry.filenameLeft.isEmpty() || entry.filenameRight.isEmpty()) {
+        return false;
+    }
+
+    frameIndex.insert(frame, entry);
+    incompleteEntries.remove(frame);
+
+    return true;
+}
+
+int SourceImage::getNumFrames () const
+{
+    // In watch mode, the sequence is open-ended
+    if (!indexValid || watch) {
+        return -1;
+    }
+
+    QMutexLocker locker(&indexMutex);
+    return frameIndex.size();
+}
+
+int SourceImage::getLastFrame () const
+{
+    if (!indexValid || watch) {
+        return -1;
+    }
+
+    QMutexLocker locker(&indexMutex);
+    return frameIndex.isEmpty() ? -1 : frameIndex.lastKey();
+}
+
+bool SourceImage::isFrameAvailable (int frame) const
+{
+    if (!indexValid) {
+        return true;
+    }
+
+    QMutexLocker locker(&indexMutex);
+
+    if (frameIndex.contains(frame)) {
+        return true;
+    }
+
+    // In watch mode, frames beyond the newest one (and those with only
+    // one half written) may still arrive
+    return watch && (frameIndex.isEmpty() || frame > frameIndex.lastKey() || incompleteEntries.contains(frame));
+}
+
+
+// *********************************************************************
+// *                            Watch mode                             *
+// *********************************************************************
+void SourceImage::startWatching ()
+{
+    QString watchDirectory = QFileInfo(filename).path();
+
+    inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd < 0) {
+        throw QString("Failed to initialize inotify: %1").arg(strerror(errno));
+    }
+
+    // Files are considered complete once closed after writing, or once
+    // moved into the directory (write-and-rename)
+    if (::inotify_add_watch(inotifyFd, QFile::encodeName(watchDirectory).constData(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        int error = errno;
+        ::close(inotifyFd);
+        inotifyFd = -1;
+        throw QString("Failed to watch directory '%1': %2").arg(watchDirectory).arg(strerror(error));
+    }
+}
+
+void SourceImage::watchDirectory ()
+{
+    std::vector<char> buffer(64*1024);
 
-    imageLeft = cv::imread(filenameLeft.toStdString());
+    while (!stopRequested.load()) {
+        // Poll with timeout, so that stop requests are noticed
+        struct pollfd pfd = { inotifyFd, POLLIN, 0 };
+        int ret = ::poll(&pfd, 1, 200);
+        if (ret <= 0) {
+            continue;
+        }
+
+        ssize_t length = ::read(inotifyFd, buffer.data(), buffer.size());
+        if (length <= 0) {
+            continue;
+        }
+
+        qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+        QMutexLocker locker(&indexMutex);
+
+        bool added = false;
+        for (ssize_t offset = 0; offset < length; ) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer.data() + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->len && !(event->mask & IN_ISDIR)) {
+                added = addFileToIndex(QFile::decodeName(event->name), timestamp) || added;
+            }
+        }
+
+        if (added) {
+            qCDebug(mvlStereoProcessor) << "Watched sequence: newest frame" << frameIndex.lastKey();
+
+            lastArrival.restart();
+            frameArrived.wakeAll();
+        }
+    }
+}
+
+// Block until the given frame arrives; throws if the frame has been
+// skipped (a later frame arrived, and this one is not even partially
+// written), or if idle timeout expires
+void SourceImage::waitForFrame (int frame)
+{
+    QMutexLocker locker(&indexMutex);
+
+    while (!frameIndex.contains(frame)) {
+        if (!frameIndex.isEmpty() && frame < frameIndex.lastKey() && !incompleteEntries.contains(frame)) {
+            throw QString("Frame %1 was skipped in watched image sequence").arg(frame);
+        }
+
+        if (watchTimeout > 0 && lastArrival.hasExpired(watchTimeout * 1000LL)) {
+            throw QString("No new frames for %1 seconds; stopping watch").arg(watchTimeout);
+        }
+
+        frameArrived.wait(&indexMutex, 1000);
+    }
+}
+
+bool SourceImage::isLive () const
+{
+    return watch;
+}
+
+
+// *********************************************************************
+// *                          Image reading                            *
+// *********************************************************************
+cv::Mat SourceImage::readImage (const QString &filename, int flags) const
+{
+    QFile file(filename);
+    if (!file.open(QIODevice::ReadOnly) || file.size() == 0) {
+        return cv::Mat();
+    }
+
+    // Memory-map the file and decode from memory; fall back to reading
+    // if mapping is not possible
+    cv::Mat image;
+
+    uchar *data = file.map(0, file.size());
+    if (data) {
+        image = cv::imdecode(cv::Mat(1, static_cast<int>(file.size()), CV_8UC1, data), flags);
+        file.unmap(data);
+    } else {
+        QByteArray buffer = file.readAll();
+        image = cv::imdecode(cv::Mat(1, buffer.size(), CV_8UC1, buffer.data()), flags);
+    }
+
+    return image;
+}
+
+void SourceImage::adviseReadAhead (int frame)
+{
+    if (!indexValid) {
+        return;
+    }
+
+    QMutexLocker locker(&readAheadMutex);
+    QMutexLocker indexLocker(&indexMutex);
+
+    // Estimate step from previous request
+    int step = (previousFrame >= 0 && frame > previousFrame) ? frame - previousFrame : 1;
+
+    // Forget about frames that have already been read
+    for (auto it = advisedFrames.begin(); it != advisedFrames.end(); ) {
+        if (*it <= frame) {
+            it = advisedFrames.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // Ask kernel to start reading upcoming files into page cache
+    for (int i = 1; i <= readAheadFrames; i++) {
+        int nextFrame = frame + i*step;
+
+        auto entry = frameIndex.constFind(nextFrame);
+        if (entry == frameIndex.constEnd() || advisedFrames.contains(nextFrame)) {
+            continue;
+        }
+
+        for (const QString &name : { entry->filenameLeft, entry->filenameRight }) {
+            int fd = ::open(QFile::encodeName(name).constData(), O_RDONLY);
+            if (fd >= 0) {
+                ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+                ::close(fd);
+            }
+        }
+
+        advisedFrames.insert(nextFrame);
+    }
+
+    previousFrame = frame;
+}
+
+
+qint64 SourceImage::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    // In grayscale mode, let the codec decode directly to single channel
+    return readFrame(frame, imageLeft, imageRight, grayscale ? cv::IMREAD_GRAYSCALE : cv::IMREAD_COLOR);
+}
+
+void SourceImage::getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    readFrame(frame, imageLeft, imageRight, cv::IMREAD_COLOR);
+}
+
+bool SourceImage::supportsConcurrentAccess () const
+{
+    return true;
+}
+
+bool SourceImage::getFrameFilenames (int frame, QString &filenameLeft, QString &filenameRight, qint64 &timestamp) const
+{
+    timestamp = -1;
+
+    if (indexValid) {
+        QMutexLocker locker(&indexMutex);
+
+        auto entry = frameIndex.constFind(frame);
+        if (entry == frameIndex.constEnd()) {
+            return false;
+        }
+
+        filenameLeft = entry->filenameLeft;
+        filenameRight = entry->filenameRight;
+        timestamp = entry->timestamp;
+    } else {
+        QHash<QString, QVariant> variableMap;
+        variableMap["f"] = frame;
+
+        variableMap["s"] = "L";
+        filenameLeft = Utils::formatString(filename, variableMap);
+
+        variableMap["s"] = "R";
+        filenameRight = Utils::formatString(filename, variableMap);
+    }
+
+    return true;
+}
+
+QString SourceImage::getFrameIdentity (int frame) const
+{
+    // Size and modification time of both image files
+    QString filenameLeft, filenameRight;
+    qint64 timestamp;
+    if (!getFrameFilenames(frame, filenameLeft, filenameRight, timestamp)) {
+        return QString();
+    }
+
+    QStringList identity;
+    for (const QString &name : { filenameLeft, filenameRight }) {
+        QFileInfo info(name);
+        identity << QString("%1:%2").arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+    }
+
+    return identity.join(",");
+}
+
+qint64 SourceImage::readFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight, int flags)
+{
+    QString filenameLeft, filenameRight;
+    qint64 timestamp;
+
+    if (watch) {
+        waitForFrame(frame);
+    }
+
+    if (!getFrameFilenames(frame, filenameLeft, filenameRight, timestamp)) {
+        throw QString("Frame %1 not found in image sequence").arg(frame);
+    }
+
+    adviseReadAhead(frame);
+
+    // Left image
+    imageLeft = readImage(filenameLeft, flags);
     if (imageLeft.empty()) {
         throw QString("Failed to open image '%1'").arg(filenameLeft);
     }
 
     // Right image
-    variableMap["s"] = "R";
-    QString filenameRight = Utils::formatString(filename, variableMap);
-
-    imageRight = cv::imread(filenameRight.toStdString());
+    imageRight = readImage(filenameRight, flags);
     if (imageRight.empty()) {
         throw QString("Failed to open image '%1'").arg(filenameRight);
     }
-}
 
+    return timestamp;
+}
 
 
 } // StereoProcessor
@@ -27,13 +27,89 @@ namespace MVL {
 namespace StereoProcessor {
 
 
+// Sequence of image pairs, given by filename pattern with %{f} (frame
+// number) and %{s} (L or R) placeholders. In watch mode, the directory
+// is monitored via inotify, and pairs are added to the frame index as
+// soon as both of their files are completely written; requests for
+// frames that have not arrived yet block until they do, or until no new
+// frame arrives within the idle timeout.
 class SourceImage : public Source
 {
 public:
-    SourceImage (const QString &filename);
+    SourceImage (const QString &filename, bool watch, int watchTimeout);
     virtual ~SourceImage ();
 
-    virtual void getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual qint64 getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual void getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+
+    virtual bool supportsConcurrentAccess () const;
+
+    virtual int getNumFrames () const;
+    virtual int getLastFrame () const;
+    virtual bool isFrameAvailable (int frame) const;
+
+    virtual QString getFrameIdentity (int frame) const;
+
+    // Watch mode
+    virtual bool isLive () const;
+
+protected:
+    void buildFrameIndex ();
+    bool addFileToIndex (const QString &name, qint64 timestamp);
+
+    void startWatching ();
+    void watchDirectory ();
+    void waitForFrame (int frame);
+
+    bool getFrameFilenames (int frame, QString &filenameLeft, QString &filenameRight, qint64 &timestamp) const;
+    qint64 readFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight, int flags);
+    cv::Mat readImage (const QString &filename, int flags) const;
+    void adviseReadAhead (int frame);
+
+protected:
+    // Frame index, built by scanning the directory; maps frame number
+    // to left and right image filename
+    struct IndexEntry {
+        IndexEntry () : timestamp(-1) {}
+
+        QString filenameLeft;
+        QString filenameRight;
+
+        // Time at which the pair was completed (ms since epoch)
+        qint64 timestamp;
+    };
+
+    bool indexValid;
+    QMap<int, IndexEntry> frameIndex;
+    QMap<int, IndexEntry> incompleteEntries;
+
+    // Filename matching
+    QString directory;
+    QString pattern;
+    QRegularExpression filenameExpression;
+    int frameGroup;
+    int sideGroup;
+
+    // Frame index may be updated by the watcher thread
+    mutable QMutex indexMutex;
+
+    // Watch mode
+    class WatcherThread;
+    WatcherThread *watcherThread;
+
+    bool watch;
+    int watchTimeout; // seconds; 0 to wait indefinitely
+    int inotifyFd;
+    QAtomicInt stopRequested;
+
+    QWaitCondition frameArrived;
+    QElapsedTimer lastArrival;
+
+    // Read-ahead
+    QMutex readAheadMutex;
+    int readAheadFrames;
+    int previousFrame;
+    QSet<int> advisedFrames;
 };
 
 
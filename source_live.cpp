@@ -0,0 +1,393 @@
+/*
+ * MVL Stereo Processor: input source: live stream
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "source_live.h"
+#include "debug.h"
+
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+class SourceLive::ReaderThread : public QThread
+{
+public:
+    ReaderThread (SourceLive *source)
+        : QThread(), source(source)
+    {
+    }
+
+protected:
+    virtual void run ()
+    {
+        source->readFrames();
+    }
+
+protected:
+    SourceLive *source;
+};
+
+
+SourceLive::SourceLive (const QString &filename, const QString &format, bool dropFrames)
+    : Source(filename),
+      readerThread(0),
+      fd(-1),
+      streamFormat(FormatMjpeg),
+      rawType(CV_8UC3),
+      streamSearchPos(0),
+      maxQueueSize(dropFrames ? 1 : 8),
+      dropFrames(dropFrames),
+      endOfStream(false),
+      stopRequested(0),
+      numDroppedFrames(0)
+{
+    struct stat info;
+
+    if (filename == "-") {
+        // Standard input
+        parseFormat(format);
+        fd = STDIN_FILENO;
+    } else if (::stat(filename.toLocal8Bit().constData(), &info) == 0 && (S_ISFIFO(info.st_mode) || S_ISREG(info.st_mode))) {
+        // FIFO or file containing the stream
+        parseFormat(format);
+        fd = ::open(filename.toLocal8Bit().constData(), O_RDONLY);
+        if (fd < 0) {
+            throw QString("Failed to open live stream '%1': %2").arg(filename).arg(strerror(errno));
+        }
+    } else {
+        // Device index, device node, URL or GStreamer pipeline
+        bool isIndex;
+        int index = filename.toInt(&isIndex);
+
+        if (isIndex) {
+            capture.open(index);
+        } else {
+            capture.open(filename.toStdString());
+        }
+
+        if (!capture.isOpened()) {
+            throw QString("Failed to open live capture %1").arg(filename);
+        }
+    }
+
+    // Start reader thread
+    readerThread = new ReaderThread(this);
+    readerThread->start();
+}
+
+SourceLive::~SourceLive ()
+{
+    // Stop reader thread
+    stopRequested.store(1);
+    {
+        QMutexLocker locker(&mutex);
+        spaceAvailable.wakeAll();
+    }
+    readerThread->wait();
+    delete readerThread;
+
+    if (fd >= 0 && fd != STDIN_FILENO) {
+        ::close(fd);
+    }
+}
+
+
+void SourceLive::parseFormat (const QString &format)
+{
+    // Format: mjpeg, or raw:WIDTHxHEIGHT[:gray8|bgr24]
+    if (format.isEmpty() || format == "mjpeg") {
+        streamFormat = FormatMjpeg;
+        return;
+    }
+
+    QStringList tokens = format.split(":");
+    if (tokens[0] != "raw" || tokens.size() < 2 || tokens.size() > 3) {
+        throw QString("Invalid live stream format '%1'").arg(format);
+    }
+
+    QStringList dimensions = tokens[1].split("x");
+    bool okWidth = false, okHeight = false;
+    if (dimensions.size() == 2) {
+        rawSize.width = dimensions[0].toInt(&okWidth);
+        rawSize.height = dimensions[1].toInt(&okHeight);
+    }
+    if (!okWidth || !okHeight || rawSize.area() <= 0) {
+        throw QString("Invalid raw frame dimensions '%1'").arg(tokens[1]);
+    }
+
+    rawType = CV_8UC3;
+    if (tokens.size() == 3) {
+        if (tokens[2] == "gray8") {
+            rawType = CV_8UC1;
+        } else if (tokens[2] != "bgr24") {
+            throw QString("Invalid raw pixel format '%1'").arg(tokens[2]);
+        }
+    }
+
+    streamFormat = FormatRaw;
+}
+
+
+// *********************************************************************
+// *                           Reader thread                           *
+// *********************************************************************
+void SourceLive::readFrames ()
+{
+    while (!stopRequested.load()) {
+        Frame frame;
+        bool ok;
+
+        try {
+            if (fd >= 0) {
+                ok = readStreamFrame(frame.image);
+            } else {
+                ok = capture.read(frame.image);
+            }
+        } catch (const QString &error) {
+            QMutexLocker locker(&mutex);
+            streamError = error;
+            ok = false;
+        }
+
+        if (!ok) {
+            break;
+        }
+
+        frame.timestamp = QDateTime::currentMSecsSinceEpoch();
+
+        // Enqueue
+        QMutexLocker locker(&mutex);
+        if (dropFrames) {
+            // Replace stale frames with the newest one
+            numDroppedFrames += queue.size();
+            queue.clear();
+        } else {
+            while (queue.size() >= maxQueueSize && !stopRequested.load()) {
+                spaceAvailable.wait(&mutex);
+            }
+        }
+        queue.enqueue(frame);
+        frameAvailable.wakeAll();
+    }
+
+    QMutexLocker locker(&mutex);
+    endOfStream = true;
+    frameAvailable.wakeAll();
+}
+
+bool SourceLive::readStreamFrame (cv::Mat &image)
+{
+    if (streamFormat == FormatRaw) {
+        // Raw frame of known size
+        image.create(rawSize, rawType);
+
+        size_t frameSize = image.total() * image.elemSize();
+        size_t numRead = 0;
+        while (numRead < frameSize) {
+            qint64 n = readStream(image.data + numRead, frameSize - numRead);
+            if (n <= 0) {
+                return false;
+            }
+            numRead += n;
+        }
+
+        return true;
+    }
+
+    // MJPEG; sequence of JPEG images, delimited by start-of-image (FFD8)
+    // and end-of-image (FFD9) markers
+    const size_t chunkSize = 64*1024;
+    const size_t maxFrameSize = 64*1024*1024;
+    bool haveStart = false;
+
+    while (true) {
+        // Search for markers in buffered data
+        for (; streamSearchPos + 1 < streamBuffer.size(); streamSearchPos++) {
+            if (streamBuffer[streamSearchPos] != 0xFF) {
+                continue;
+            }
+
+            uchar marker = streamBuffer[streamSearchPos + 1];
+            if (!haveStart && marker == 0xD8) {
+                // Discard everything before start of image
+                streamBuffer.erase(streamBuffer.begin(), streamBuffer.begin() + streamSearchPos);
+                streamSearchPos = 1;
+                haveStart = true;
+            } else if (haveStart && marker == 0xD9) {
+                // Decode and remove image from buffer
+                size_t imageSize = streamSearchPos + 2;
+
+                image = cv::imdecode(cv::Mat(1, static_cast<int>(imageSize), CV_8UC1, streamBuffer.data()), cv::IMREAD_COLOR);
+                streamBuffer.erase(streamBuffer.begin(), streamBuffer.begin() + imageSize);
+                streamSearchPos = 0;
+
+                if (image.empty()) {
+                    throw QString("Failed to decode MJPEG frame!");
+                }
+
+                return true;
+            }
+        }
+
+        if (!haveStart) {
+            // No start of image yet; drop searched data, except for the
+            // last byte, which may be the first half of the marker
+            if (streamBuffer.size() > 1) {
+                streamBuffer.erase(streamBuffer.begin(), streamBuffer.end() - 1);
+                streamSearchPos = 0;
+            }
+        } else if (streamBuffer.size() > maxFrameSize) {
+            throw QString("MJPEG frame exceeds %1 MB without end-of-image marker!").arg(maxFrameSize / (1024*1024));
+        }
+
+        // Read more data
+        size_t size = streamBuffer.size();
+        streamBuffer.resize(size + chunkSize);
+
+        qint64 n = readStream(streamBuffer.data() + size, chunkSize);
+        streamBuffer.resize(size + std::max<qint64>(n, 0));
+
+        if (n <= 0) {
+            return false;
+        }
+    }
+}
+
+qint64 SourceLive::readStream (uchar *data, size_t size)
+{
+    // Poll with timeout, so that we can react to stop requests
+    while (!stopRequested.load()) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        int ret = ::poll(&pfd, 1, 100);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw QString("Failed to poll live stream: %1").arg(strerror(errno));
+        } else if (ret == 0) {
+            continue;
+        }
+
+        ssize_t n = ::read(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            throw QString("Failed to read live stream: %1").arg(strerror(errno));
+        }
+
+        return n; // 0 on end of stream
+    }
+
+    return 0;
+}
+
+
+// *********************************************************************
+// *                          Frame retrieval                          *
+// *********************************************************************
+qint64 SourceLive::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    Q_UNUSED(frame)
+
+    Frame liveFrame;
+
+    {
+        QMutexLocker locker(&mutex);
+        while (queue.isEmpty() && !endOfStream) {
+            frameAvailable.wait(&mutex);
+        }
+
+        if (queue.isEmpty()) {
+            if (!streamError.isEmpty()) {
+                throw streamError;
+            }
+            throw QString("End of live stream!");
+        }
+
+        liveFrame = queue.dequeue();
+
+        spaceAvailable.wakeAll();
+    }
+
+    lastImage = liveFrame.image;
+    const cv::Mat &image = lastImage;
+
+    // Split frame into left and right
+    if (grayscale && image.channels() == 3) {
+        cv::cvtColor(image(cv::Rect(0, 0, image.cols/2, image.rows)), imageLeft, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(image(cv::Rect(image.cols/2, 0, image.cols/2, image.rows)), imageRight, cv::COLOR_BGR2GRAY);
+    } else {
+        image(cv::Rect(0, 0, image.cols/2, image.rows)).copyTo(imageLeft);
+        image(cv::Rect(image.cols/2, 0, image.cols/2, image.rows)).copyTo(imageRight);
+    }
+
+    return liveFrame.timestamp;
+}
+
+void SourceLive::getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    Q_UNUSED(frame)
+
+    // Live frames cannot be re-read; use the last returned frame
+    if (lastImage.empty()) {
+        throw QString("No live frame available!");
+    }
+
+    const cv::Mat &image = lastImage;
+    image(cv::Rect(0, 0, image.cols/2, image.rows)).copyTo(imageLeft);
+    image(cv::Rect(image.cols/2, 0, image.cols/2, image.rows)).copyTo(imageRight);
+}
+
+
+bool SourceLive::isLive () const
+{
+    return true;
+}
+
+int SourceLive::getNumDroppedFrames () const
+{
+    QMutexLocker locker(&mutex);
+    return numDroppedFrames;
+}
+
+bool SourceLive::isBuffered () const
+{
+    return true;
+}
+
+
+} // StereoProcessor
+} // MVL
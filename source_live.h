@@ -0,0 +1,108 @@
+/*
+ * MVL Stereo Processor: input source: live stream
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__SOURCE_LIVE_H
+#define MVL_STEREO_PROCESSOR__SOURCE_LIVE_H
+
+#include "source.h"
+
+#include <opencv2/videoio.hpp>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Live stream of side-by-side stereo frames. The stream is either read
+// from standard input ("-") or a FIFO, as a sequence of MJPEG or raw
+// frames, or captured via cv::VideoCapture (device, URL or GStreamer
+// pipeline). Frames are read by a background thread; in frame-dropping
+// mode, only the newest frame is kept, so that the latency remains
+// bounded even if processing cannot keep up with the stream.
+class SourceLive : public Source
+{
+public:
+    SourceLive (const QString &filename, const QString &format, bool dropFrames);
+    virtual ~SourceLive ();
+
+    // Frame number is ignored; frames are returned in order of arrival
+    virtual qint64 getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual void getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+
+    virtual bool isLive () const;
+    virtual int getNumDroppedFrames () const;
+    virtual bool isBuffered () const;
+
+protected:
+    void parseFormat (const QString &format);
+
+    void readFrames ();
+    bool readStreamFrame (cv::Mat &image);
+    qint64 readStream (uchar *data, size_t size);
+
+protected:
+    class ReaderThread;
+    ReaderThread *readerThread;
+
+    // Stream input (standard input or FIFO)
+    int fd;
+
+    enum StreamFormat {
+        FormatMjpeg,
+        FormatRaw,
+    } streamFormat;
+    cv::Size rawSize;
+    int rawType;
+
+    std::vector<uchar> streamBuffer;
+    size_t streamSearchPos;
+
+    // Capture input
+    cv::VideoCapture capture;
+
+    // Frame queue
+    struct Frame {
+        cv::Mat image;
+        qint64 timestamp;
+    };
+
+    mutable QMutex mutex;
+    QWaitCondition frameAvailable;
+    QWaitCondition spaceAvailable;
+
+    QQueue<Frame> queue;
+    int maxQueueSize;
+    bool dropFrames;
+
+    bool endOfStream;
+    QString streamError;
+    QAtomicInt stopRequested;
+
+    int numDroppedFrames;
+
+    // Last returned frame, for on-demand colour retrieval
+    cv::Mat lastImage;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
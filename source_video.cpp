@@ -19,12 +19,15 @@
 
 #include "source_video.h"
 
+#include <opencv2/imgproc.hpp>
+
 namespace MVL {
 namespace StereoProcessor {
 
 
 SourceVideo::SourceVideo (const QString &filename)
-    : Source(filename)
+    : Source(filename),
+      imageFrame(-1)
 {
     capture.open(filename.toStdString());
     if (!capture.isOpened()) {
@@ -37,7 +40,13 @@ SourceVideo::~SourceVideo ()
 }
 
 
-void SourceVideo::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+void SourceVideo::readFrame (cv::VideoCapture &capture, int frame, cv::Mat &image)
+{
+    grabFrame(capture, frame);
+    capture.retrieve(image);
+}
+
+void SourceVideo::grabFrame (cv::VideoCapture &capture, int frame)
 {
     // Rewind back, if necessary (forward seek is currently implemented
     // as skipping frames)
@@ -55,12 +64,42 @@ void SourceVideo::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
             break;
         }
     }
+}
 
-    capture.retrieve(image);
 
-    // Split frame into left and right
-    image(cv::Rect(0, 0, image.cols/2, image.rows)).copyTo(imageLeft);
-    image(cv::Rect(image.cols/2, 0, image.cols/2, image.rows)).copyTo(imageRight);
+qint64 SourceVideo::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    readFrame(capture, frame, image);
+    imageFrame = frame;
+
+    splitFrame(grayscale, imageLeft, imageRight);
+
+    return -1;
+}
+
+void SourceVideo::getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    // Decoded frame is usually still available; otherwise, seek and
+    // decode again
+    if (frame != imageFrame || image.empty()) {
+        readFrame(capture, frame, image);
+        imageFrame = frame;
+    }
+
+    splitFrame(false, imageLeft, imageRight);
+}
+
+void SourceVideo::splitFrame (bool toGrayscale, cv::Mat &imageLeft, cv::Mat &imageRight) const
+{
+    // VideoCapture always decodes to BGR; in grayscale mode, the colour
+    // conversion takes place of the copy
+    if (toGrayscale) {
+        cv::cvtColor(image(cv::Rect(0, 0, image.cols/2, image.rows)), imageLeft, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(image(cv::Rect(image.cols/2, 0, image.cols/2, image.rows)), imageRight, cv::COLOR_BGR2GRAY);
+    } else {
+        image(cv::Rect(0, 0, image.cols/2, image.rows)).copyTo(imageLeft);
+        image(cv::Rect(image.cols/2, 0, image.cols/2, image.rows)).copyTo(imageRight);
+    }
 }
 
 
@@ -35,11 +35,25 @@ public:
     SourceVideo (const QString &filename);
     virtual ~SourceVideo ();
 
-    virtual void getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual qint64 getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual void getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+
+    // Seek to given frame and retrieve it
+    static void readFrame (cv::VideoCapture &capture, int frame, cv::Mat &image);
+
+    // Seek to given frame and grab it, without decoding it; the frame's
+    // properties (e.g., timestamp) are available afterwards
+    static void grabFrame (cv::VideoCapture &capture, int frame);
+
+protected:
+    // Split decoded side-by-side frame into left and right image,
+    // optionally converting them to grayscale
+    void splitFrame (bool toGrayscale, cv::Mat &imageLeft, cv::Mat &imageRight) const;
 
 protected:
     cv::VideoCapture capture;
     cv::Mat image;
+    int imageFrame;
 };
 
 
@@ -0,0 +1,267 @@
+/*
+ * MVL Stereo Processor: input source: pair of video files
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "source_video_pair.h"
+#include "source_video.h"
+#include "utils.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <functional>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Persistent thread on which the right stream is decoded; one job at a
+// time is submitted, and its completion awaited
+class SourceVideoPair::DecoderThread : public QThread
+{
+public:
+    DecoderThread ()
+        : QThread(), stopRequested(false), busy(false)
+    {
+    }
+
+    void submit (const std::function<void ()> &function)
+    {
+        QMutexLocker locker(&mutex);
+        job = function;
+        error.clear();
+        busy = true;
+        jobChanged.wakeAll();
+    }
+
+    // Wait for the submitted job to finish; re-throws its error, if any
+    void waitForJob ()
+    {
+        QMutexLocker locker(&mutex);
+        while (busy) {
+            jobChanged.wait(&mutex);
+        }
+        if (!error.isEmpty()) {
+            throw error;
+        }
+    }
+
+    void stop ()
+    {
+        {
+            QMutexLocker locker(&mutex);
+            stopRequested = true;
+            jobChanged.wakeAll();
+        }
+        wait();
+    }
+
+protected:
+    virtual void run ()
+    {
+        QMutexLocker locker(&mutex);
+
+        while (true) {
+            while (!busy && !stopRequested) {
+                jobChanged.wait(&mutex);
+            }
+            if (!busy) {
+                break;
+            }
+
+            std::function<void ()> function = job;
+            QString jobError;
+
+            locker.unlock();
+            try {
+                function();
+            } catch (const QString &e) {
+                jobError = e;
+            } catch (const std::exception &e) {
+                jobError = QString::fromStdString(e.what());
+            }
+            locker.relock();
+
+            error = jobError;
+            busy = false;
+            jobChanged.wakeAll();
+        }
+    }
+
+protected:
+    QMutex mutex;
+    QWaitCondition jobChanged;
+    bool stopRequested;
+
+    bool busy;
+    std::function<void ()> job;
+    QString error;
+};
+
+
+// Read the first frame whose timestamp is not before the given one
+static void readFrameAtTimestamp (cv::VideoCapture &capture, double timestamp, double tolerance, cv::Mat &image)
+{
+    // Rewind back, if necessary
+    if (capture.get(cv::CAP_PROP_POS_MSEC) > timestamp + tolerance) {
+        capture.set(cv::CAP_PROP_POS_MSEC, std::max(timestamp - tolerance, 0.0));
+    }
+
+    while (true) {
+        if (!capture.grab()) {
+            throw QString("Failed to retrieve frame!");
+        }
+
+        if (capture.get(cv::CAP_PROP_POS_MSEC) >= timestamp - tolerance) {
+            break;
+        }
+    }
+
+    capture.retrieve(image);
+}
+
+
+SourceVideoPair::SourceVideoPair (const QString &filename, bool syncTimestamp)
+    : Source(filename),
+      syncTimestamp(syncTimestamp),
+      decoderThread(0),
+      lastFrame(-1)
+{
+    QHash<QString, QVariant> variableMap;
+
+    variableMap["s"] = "L";
+    QString filenameLeft = Utils::formatString(filename, variableMap);
+
+    variableMap["s"] = "R";
+    QString filenameRight = Utils::formatString(filename, variableMap);
+
+    captureLeft.open(filenameLeft.toStdString());
+    if (!captureLeft.isOpened()) {
+        throw QString("Failed to open video source %1").arg(filenameLeft);
+    }
+
+    captureRight.open(filenameRight.toStdString());
+    if (!captureRight.isOpened()) {
+        throw QString("Failed to open video source %1").arg(filenameRight);
+    }
+
+    QStringList identity;
+    for (const QString &name : { filenameLeft, filenameRight }) {
+        QFileInfo info(name);
+        identity << QString("%1:%2").arg(info.size()).arg(info.lastModified().toMSecsSinceEpoch());
+    }
+    filesIdentity = identity.join(",");
+
+    if (syncTimestamp && captureLeft.get(cv::CAP_PROP_FPS) <= 0) {
+        throw QString("Cannot synchronize by timestamp; unknown frame rate of video source %1").arg(filenameLeft);
+    }
+
+    decoderThread = new DecoderThread();
+    decoderThread->start();
+}
+
+SourceVideoPair::~SourceVideoPair ()
+{
+    if (decoderThread) {
+        decoderThread->stop();
+        delete decoderThread;
+    }
+}
+
+
+qint64 SourceVideoPair::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    decodeFrame(frame);
+
+    // VideoCapture always decodes to BGR; in grayscale mode, the colour
+    // conversion takes place of the copy
+    if (grayscale) {
+        cv::cvtColor(frameLeft, imageLeft, cv::COLOR_BGR2GRAY);
+        cv::cvtColor(frameRight, imageRight, cv::COLOR_BGR2GRAY);
+    } else {
+        frameLeft.copyTo(imageLeft);
+        frameRight.copyTo(imageRight);
+    }
+
+    return -1;
+}
+
+void SourceVideoPair::getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    // Decoded frames are usually still available; otherwise, seek and
+    // decode again
+    if (frame != lastFrame) {
+        decodeFrame(frame);
+    }
+
+    frameLeft.copyTo(imageLeft);
+    frameRight.copyTo(imageRight);
+}
+
+void SourceVideoPair::decodeFrame (int frame)
+{
+    // Invalidate decoded frames until both streams are decoded
+    lastFrame = -1;
+
+    // Decode right stream on the decoder thread, while left one is
+    // decoded on this one
+    if (syncTimestamp) {
+        // Grab the left frame first, so that the right stream can be
+        // synchronized to its actual timestamp (frames may be dropped or
+        // have variable duration, so the nominal frame rate cannot be
+        // relied upon); the tolerance is half of the nominal period
+        SourceVideo::grabFrame(captureLeft, frame);
+
+        double timestamp = captureLeft.get(cv::CAP_PROP_POS_MSEC);
+        double tolerance = 500.0 / captureLeft.get(cv::CAP_PROP_FPS);
+
+        decoderThread->submit([this, timestamp, tolerance] () {
+            readFrameAtTimestamp(captureRight, timestamp, tolerance, frameRight);
+        });
+
+        captureLeft.retrieve(frameLeft);
+    } else {
+        decoderThread->submit([this, frame] () {
+            SourceVideo::readFrame(captureRight, frame, frameRight);
+        });
+
+        try {
+            SourceVideo::readFrame(captureLeft, frame, frameLeft);
+        } catch (...) {
+            try {
+                decoderThread->waitForJob();
+            } catch (...) {
+            }
+            throw;
+        }
+    }
+
+    decoderThread->waitForJob(); // Re-throws the error, if any
+    lastFrame = frame;
+}
+
+QString SourceVideoPair::getFrameIdentity (int frame) const
+{
+    Q_UNUSED(frame)
+    return filesIdentity;
+}
+
+
+} // StereoProcessor
+} // MVL
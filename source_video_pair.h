@@ -0,0 +1,76 @@
+/*
+ * MVL Stereo Processor: input source: pair of video files
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__SOURCE_VIDEO_PAIR_H
+#define MVL_STEREO_PROCESSOR__SOURCE_VIDEO_PAIR_H
+
+#include "source.h"
+
+#include <opencv2/videoio.hpp>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Left and right image stored in separate video files, whose names are
+// obtained by substituting %{s} placeholder in the filename. The two
+// streams are decoded in parallel (the right one on a persistent decoder
+// thread), and synchronized either by frame index, or by timestamp (in
+// which case the right stream is advanced until its timestamp matches
+// the actual timestamp of the grabbed left frame, within half of the
+// nominal frame period).
+class SourceVideoPair : public Source
+{
+public:
+    SourceVideoPair (const QString &filename, bool syncTimestamp = false);
+    virtual ~SourceVideoPair ();
+
+    virtual qint64 getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual void getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+
+    virtual QString getFrameIdentity (int frame) const;
+
+protected:
+    // Decode both streams into frameLeft and frameRight
+    void decodeFrame (int frame);
+
+protected:
+    bool syncTimestamp;
+
+    class DecoderThread;
+    DecoderThread *decoderThread;
+
+    cv::VideoCapture captureLeft;
+    cv::VideoCapture captureRight;
+
+    // Size and modification time of both video files
+    QString filesIdentity;
+
+    cv::Mat frameLeft;
+    cv::Mat frameRight;
+    int lastFrame;
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
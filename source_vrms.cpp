@@ -18,46 +18,208 @@
  */
 
 #include "source_vrms.h"
+#include "debug.h"
+
+#include <opencv2/imgproc.hpp>
 
 namespace MVL {
 namespace StereoProcessor {
 
 
-SourceVrms::SourceVrms (const QString &filename)
+#ifdef ENABLE_VRMS
+class SourceVrms::OpenerThread : public QThread
+{
+public:
+    OpenerThread (SourceVrms *source)
+        : QThread(), source(source)
+    {
+    }
+
+protected:
+    virtual void run ()
+    {
+        source->openAdditionalReaders();
+    }
+
+protected:
+    SourceVrms *source;
+};
+
+// Returns the reader to the pool when leaving scope, also if decoding
+// throws
+class SourceVrms::ReaderLease
+{
+public:
+    ReaderLease (SourceVrms *source)
+        : source(source), reader(source->acquireReader())
+    {
+    }
+
+    ~ReaderLease ()
+    {
+        source->releaseReader(reader);
+    }
+
+    MVL::VRMS::Reader *operator-> () const
+    {
+        return reader;
+    }
+
+protected:
+    SourceVrms *source;
+    MVL::VRMS::Reader *reader;
+};
+#endif
+
+
+SourceVrms::SourceVrms (const QString &filename, int numReaders)
     : Source(filename)
+#ifdef ENABLE_VRMS
+      , openerThread(0),
+      numAdditionalReaders(0),
+      stopRequested(0)
+#endif
 {
 #ifdef ENABLE_VRMS
-    reader = new MVL::VRMS::Reader(this);
-    if (!reader->openFile(filename)) {
-        throw QString("Failed to open VRMS file '%1'").arg(filename);
+    // Open first reader immediately
+    MVL::VRMS::Reader *reader = openReader();
+    readers.append(reader);
+    idleReaders.append(reader);
+
+    // Open additional readers in background; each scans the file to
+    // build its own seek table
+    if (numReaders > 1) {
+        numAdditionalReaders = numReaders - 1;
+        openerThread = new OpenerThread(this);
+        openerThread->start();
     }
-    reader->buildSeekTable();
 #else
+    Q_UNUSED(numReaders)
     throw QString("VRMS support not enabled!");
 #endif
 }
 
 SourceVrms::~SourceVrms ()
 {
+#ifdef ENABLE_VRMS
+    // Stop opening additional readers; waits for the scan in progress,
+    // if any
+    if (openerThread) {
+        stopRequested.store(1);
+        openerThread->wait();
+        delete openerThread;
+    }
+
+    qDeleteAll(readers);
+#endif
 }
 
 
-void SourceVrms::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+#ifdef ENABLE_VRMS
+// *********************************************************************
+// *                            Reader pool                            *
+// *********************************************************************
+MVL::VRMS::Reader *SourceVrms::openReader ()
+{
+    MVL::VRMS::Reader *reader = new MVL::VRMS::Reader();
+    if (!reader->openFile(filename)) {
+        delete reader;
+        throw QString("Failed to open VRMS file '%1'").arg(filename);
+    }
+    reader->buildSeekTable();
+
+    return reader;
+}
+
+void SourceVrms::openAdditionalReaders ()
+{
+    for (int i = 0; i < numAdditionalReaders && !stopRequested.load(); i++) {
+        MVL::VRMS::Reader *reader;
+        try {
+            reader = openReader();
+        } catch (const QString &error) {
+            qCWarning(mvlStereoProcessor) << "Failed to open additional VRMS reader:" << qPrintable(error);
+            return;
+        }
+
+        QMutexLocker locker(&mutex);
+        readers.append(reader);
+        idleReaders.append(reader);
+        readerAvailable.wakeOne();
+
+        qCDebug(mvlStereoProcessor) << "Opened additional VRMS reader; total:" << readers.size();
+    }
+}
+
+MVL::VRMS::Reader *SourceVrms::acquireReader ()
+{
+    QMutexLocker locker(&mutex);
+    while (idleReaders.isEmpty()) {
+        readerAvailable.wait(&mutex);
+    }
+
+    return idleReaders.takeLast();
+}
+
+void SourceVrms::releaseReader (MVL::VRMS::Reader *reader)
+{
+    QMutexLocker locker(&mutex);
+    idleReaders.append(reader);
+    readerAvailable.wakeOne();
+}
+#endif
+
+
+// *********************************************************************
+// *                          Frame retrieval                          *
+// *********************************************************************
+qint64 SourceVrms::getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    readFrame(frame, imageLeft, imageRight, grayscale);
+    return -1;
+}
+
+void SourceVrms::getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    readFrame(frame, imageLeft, imageRight, false);
+}
+
+bool SourceVrms::supportsConcurrentAccess () const
+{
+    // Each request uses its own reader from the pool
+    return true;
+}
+
+void SourceVrms::readFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight, bool convertToGray)
 {
 #ifdef ENABLE_VRMS
-    // Seek to frame
-    try {
-        reader->setVideoPosition(frame);
-    } catch (const QString &error) {
-        throw QString("VRMS reader error: %1").arg(error);
+    {
+        ReaderLease reader(this);
+
+        // Seek to frame
+        try {
+            reader->setVideoPosition(frame);
+        } catch (const QString &error) {
+            throw QString("VRMS reader error: %1").arg(error);
+        }
+
+        // Get images
+        reader->getImages(imageLeft, imageRight);
     }
 
-    // Get images
-    reader->getImages(imageLeft, imageRight);
+    if (convertToGray) {
+        if (imageLeft.channels() == 3) {
+            cv::cvtColor(imageLeft, imageLeft, cv::COLOR_BGR2GRAY);
+        }
+        if (imageRight.channels() == 3) {
+            cv::cvtColor(imageRight, imageRight, cv::COLOR_BGR2GRAY);
+        }
+    }
 #else
     Q_UNUSED(frame)
     Q_UNUSED(imageLeft)
     Q_UNUSED(imageRight)
+    Q_UNUSED(convertToGray)
 #endif
 }
 
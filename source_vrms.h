@@ -31,17 +31,45 @@ namespace MVL {
 namespace StereoProcessor {
 
 
+// VRMS video file. A pool of independent readers is used, so that
+// several frames can be decoded concurrently; the first reader is
+// opened immediately, while the additional ones are opened (and their
+// seek tables built) in background. libvrms does not expose the seek
+// table, so each reader has to build its own.
 class SourceVrms : public Source
 {
 public:
-    SourceVrms (const QString &filename);
+    SourceVrms (const QString &filename, int numReaders = 1);
     virtual ~SourceVrms ();
 
-    virtual void getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual qint64 getFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+    virtual void getColorFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight);
+
+    virtual bool supportsConcurrentAccess () const;
 
 protected:
+    void readFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight, bool convertToGray);
+
 #ifdef ENABLE_VRMS
-    MVL::VRMS::Reader *reader;
+    MVL::VRMS::Reader *openReader ();
+    void openAdditionalReaders ();
+
+    MVL::VRMS::Reader *acquireReader ();
+    void releaseReader (MVL::VRMS::Reader *reader);
+
+    // Reader, held for the duration of a request
+    class ReaderLease;
+
+    QMutex mutex;
+    QWaitCondition readerAvailable;
+
+    QList<MVL::VRMS::Reader *> readers;
+    QList<MVL::VRMS::Reader *> idleReaders;
+
+    class OpenerThread;
+    OpenerThread *openerThread;
+    int numAdditionalReaders;
+    QAtomicInt stopRequested;
 #endif
 };
 
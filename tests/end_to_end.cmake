@@ -0,0 +1,277 @@
+# End-to-end test of the processor; run in script mode (cmake -P) with
+# following variables:
+#  - PROCESSOR: processor executable
+#  - GENERATOR: synthetic input generator executable
+#  - VERIFIER: output verification executable
+#  - NAME: test name (used for golden checksums and baseline)
+#  - INPUT: input type; image (image sequence) or video (side-by-side)
+#  - KIND: output kind; frames, rectified, disparity, points, depth or
+#    stats
+#  - WORK_DIR: working directory (recreated)
+#  - NUM_FRAMES: number of frames of synthetic input
+#  - CALIBRATION, METHOD: optional stereo calibration and stereo method
+#    configuration, used instead of the generated ones
+#  - GROUND_TRUTH: ground truth of the synthetic scene (see
+#    verify_output.cpp)
+#  - GOLDEN: directory with golden checksums (<NAME>.sha256)
+#  - BASELINE: file with baseline frame rates (<NAME> <fps> per line)
+#  - TOLERANCE: allowed drop of frame rate below baseline, in percent
+#  - OPENCV_VERSION: OpenCV version of the build
+#  - UPDATE: store golden checksums and baseline instead of comparing
+#
+# The processor is run twice, and the outputs of both runs must exist
+# and be identical (statistics files are compared line-wise, as rows are
+# appended in order of completion), and must match the ground truth of
+# the scene. Checksums of the outputs are stored in
+# <WORK_DIR>/checksums.sha256, and the frame rate and wall time (in
+# whole seconds) of the first run in <WORK_DIR>/timing.txt.
+#
+# Golden checksums and baseline record the OpenCV version they were
+# generated with (as "# OpenCV <version>" first line), and are compared
+# only with a build using the same version, as encoders (and thus the
+# outputs) change between versions. Ground truth, golden checksums and
+# baseline apply only to the generated stereo calibration and method
+# configuration.
+
+# *** Synthetic input ***
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR}/input/images)
+
+execute_process(COMMAND ${GENERATOR} ${WORK_DIR}/input ${NUM_FRAMES}
+    RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "Failed to generate synthetic input!")
+endif ()
+
+# Ground truth and golden data apply to generated configuration only
+set(generated_config TRUE)
+if (CALIBRATION OR METHOD)
+    set(generated_config FALSE)
+endif ()
+
+if (NOT CALIBRATION)
+    set(CALIBRATION ${WORK_DIR}/input/calibration.yml)
+endif ()
+if (NOT METHOD)
+    set(METHOD ${WORK_DIR}/input/method.yml)
+endif ()
+
+if (INPUT STREQUAL "image")
+    set(input_file "${WORK_DIR}/input/images/%{f}%{s}.png")
+elseif (INPUT STREQUAL "video")
+    set(input_file "${WORK_DIR}/input/video.avi")
+else ()
+    message(FATAL_ERROR "Invalid input type: '${INPUT}'")
+endif ()
+
+# *** Outputs ***
+# Options are given relative to the output directory of each run (@OUT@),
+# together with the expected number of output files
+set(calibration_options --stereo-calibration=${CALIBRATION})
+set(method_options ${calibration_options} --stereo-method=${METHOD})
+
+if (KIND STREQUAL "frames")
+    set(options --output-frames=@OUT@/frames/%{f}%{s}.png)
+    math(EXPR num_expected "2 * ${NUM_FRAMES}")
+elseif (KIND STREQUAL "rectified")
+    set(options ${calibration_options} --output-rectified=@OUT@/rectified/%{f}%{s}.png)
+    math(EXPR num_expected "2 * ${NUM_FRAMES}")
+elseif (KIND STREQUAL "disparity")
+    set(options ${method_options}
+        --output-disparity=@OUT@/disparity/%{f}.png
+        --output-disparity=@OUT@/disparity/%{f}.yml
+        --output-disparity=@OUT@/disparity/%{f}.bin)
+    math(EXPR num_expected "3 * ${NUM_FRAMES}")
+elseif (KIND STREQUAL "points")
+    set(options ${method_options}
+        --output-points=@OUT@/points/%{f}.yml
+        --output-points=@OUT@/points/%{f}.bin
+        --output-points=@OUT@/points/%{f}.pcd)
+    math(EXPR num_expected "3 * ${NUM_FRAMES}")
+elseif (KIND STREQUAL "depth")
+    set(options ${method_options}
+        --output-depth=@OUT@/depth/%{f}.tif
+        --output-depth=@OUT@/depth/%{f}.yml)
+    math(EXPR num_expected "2 * ${NUM_FRAMES}")
+elseif (KIND STREQUAL "stats")
+    set(options ${method_options}
+        --output-stats=@OUT@/stats.csv
+        --output-stats=@OUT@/stats.jsonl)
+    set(num_expected 2)
+else ()
+    message(FATAL_ERROR "Invalid output kind: '${KIND}'")
+endif ()
+
+
+# *********************************************************************
+# *                             Functions                             *
+# *********************************************************************
+# Run the processor with outputs into given directory; the final progress
+# report (Prometheus format) is written next to it
+function(run_processor run)
+    string(REPLACE "@OUT@" "${WORK_DIR}/${run}" run_options "${options}")
+
+    string(TIMESTAMP start "%s")
+    execute_process(COMMAND ${PROCESSOR} ${input_file} ${run_options} --progress-prometheus=${WORK_DIR}/${run}.prom
+        RESULT_VARIABLE result
+        OUTPUT_VARIABLE log
+        ERROR_VARIABLE log)
+    string(TIMESTAMP end "%s")
+
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Processor failed (${result}):\n${log}")
+    endif ()
+
+    math(EXPR wall_time "${end} - ${start}")
+    set(wall_time ${wall_time} PARENT_SCOPE)
+endfunction()
+
+# Compute checksums of all files in given directory, one "<sha256>  <path>"
+# line per file; statistics files are checksummed with sorted lines
+function(compute_checksums directory result_checksums result_count)
+    file(GLOB_RECURSE files RELATIVE ${directory} ${directory}/*)
+    list(SORT files)
+
+    set(checksums "")
+    foreach (file ${files})
+        if (file MATCHES "\\.(csv|jsonl)$")
+            file(STRINGS ${directory}/${file} lines)
+            list(SORT lines)
+            string(SHA256 checksum "${lines}")
+        else ()
+            file(SHA256 ${directory}/${file} checksum)
+        endif ()
+        set(checksums "${checksums}${checksum}  ${file}\n")
+    endforeach ()
+
+    list(LENGTH files count)
+    set(${result_checksums} "${checksums}" PARENT_SCOPE)
+    set(${result_count} ${count} PARENT_SCOPE)
+endfunction()
+
+# Convert decimal number (as written by the progress reporter) to integer
+# thousandths, as CMake has integer arithmetic only
+function(to_milli value result)
+    if (NOT value MATCHES "^([0-9]+)(\\.([0-9]*))?$")
+        message(FATAL_ERROR "Cannot parse number: '${value}'")
+    endif ()
+    set(integer ${CMAKE_MATCH_1})
+    string(SUBSTRING "${CMAKE_MATCH_3}000" 0 3 fraction)
+    math(EXPR milli "${integer} * 1000 + ${fraction}")
+    set(${result} ${milli} PARENT_SCOPE)
+endfunction()
+
+
+# *********************************************************************
+# *                               Runs                                *
+# *********************************************************************
+run_processor(run1)
+set(run1_wall_time ${wall_time})
+run_processor(run2)
+
+compute_checksums(${WORK_DIR}/run1 checksums1 count1)
+compute_checksums(${WORK_DIR}/run2 checksums2 count2)
+
+file(WRITE ${WORK_DIR}/checksums.sha256 "${checksums1}")
+
+# Outputs exist...
+if (NOT count1 EQUAL num_expected)
+    message(FATAL_ERROR "Expected ${num_expected} output files, found ${count1}:\n${checksums1}")
+endif ()
+
+# ... and are deterministic
+if (NOT checksums1 STREQUAL checksums2)
+    message(FATAL_ERROR "Outputs of two runs differ!\nFirst run:\n${checksums1}\nSecond run:\n${checksums2}")
+endif ()
+
+# ... and match the ground truth of the scene
+if (GROUND_TRUTH AND (generated_config OR KIND STREQUAL "frames"))
+    execute_process(COMMAND ${VERIFIER} ${KIND} ${INPUT} ${WORK_DIR}/input ${WORK_DIR}/run1 ${NUM_FRAMES} ${GROUND_TRUTH}
+        RESULT_VARIABLE result
+        OUTPUT_VARIABLE log
+        ERROR_VARIABLE log)
+    if (NOT result EQUAL 0)
+        message(FATAL_ERROR "Outputs do not match ground truth in ${GROUND_TRUTH}:\n${log}")
+    endif ()
+endif ()
+
+set(version_line "# OpenCV ${OPENCV_VERSION}")
+
+# ... and match golden checksums, if available for this OpenCV version
+set(golden_file ${GOLDEN}/${NAME}.sha256)
+if (GOLDEN AND generated_config)
+    if (UPDATE)
+        file(WRITE ${golden_file} "${version_line}\n${checksums1}")
+        message(STATUS "Stored golden checksums into ${golden_file}")
+    elseif (EXISTS ${golden_file})
+        file(READ ${golden_file} golden)
+        string(FIND "${golden}" "\n" end_of_line)
+        string(SUBSTRING "${golden}" 0 ${end_of_line} golden_version)
+        math(EXPR end_of_line "${end_of_line} + 1")
+        string(SUBSTRING "${golden}" ${end_of_line} -1 golden)
+        if (NOT golden_version STREQUAL version_line)
+            message(STATUS "Golden checksums in ${golden_file} were generated with different OpenCV version ('${golden_version}'); skipping comparison")
+        elseif (NOT checksums1 STREQUAL golden)
+            message(FATAL_ERROR "Outputs differ from golden checksums in ${golden_file}!\nOutputs:\n${checksums1}")
+        endif ()
+    else ()
+        message(STATUS "No golden checksums for ${NAME}; skipping comparison")
+    endif ()
+endif ()
+
+
+# *********************************************************************
+# *                            Throughput                             *
+# *********************************************************************
+# Average frame rate of the first run, from its final progress report
+file(STRINGS ${WORK_DIR}/run1.prom fps_line REGEX "^mvl_stereo_processor_fps_average ")
+if (NOT fps_line MATCHES " ([0-9.]+)$")
+    message(FATAL_ERROR "Failed to parse frame rate from progress report!")
+endif ()
+set(fps ${CMAKE_MATCH_1})
+
+message(STATUS "${NAME}: ${NUM_FRAMES} frames, wall time ${run1_wall_time} s, ${fps} fps")
+file(WRITE ${WORK_DIR}/timing.txt "${NAME} ${fps} ${run1_wall_time}\n")
+
+if (BASELINE AND generated_config)
+    # Tests may run concurrently, and share the baseline file; the lock
+    # file is kept in the build directory
+    get_filename_component(lock_file ${WORK_DIR}/../baseline.lock ABSOLUTE)
+    if (UPDATE)
+        file(LOCK ${lock_file} GUARD PROCESS)
+        set(lines "${version_line}")
+        if (EXISTS ${BASELINE})
+            file(STRINGS ${BASELINE} previous_lines)
+            foreach (line ${previous_lines})
+                if (NOT line MATCHES "^(# OpenCV |${NAME} )")
+                    list(APPEND lines "${line}")
+                endif ()
+            endforeach ()
+        endif ()
+        list(APPEND lines "${NAME} ${fps}")
+        string(REPLACE ";" "\n" lines "${lines}")
+        file(WRITE ${BASELINE} "${lines}\n")
+        file(LOCK ${lock_file} RELEASE)
+        message(STATUS "Stored baseline of ${NAME} into ${BASELINE}")
+    elseif (EXISTS ${BASELINE})
+        file(STRINGS ${BASELINE} baseline_version LIMIT_COUNT 1)
+        file(STRINGS ${BASELINE} baseline_line REGEX "^${NAME} ")
+        if (NOT baseline_version STREQUAL version_line)
+            message(STATUS "Baseline in ${BASELINE} was generated with different OpenCV version ('${baseline_version}'); skipping comparison")
+        elseif (baseline_line MATCHES "^${NAME} ([0-9.]+)")
+            set(baseline_fps ${CMAKE_MATCH_1})
+
+            to_milli(${fps} fps_milli)
+            to_milli(${baseline_fps} baseline_milli)
+            math(EXPR lhs "${fps_milli} * 100")
+            math(EXPR rhs "${baseline_milli} * (100 - ${TOLERANCE})")
+            if (lhs LESS rhs)
+                message(FATAL_ERROR "Frame rate ${fps} fps is more than ${TOLERANCE}% below baseline of ${baseline_fps} fps!")
+            endif ()
+        else ()
+            message(STATUS "No baseline for ${NAME}; skipping comparison")
+        endif ()
+    else ()
+        message(STATUS "No baseline file ${BASELINE}; skipping comparison")
+    endif ()
+endif ()
@@ -0,0 +1,141 @@
+/*
+ * MVL Stereo Processor: synthetic input for end-to-end tests
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+
+// Generates a deterministic synthetic stereo sequence into given
+// directory (which, along with its images subdirectory, must exist):
+//  - images/<frame>L.png, images/<frame>R.png: image sequence
+//  - video.avi: the same frames as a side-by-side video
+//  - calibration.yml: stereo calibration of an ideal, already rectified
+//    camera pair
+//  - method.yml: block matching stereo method configuration
+//
+// The scene is a fronto-parallel plane with random blob texture at a
+// constant disparity; it moves vertically by one pixel per frame, so
+// that consecutive frames differ.
+static const int imageWidth = 320;
+static const int imageHeight = 240;
+static const int sceneDisparity = 16;
+static const int blobSize = 3;
+
+
+static void writeCalibration (const std::string &filename)
+{
+    double focalLength = imageWidth;
+    double baseline = 0.1;
+
+    cv::Mat M = (cv::Mat_<double>(3, 3) << focalLength, 0, imageWidth / 2.0, 0, focalLength, imageHeight / 2.0, 0, 0, 1);
+    cv::Mat D = cv::Mat::zeros(1, 5, CV_64F);
+    cv::Mat R = cv::Mat::eye(3, 3, CV_64F);
+    cv::Mat T = (cv::Mat_<double>(3, 1) << -baseline, 0, 0);
+
+    // Essential and fundamental matrix, for completeness
+    cv::Mat Tx = (cv::Mat_<double>(3, 3) << 0, -T.at<double>(2), T.at<double>(1), T.at<double>(2), 0, -T.at<double>(0), -T.at<double>(1), T.at<double>(0), 0);
+    cv::Mat E = Tx * R;
+    cv::Mat F = M.inv().t() * E * M.inv();
+
+    cv::FileStorage storage(filename, cv::FileStorage::WRITE);
+    storage << "imageSize" << cv::Size(imageWidth, imageHeight);
+    storage << "M1" << M;
+    storage << "D1" << D;
+    storage << "M2" << M;
+    storage << "D2" << D;
+    storage << "R" << R;
+    storage << "T" << T;
+    storage << "E" << E;
+    storage << "F" << F;
+}
+
+static void writeMethod (const std::string &filename)
+{
+    cv::FileStorage storage(filename, cv::FileStorage::WRITE);
+    storage << "DataType" << "StereoMethodParameters";
+    storage << "MethodName" << "OpenCV_BM";
+    storage << "PreFilterType" << 1;
+    storage << "PreFilterSize" << 9;
+    storage << "PreFilterCap" << 31;
+    storage << "SADWindowSize" << 9;
+    storage << "MinDisparity" << 0;
+    storage << "NumDisparities" << 32;
+    storage << "TextureThreshold" << 10;
+    storage << "UniquenessRatio" << 15;
+    storage << "SpeckleWindowSize" << 0;
+    storage << "SpeckleRange" << 0;
+    storage << "Disp12MaxDiff" << -1;
+}
+
+
+int main (int argc, char **argv)
+{
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <output-directory> <num-frames>" << std::endl;
+        return -1;
+    }
+
+    std::string directory = argv[1];
+    int numFrames = std::atoi(argv[2]);
+    if (numFrames <= 0) {
+        std::cerr << "Invalid number of frames: '" << argv[2] << "'" << std::endl;
+        return -1;
+    }
+
+    // Texture covers all frames; cv::RNG is deterministic across
+    // platforms and OpenCV versions
+    cv::Mat blobs((imageHeight + numFrames) / blobSize + 1, (imageWidth + sceneDisparity) / blobSize + 1, CV_8UC3);
+    cv::RNG rng(0x5eed);
+    rng.fill(blobs, cv::RNG::UNIFORM, cv::Scalar::all(0), cv::Scalar::all(256));
+
+    cv::Mat texture;
+    cv::resize(blobs, texture, cv::Size(), blobSize, blobSize, cv::INTER_NEAREST);
+
+    cv::VideoWriter video(directory + "/video.avi", cv::VideoWriter::fourcc('M', 'J', 'P', 'G'), 25, cv::Size(2*imageWidth, imageHeight));
+    if (!video.isOpened()) {
+        std::cerr << "Failed to open video writer!" << std::endl;
+        return -1;
+    }
+
+    for (int frame = 0; frame < numFrames; frame++) {
+        cv::Mat imageLeft = texture(cv::Rect(0, frame, imageWidth, imageHeight));
+        cv::Mat imageRight = texture(cv::Rect(sceneDisparity, frame, imageWidth, imageHeight));
+
+        if (!cv::imwrite(directory + "/images/" + std::to_string(frame) + "L.png", imageLeft) ||
+            !cv::imwrite(directory + "/images/" + std::to_string(frame) + "R.png", imageRight)) {
+            std::cerr << "Failed to write images of frame " << frame << "!" << std::endl;
+            return -1;
+        }
+
+        cv::Mat sideBySide;
+        cv::hconcat(imageLeft, imageRight, sideBySide);
+        video << sideBySide;
+    }
+
+    writeCalibration(directory + "/calibration.yml");
+    writeMethod(directory + "/method.yml");
+
+    return 0;
+}
@@ -0,0 +1,464 @@
+/*
+ * MVL Stereo Processor: end-to-end tests: output verification
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Verifies outputs of a processor run on the synthetic input (see
+// generate_input.cpp) against the ground truth of the scene, which does
+// not depend on OpenCV version or codecs:
+//  - frames: identical to the input frames
+//  - rectified: match the input frames (the cameras are ideal and
+//    already rectified), up to interpolation
+//  - disparity, depth, points, stats: median disparity and depth of
+//    the plane, and the ratio of valid pixels
+//
+// Expected values and tolerances are read from the ground truth file,
+// as "key value" lines ('#' starts a comment).
+typedef std::map<std::string, double> GroundTruth;
+
+static std::string inputType;
+static std::string inputDirectory;
+static std::string outputDirectory;
+static int numFrames;
+static GroundTruth groundTruth;
+static int numFailures = 0;
+
+
+static void fail (const std::string &message)
+{
+    std::cerr << "FAILED: " << message << std::endl;
+    numFailures++;
+}
+
+static double expected (const std::string &key)
+{
+    GroundTruth::const_iterator it = groundTruth.find(key);
+    if (it == groundTruth.end()) {
+        std::cerr << "Missing ground truth value: '" << key << "'" << std::endl;
+        std::exit(-1);
+    }
+    return it->second;
+}
+
+static bool readGroundTruth (const std::string &filename)
+{
+    std::ifstream file(filename.c_str());
+    if (!file) {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+
+        std::istringstream stream(line);
+        std::string key;
+        double value;
+        if (stream >> key >> value) {
+            groundTruth[key] = value;
+        }
+    }
+
+    return true;
+}
+
+
+// *********************************************************************
+// *                              Helpers                              *
+// *********************************************************************
+// Input frame, as read by the processor
+static void readInputFrame (int frame, cv::Mat &imageLeft, cv::Mat &imageRight)
+{
+    if (inputType == "image") {
+        imageLeft = cv::imread(inputDirectory + "/images/" + std::to_string(frame) + "L.png", cv::IMREAD_UNCHANGED);
+        imageRight = cv::imread(inputDirectory + "/images/" + std::to_string(frame) + "R.png", cv::IMREAD_UNCHANGED);
+        return;
+    }
+
+    // Video is decoded sequentially up to the frame; the same decoder
+    // is used by the processor, so lossy compression does not matter
+    static cv::VideoCapture video;
+    static int nextFrame = 0;
+    static cv::Mat image;
+
+    if (!video.isOpened() || frame < nextFrame) {
+        video.open(inputDirectory + "/video.avi");
+        nextFrame = 0;
+    }
+    while (nextFrame <= frame) {
+        if (!video.read(image)) {
+            image.release();
+            break;
+        }
+        nextFrame++;
+    }
+
+    if (image.empty()) {
+        imageLeft.release();
+        imageRight.release();
+        return;
+    }
+
+    imageLeft = image(cv::Rect(0, 0, image.cols/2, image.rows)).clone();
+    imageRight = image(cv::Rect(image.cols/2, 0, image.cols/2, image.rows)).clone();
+}
+
+static cv::Mat toGray (const cv::Mat &image)
+{
+    cv::Mat gray;
+    if (image.channels() == 3) {
+        cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = image;
+    }
+    return gray;
+}
+
+// Central part of the image; excludes the border, in which block
+// matching has no valid disparities (left border, up to the number of
+// disparities) and rectification may interpolate from outside
+static cv::Rect getCentralRegion (const cv::Size &size)
+{
+    int border = size.height / 10;
+    int left = std::max(border, 2*static_cast<int>(expected("disparity")) + border);
+    return cv::Rect(left, border, size.width - left - border, size.height - 2*border);
+}
+
+// Median of finite, positive values within the central region; also
+// returns the ratio of such values
+static double computeMedian (const cv::Mat &values, double &validRatio)
+{
+    cv::Mat region = values(getCentralRegion(values.size()));
+    std::vector<float> valid;
+
+    for (int y = 0; y < region.rows; y++) {
+        const float *row = region.ptr<float>(y);
+        for (int x = 0; x < region.cols; x++) {
+            if (std::isfinite(row[x]) && row[x] > 0) {
+                valid.push_back(row[x]);
+            }
+        }
+    }
+
+    validRatio = static_cast<double>(valid.size()) / region.total();
+    if (valid.empty()) {
+        return std::nan("");
+    }
+
+    std::nth_element(valid.begin(), valid.begin() + valid.size()/2, valid.end());
+    return valid[valid.size()/2];
+}
+
+static void checkMedian (const std::string &name, const cv::Mat &values, const std::string &key)
+{
+    double validRatio;
+    double median = computeMedian(values, validRatio);
+
+    if (validRatio < expected("valid_ratio")) {
+        fail(name + ": valid ratio " + std::to_string(validRatio) + " below " + std::to_string(expected("valid_ratio")));
+    }
+    if (!(std::fabs(median - expected(key)) <= expected(key + "_tolerance"))) {
+        fail(name + ": median " + key + " " + std::to_string(median) + ", expected " + std::to_string(expected(key)));
+    }
+}
+
+static cv::Mat readStorageMatrix (const std::string &filename, const std::string &node)
+{
+    cv::Mat matrix;
+    try {
+        cv::FileStorage storage(filename, cv::FileStorage::READ);
+        storage[node] >> matrix;
+    } catch (const cv::Exception &) {
+        matrix.release();
+    }
+    return matrix;
+}
+
+static bool isNonEmptyFile (const std::string &filename)
+{
+    std::ifstream file(filename.c_str(), std::ios::binary | std::ios::ate);
+    return file && file.tellg() > 0;
+}
+
+
+// *********************************************************************
+// *                              Checks                               *
+// *********************************************************************
+static void verifyFrames ()
+{
+    for (int frame = 0; frame < numFrames; frame++) {
+        cv::Mat input[2];
+        readInputFrame(frame, input[0], input[1]);
+
+        for (int side = 0; side < 2; side++) {
+            std::string filename = outputDirectory + "/frames/" + std::to_string(frame) + (side ? "R" : "L") + ".png";
+            cv::Mat output = cv::imread(filename, cv::IMREAD_UNCHANGED);
+
+            if (output.empty() || input[side].empty() || output.size() != input[side].size() || output.type() != input[side].type()) {
+                fail(filename + ": missing, or size/type differs from input");
+            } else if (cv::norm(output, input[side], cv::NORM_INF) > expected("frames_difference")) {
+                fail(filename + ": differs from input");
+            }
+        }
+    }
+}
+
+static void verifyRectified ()
+{
+    for (int frame = 0; frame < numFrames; frame++) {
+        cv::Mat input[2];
+        readInputFrame(frame, input[0], input[1]);
+
+        for (int side = 0; side < 2; side++) {
+            std::string filename = outputDirectory + "/rectified/" + std::to_string(frame) + (side ? "R" : "L") + ".png";
+            cv::Mat output = cv::imread(filename, cv::IMREAD_UNCHANGED);
+
+            if (output.empty() || input[side].empty() || output.size() != input[side].size()) {
+                fail(filename + ": missing, or size differs from input");
+                continue;
+            }
+
+            cv::Rect region = getCentralRegion(output.size());
+            cv::Mat difference;
+            cv::absdiff(toGray(output)(region), toGray(input[side])(region), difference);
+
+            double meanDifference = cv::mean(difference)[0];
+            if (meanDifference > expected("rectified_difference")) {
+                fail(filename + ": mean difference from input " + std::to_string(meanDifference));
+            }
+        }
+    }
+}
+
+static void verifyDisparity ()
+{
+    for (int frame = 0; frame < numFrames; frame++) {
+        std::string base = outputDirectory + "/disparity/" + std::to_string(frame);
+
+        // Fixed-point disparity (as computed by block matching) has four
+        // fractional bits
+        cv::Mat disparity = readStorageMatrix(base + ".yml", "disparity");
+        if (disparity.empty()) {
+            fail(base + ".yml: missing or unreadable");
+        } else {
+            disparity.convertTo(disparity, CV_32F, disparity.type() == CV_16SC1 ? 1.0/16 : 1.0);
+            checkMedian(base + ".yml", disparity, "disparity");
+        }
+
+        cv::Mat visualization = cv::imread(base + ".png");
+        if (visualization.empty() || (!disparity.empty() && visualization.size() != disparity.size())) {
+            fail(base + ".png: missing, or size differs from disparity");
+        }
+
+        if (!isNonEmptyFile(base + ".bin")) {
+            fail(base + ".bin: missing or empty");
+        }
+    }
+}
+
+static void verifyDepth ()
+{
+    for (int frame = 0; frame < numFrames; frame++) {
+        std::string base = outputDirectory + "/depth/" + std::to_string(frame);
+
+        cv::Mat depth = readStorageMatrix(base + ".yml", "depth");
+        if (depth.empty() || depth.type() != CV_32FC1) {
+            fail(base + ".yml: missing, unreadable or not floating-point");
+        } else {
+            checkMedian(base + ".yml", depth, "depth");
+        }
+
+        cv::Mat image = cv::imread(base + ".tif", cv::IMREAD_UNCHANGED);
+        if (image.empty() || image.type() != CV_32FC1) {
+            fail(base + ".tif: missing, unreadable or not floating-point");
+        } else {
+            checkMedian(base + ".tif", image, "depth");
+        }
+    }
+}
+
+static void verifyPoints ()
+{
+    for (int frame = 0; frame < numFrames; frame++) {
+        std::string base = outputDirectory + "/points/" + std::to_string(frame);
+
+        cv::Mat points = readStorageMatrix(base + ".yml", "points");
+        if (points.empty() || points.type() != CV_32FC3) {
+            fail(base + ".yml: missing, unreadable or not 3-channel floating-point");
+        } else {
+            cv::Mat channels[3];
+            cv::split(points, channels);
+            checkMedian(base + ".yml", channels[2], "depth");
+        }
+
+        // Organized point cloud; one point per pixel
+        std::ifstream pcd((base + ".pcd").c_str(), std::ios::binary);
+        std::string line;
+        long long numPoints = -1;
+        while (std::getline(pcd, line) && line.compare(0, 4, "DATA") != 0) {
+            if (line.compare(0, 7, "POINTS ") == 0) {
+                numPoints = std::atoll(line.c_str() + 7);
+            }
+        }
+        if (!pcd || (!points.empty() && numPoints != static_cast<long long>(points.total()))) {
+            fail(base + ".pcd: missing, or number of points differs from point cloud");
+        }
+
+        if (!isNonEmptyFile(base + ".bin")) {
+            fail(base + ".bin: missing or empty");
+        }
+    }
+}
+
+// Values of given column of a CSV file (quoted fields contain no commas)
+static std::vector<std::string> readCsvColumn (const std::string &filename, const std::string &column)
+{
+    std::ifstream file(filename.c_str());
+    std::vector<std::string> values;
+    std::string line;
+    int index = -1;
+
+    while (std::getline(file, line)) {
+        std::vector<std::string> fields;
+        std::istringstream stream(line);
+        std::string field;
+        while (std::getline(stream, field, ',')) {
+            fields.push_back(field);
+        }
+
+        if (index < 0) {
+            index = static_cast<int>(std::find(fields.begin(), fields.end(), column) - fields.begin());
+            if (index == static_cast<int>(fields.size())) {
+                return values;
+            }
+        } else if (index < static_cast<int>(fields.size())) {
+            values.push_back(fields[index]);
+        } else {
+            values.push_back(std::string());
+        }
+    }
+
+    return values;
+}
+
+// Values of given key of a JSON-lines file (numbers only)
+static std::vector<std::string> readJsonColumn (const std::string &filename, const std::string &key)
+{
+    std::ifstream file(filename.c_str());
+    std::vector<std::string> values;
+    std::string line;
+    std::string pattern = "\"" + key + "\":";
+
+    while (std::getline(file, line)) {
+        size_t position = line.find(pattern);
+        if (position == std::string::npos) {
+            values.push_back(std::string());
+            continue;
+        }
+        position += pattern.size();
+        values.push_back(line.substr(position, line.find_first_of(",}", position) - position));
+    }
+
+    return values;
+}
+
+static void checkValues (const std::string &name, const std::vector<std::string> &values, const std::string &key)
+{
+    if (static_cast<int>(values.size()) != numFrames) {
+        fail(name + ": " + std::to_string(values.size()) + " rows, expected " + std::to_string(numFrames));
+        return;
+    }
+
+    for (const std::string &value : values) {
+        char *end;
+        double number = std::strtod(value.c_str(), &end);
+        if (value.empty() || *end || !(std::fabs(number - expected(key)) <= expected(key + "_tolerance"))) {
+            fail(name + ": " + key + " '" + value + "', expected " + std::to_string(expected(key)));
+        }
+    }
+}
+
+static void verifyStats ()
+{
+    std::string csv = outputDirectory + "/stats.csv";
+    checkValues(csv, readCsvColumn(csv, "median_disparity"), "disparity");
+    checkValues(csv, readCsvColumn(csv, "median_depth"), "depth");
+
+    std::string jsonl = outputDirectory + "/stats.jsonl";
+    checkValues(jsonl, readJsonColumn(jsonl, "median_disparity"), "disparity");
+    checkValues(jsonl, readJsonColumn(jsonl, "median_depth"), "depth");
+}
+
+
+int main (int argc, char **argv)
+{
+    if (argc != 7) {
+        std::cerr << "Usage: " << argv[0] << " <kind> <input-type> <input-directory> <output-directory> <num-frames> <ground-truth-file>" << std::endl;
+        return -1;
+    }
+
+    std::string kind = argv[1];
+    inputType = argv[2];
+    inputDirectory = argv[3];
+    outputDirectory = argv[4];
+    numFrames = std::atoi(argv[5]);
+
+    if (!readGroundTruth(argv[6])) {
+        std::cerr << "Failed to read ground truth file '" << argv[6] << "'" << std::endl;
+        return -1;
+    }
+
+    if (kind == "frames") {
+        verifyFrames();
+    } else if (kind == "rectified") {
+        verifyRectified();
+    } else if (kind == "disparity") {
+        verifyDisparity();
+    } else if (kind == "points") {
+        verifyPoints();
+    } else if (kind == "depth") {
+        verifyDepth();
+    } else if (kind == "stats") {
+        verifyStats();
+    } else {
+        std::cerr << "Invalid output kind: '" << kind << "'" << std::endl;
+        return -1;
+    }
+
+    if (numFailures) {
+        std::cerr << numFailures << " check(s) failed" << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
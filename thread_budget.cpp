@@ -0,0 +1,314 @@
+/*
+ * MVL Stereo Processor: thread budget
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "thread_budget.h"
+#include "debug.h"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+ThreadBudget::ThreadBudget ()
+    : numJobs(1)
+{
+    for (int i = 0; i < NumStages; i++) {
+        threadPools[i] = 0;
+    }
+
+    configure(0, QString(), false);
+}
+
+ThreadBudget::~ThreadBudget ()
+{
+    for (int i = 0; i < NumStages; i++) {
+        if (threadPools[i]) {
+            threadPools[i]->waitForDone();
+            delete threadPools[i];
+        }
+    }
+}
+
+
+// *********************************************************************
+// *                           Configuration                           *
+// *********************************************************************
+void ThreadBudget::configure (int totalThreads, const QString &stageAssignment, bool pinThreads)
+{
+    if (totalThreads <= 0) {
+        totalThreads = QThread::idealThreadCount();
+    }
+
+    // Default distribution: decoding and writing get a small share, and
+    // the remaining threads are used by the compute stages. Rectification
+    // and stereo method run one after another, so they share the same
+    // threads
+    numThreads[StageDecode] = totalThreads >= 8 ? 2 : 1;
+    numThreads[StageWrite] = std::max(1, totalThreads / 8);
+    numThreads[StageRectify] = std::max(1, totalThreads - numThreads[StageDecode] - numThreads[StageWrite]);
+    numThreads[StageMethod] = numThreads[StageRectify];
+
+    for (int i = 0; i < NumStages; i++) {
+        cores[i].clear();
+    }
+
+    // Explicit assignment
+    bool explicitCores[NumStages] = { false };
+
+    // CPU lists contain commas themselves, so tokens without a stage
+    // name are appended to the preceding one
+    QStringList tokens;
+    for (const QString &token : stageAssignment.split(",", QString::SkipEmptyParts)) {
+        if (!token.contains('=') && !tokens.isEmpty()) {
+            tokens.last() += "," + token;
+        } else {
+            tokens.append(token);
+        }
+    }
+
+    for (const QString &token : tokens) {
+        int stage = -1;
+        QString name = token.section('=', 0, 0).trimmed();
+        for (int i = 0; i < NumStages; i++) {
+            if (name == getStageName(static_cast<Stage>(i))) {
+                stage = i;
+            }
+        }
+        if (stage < 0) {
+            throw QString("Invalid stage in thread assignment: '%1'").arg(token);
+        }
+
+        QString value = token.section('=', 1);
+        QString count = value.section('@', 0, 0);
+        QString cpus = value.section('@', 1);
+
+        bool ok;
+        numThreads[stage] = count.toInt(&ok);
+        if (!ok || numThreads[stage] < 1) {
+            throw QString("Invalid thread count in thread assignment: '%1'").arg(token);
+        }
+
+        if (!cpus.isEmpty()) {
+            if (cpus.startsWith("node")) {
+                int node = cpus.mid(4).toInt(&ok);
+                if (!ok) {
+                    throw QString("Invalid NUMA node in thread assignment: '%1'").arg(token);
+                }
+                cores[stage] = getNumaNodeCpus(node);
+            } else {
+                cores[stage] = parseCpuList(cpus);
+            }
+            explicitCores[stage] = true;
+        }
+    }
+
+    // Automatic pinning to consecutive blocks of cores; compute stages
+    // share the same block
+    if (pinThreads) {
+        int numCores = QThread::idealThreadCount();
+        int core = 0;
+
+        for (int i = 0; i < NumStages; i++) {
+            if (explicitCores[i]) {
+                continue;
+            }
+
+            if (i == StageMethod && !explicitCores[StageRectify]) {
+                cores[i] = cores[StageRectify];
+                continue;
+            }
+
+            int count = numThreads[i];
+            if (i == StageRectify) {
+                count = std::max(numThreads[StageRectify], numThreads[StageMethod]);
+            }
+
+            for (int j = 0; j < count; j++) {
+                cores[i].append(core++ % numCores);
+            }
+        }
+    }
+
+    // Resize existing thread pools
+    for (int i = 0; i < NumStages; i++) {
+        if (threadPools[i]) {
+            threadPools[i]->setMaxThreadCount(numThreads[i]);
+        }
+    }
+}
+
+
+int ThreadBudget::getNumThreads (Stage stage) const
+{
+    return numThreads[stage];
+}
+
+const QList<int> &ThreadBudget::getCores (Stage stage) const
+{
+    return cores[stage];
+}
+
+void ThreadBudget::setNumJobs (int count)
+{
+    numJobs = std::max(1, count);
+}
+
+int ThreadBudget::getNumJobs () const
+{
+    return numJobs;
+}
+
+int ThreadBudget::getNumThreadsPerJob (Stage stage) const
+{
+    return std::max(1, numThreads[stage] / numJobs);
+}
+
+
+QThreadPool *ThreadBudget::getThreadPool (Stage stage)
+{
+    QMutexLocker locker(&threadPoolMutex);
+
+    if (!threadPools[stage]) {
+        threadPools[stage] = new QThreadPool();
+        threadPools[stage]->setMaxThreadCount(numThreads[stage]);
+    }
+
+    return threadPools[stage];
+}
+
+
+void ThreadBudget::applyComputeSettings () const
+{
+    applyGlobalSettings();
+    pinComputeThread();
+}
+
+void ThreadBudget::applyGlobalSettings () const
+{
+    cv::setNumThreads(std::max(numThreads[StageRectify], numThreads[StageMethod]));
+}
+
+void ThreadBudget::pinComputeThread () const
+{
+    QList<int> computeCores = cores[StageRectify];
+    for (int core : cores[StageMethod]) {
+        if (!computeCores.contains(core)) {
+            computeCores.append(core);
+        }
+    }
+    pinCurrentThread(computeCores);
+}
+
+
+void ThreadBudget::print () const
+{
+    qCInfo(mvlStereoProcessor) << "Thread budget:";
+    for (int i = 0; i < NumStages; i++) {
+        QStringList coreList;
+        for (int core : cores[i]) {
+            coreList << QString::number(core);
+        }
+
+        qCInfo(mvlStereoProcessor) << " *" << qPrintable(getStageName(static_cast<Stage>(i))) << ":" << numThreads[i] << "thread(s)" << (coreList.isEmpty() ? QString() : QString("on core(s) %1").arg(coreList.join(",")));
+    }
+    if (numJobs > 1) {
+        qCInfo(mvlStereoProcessor) << " * shared by" << numJobs << "concurrent job(s)";
+    }
+}
+
+
+QString ThreadBudget::getStageName (Stage stage)
+{
+    switch (stage) {
+        case StageDecode: return "decode";
+        case StageRectify: return "rectify";
+        case StageMethod: return "method";
+        case StageWrite: return "write";
+        default: return QString();
+    }
+}
+
+
+// *********************************************************************
+// *                          CPU affinity                             *
+// *********************************************************************
+QList<int> ThreadBudget::parseCpuList (const QString &list)
+{
+    // Linux CPU list format, e.g., 0-3,8,10-11
+    QList<int> cpus;
+
+    for (const QString &token : list.trimmed().split(",", QString::SkipEmptyParts)) {
+        bool okFirst, okLast = true;
+        int first = token.section('-', 0, 0).toInt(&okFirst);
+        int last = first;
+        if (token.contains('-')) {
+            last = token.section('-', 1).toInt(&okLast);
+        }
+
+        if (!okFirst || !okLast || last < first) {
+            throw QString("Invalid CPU list: '%1'").arg(list);
+        }
+
+        for (int cpu = first; cpu <= last; cpu++) {
+            cpus.append(cpu);
+        }
+    }
+
+    return cpus;
+}
+
+QList<int> ThreadBudget::getNumaNodeCpus (int node)
+{
+    QFile file(QString("/sys/devices/system/node/node%1/cpulist").arg(node));
+    if (!file.open(QIODevice::ReadOnly)) {
+        throw QString("Failed to query CPUs of NUMA node %1").arg(node);
+    }
+
+    return parseCpuList(QString::fromLatin1(file.readAll()));
+}
+
+void ThreadBudget::pinCurrentThread (const QList<int> &cores)
+{
+    if (cores.isEmpty()) {
+        return;
+    }
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int core : cores) {
+        CPU_SET(core, &set);
+    }
+
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        qCWarning(mvlStereoProcessor) << "Failed to set thread affinity:" << strerror(ret);
+    }
+}
+
+
+} // StereoProcessor
+} // MVL
@@ -0,0 +1,108 @@
+/*
+ * MVL Stereo Processor: thread budget
+ * Copyright (C) 2014-2016 Rok Mandeljc
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef MVL_STEREO_PROCESSOR__THREAD_BUDGET_H
+#define MVL_STEREO_PROCESSOR__THREAD_BUDGET_H
+
+#include <QtCore>
+
+
+namespace MVL {
+namespace StereoProcessor {
+
+
+// Distribution of threads (and optionally, CPU cores) between processing
+// stages. Decode and write stages run on their own thread pools; the
+// rectification and stereo method stages run on the processing thread,
+// and use OpenCV's internal thread pool, whose size is set accordingly
+// (additional stereo methods, when several are compared, run on the
+// method stage's thread pool).
+//
+// The budget is process-wide; in server mode, it is shared by all
+// concurrently processed jobs, which run their stages on the same thread
+// pools, and size their queues according to their share of threads.
+class ThreadBudget
+{
+public:
+    enum Stage {
+        StageDecode,
+        StageRectify,
+        StageMethod,
+        StageWrite,
+        NumStages,
+    };
+
+    ThreadBudget ();
+    virtual ~ThreadBudget ();
+
+    // Distribute given number of threads (0 for number of CPU cores)
+    // between stages. Per-stage assignment is given as comma-separated
+    // list of stage=count[@cpus] tokens, where cpus is either a list of
+    // CPU cores (e.g., 0-3,8) or a NUMA node (e.g., node1). If pinning
+    // is enabled, stages without explicit CPU list are assigned
+    // consecutive blocks of cores.
+    void configure (int numThreads, const QString &stageAssignment, bool pinThreads);
+
+    int getNumThreads (Stage stage) const;
+    const QList<int> &getCores (Stage stage) const;
+
+    // Number of jobs that share the budget, and per-job share of a
+    // stage's threads
+    void setNumJobs (int numJobs);
+    int getNumJobs () const;
+    int getNumThreadsPerJob (Stage stage) const;
+
+    // Thread pool for given stage, sized according to budget
+    QThreadPool *getThreadPool (Stage stage);
+
+    // Set OpenCV's thread count for compute stages, and pin the calling
+    // (processing) thread to their cores; threads of OpenCV's pool that
+    // are spawned afterwards inherit the affinity
+    void applyComputeSettings () const;
+
+    // The two parts of the above; OpenCV's thread count is a global
+    // setting (applied once per process), while pinning applies to the
+    // calling thread only (applied by each job's processing thread)
+    void applyGlobalSettings () const;
+    void pinComputeThread () const;
+
+    void print () const;
+
+    static QString getStageName (Stage stage);
+
+    static QList<int> parseCpuList (const QString &list);
+    static QList<int> getNumaNodeCpus (int node);
+    static void pinCurrentThread (const QList<int> &cores);
+
+protected:
+    int numThreads[NumStages];
+    QList<int> cores[NumStages];
+    int numJobs;
+
+    // Thread pools are created on demand, possibly by several jobs
+    QMutex threadPoolMutex;
+    QThreadPool *threadPools[NumStages];
+};
+
+
+} // StereoProcessor
+} // MVL
+
+
+#endif
@@ -19,11 +19,36 @@
 
 #include "utils.h"
 
+#include <opencv2/core/utility.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
 namespace MVL {
 namespace StereoProcessor {
 namespace Utils {
 
 
+class FunctionRunnable : public QRunnable
+{
+public:
+    FunctionRunnable (const std::function<void ()> &function)
+        : QRunnable(), function(function)
+    {
+        setAutoDelete(true);
+    }
+
+    virtual void run ()
+    {
+        function();
+    }
+
+protected:
+    std::function<void ()> function;
+};
+
+
 // Universal string formatter
 QString formatString (const QString &format, const QHash<QString, QVariant> &dictionary)
 {
@@ -91,6 +116,217 @@ void ensureParentDirectoryExists (const QString &filename)
 }
 
 
+// Find largest axis-aligned rectangle that contains only valid
+// (non-zero) pixels of the given 8-bit mask
+cv::Rect findValidRegion (const cv::Mat &mask)
+{
+    // Start with full image, and greedily shrink the border that
+    // contains the largest number of invalid pixels, until all
+    // borders are valid. This is not guaranteed to find the optimal
+    // rectangle, but works well for the convex-ish valid regions
+    // produced by rectification
+    cv::Rect roi(0, 0, mask.cols, mask.rows);
+
+    while (roi.width > 0 && roi.height > 0) {
+        int invalidTop = roi.width - cv::countNonZero(mask(cv::Rect(roi.x, roi.y, roi.width, 1)));
+        int invalidBottom = roi.width - cv::countNonZero(mask(cv::Rect(roi.x, roi.y + roi.height - 1, roi.width, 1)));
+        int invalidLeft = roi.height - cv::countNonZero(mask(cv::Rect(roi.x, roi.y, 1, roi.height)));
+        int invalidRight = roi.height - cv::countNonZero(mask(cv::Rect(roi.x + roi.width - 1, roi.y, 1, roi.height)));
+
+        int invalidMax = std::max(std::max(invalidTop, invalidBottom), std::max(invalidLeft, invalidRight));
+        if (invalidMax == 0) {
+            break;
+        }
+
+        if (invalidMax == invalidTop) {
+            roi.y++;
+            roi.height--;
+        } else if (invalidMax == invalidBottom) {
+            roi.height--;
+        } else if (invalidMax == invalidLeft) {
+            roi.x++;
+            roi.width--;
+        } else {
+            roi.width--;
+        }
+    }
+
+    return roi;
+}
+
+
+// Depth from disparity; equivalent to the Z/W component of full
+// reprojection, but computed in a single pass over rows, without
+// producing the 3-channel point matrix
+void computeDepthFromDisparity (const cv::Mat &disparity, const cv::Mat &reprojectionMatrix, cv::Mat &depth)
+{
+    cv::Mat disparityFloat;
+    if (disparity.type() == CV_32FC1) {
+        disparityFloat = disparity;
+    } else {
+        disparity.convertTo(disparityFloat, CV_32F);
+    }
+
+    cv::Mat Q;
+    reprojectionMatrix.convertTo(Q, CV_64F);
+
+    // Z = (q20*x + q21*y + q22*d + q23) / (q30*x + q31*y + q32*d + q33)
+    const double q20 = Q.at<double>(2, 0), q21 = Q.at<double>(2, 1), q22 = Q.at<double>(2, 2), q23 = Q.at<double>(2, 3);
+    const double q30 = Q.at<double>(3, 0), q31 = Q.at<double>(3, 1), q32 = Q.at<double>(3, 2), q33 = Q.at<double>(3, 3);
+
+    depth.create(disparityFloat.size(), CV_32FC1);
+
+    cv::parallel_for_(cv::Range(0, disparityFloat.rows), [&] (const cv::Range &rows) {
+        for (int y = rows.start; y < rows.end; y++) {
+            const float *d = disparityFloat.ptr<float>(y);
+            float *z = depth.ptr<float>(y);
+
+            for (int x = 0; x < disparityFloat.cols; x++) {
+                double w = q30*x + q31*y + q32*d[x] + q33;
+
+                if (d[x] <= 0 || w == 0) {
+                    z[x] = std::numeric_limits<float>::quiet_NaN();
+                } else {
+                    z[x] = static_cast<float>((q20*x + q21*y + q22*d[x] + q23) / w);
+                }
+            }
+        }
+    });
+}
+
+
+// Compute disparity statistics
+void computeDisparityStatistics (const cv::Mat &disparity, int numDisparities, const cv::Mat &reprojectionMatrix, int numBins, double nearDistance, DisparityStatistics &statistics)
+{
+    cv::Mat disparityFloat;
+    if (disparity.type() == CV_32FC1) {
+        disparityFloat = disparity;
+    } else {
+        disparity.convertTo(disparityFloat, CV_32F);
+    }
+
+    // Disparity range; if number of disparities is not known, use the
+    // largest disparity, bounded by the image width (which no valid
+    // disparity can exceed), so that infinite or garbage values cannot
+    // blow up the size of the fine histogram
+    double maxDisparity = numDisparities;
+    if (maxDisparity <= 0) {
+        cv::minMaxLoc(disparityFloat, 0, &maxDisparity);
+        if (!std::isfinite(maxDisparity) || maxDisparity > disparityFloat.cols) {
+            maxDisparity = disparityFloat.cols;
+        }
+        maxDisparity = std::max(maxDisparity, 1.0);
+    }
+
+    // Median is determined from a fine histogram, with sub-pixel bins
+    const int subPixelBins = 16;
+    const int numFineBins = static_cast<int>(std::ceil(maxDisparity * subPixelBins)) + 1;
+    const double binScale = numBins / maxDisparity;
+
+    cv::Mat Q;
+    bool haveDepth = !reprojectionMatrix.empty();
+    if (haveDepth) {
+        reprojectionMatrix.convertTo(Q, CV_64F);
+    } else {
+        Q = cv::Mat::zeros(4, 4, CV_64F);
+    }
+    bool countNear = haveDepth && nearDistance > 0;
+
+    const double q20 = Q.at<double>(2, 0), q21 = Q.at<double>(2, 1), q22 = Q.at<double>(2, 2), q23 = Q.at<double>(2, 3);
+    const double q30 = Q.at<double>(3, 0), q31 = Q.at<double>(3, 1), q32 = Q.at<double>(3, 2), q33 = Q.at<double>(3, 3);
+
+    std::vector<int> fineHistogram(numFineBins, 0);
+    statistics.numPixels = disparityFloat.rows * disparityFloat.cols;
+    statistics.numValid = 0;
+    statistics.histogram = QVector<int>(numBins, 0);
+    statistics.numNear = countNear ? 0 : -1;
+
+    // Each stripe accumulates into its own histograms, which are merged
+    // at the end of the stripe
+    QMutex mutex;
+
+    cv::parallel_for_(cv::Range(0, disparityFloat.rows), [&] (const cv::Range &rows) {
+        std::vector<int> localFine(numFineBins, 0);
+        std::vector<int> localHistogram(numBins, 0);
+        int localValid = 0;
+        int localNear = 0;
+
+        for (int y = rows.start; y < rows.end; y++) {
+            const float *d = disparityFloat.ptr<float>(y);
+
+            for (int x = 0; x < disparityFloat.cols; x++) {
+                if (!std::isfinite(d[x]) || d[x] <= 0) {
+                    continue;
+                }
+
+                // Bins are clamped before conversion, as disparities
+                // beyond the range may not fit into an int
+                localValid++;
+                localFine[static_cast<int>(std::min<double>(d[x] * subPixelBins, numFineBins - 1))]++;
+                localHistogram[static_cast<int>(std::min<double>(d[x] * binScale, numBins - 1))]++;
+
+                if (countNear) {
+                    double w = q30*x + q31*y + q32*d[x] + q33;
+                    if (w != 0) {
+                        double z = (q20*x + q21*y + q22*d[x] + q23) / w;
+                        localNear += (z > 0 && z < nearDistance);
+                    }
+                }
+            }
+        }
+
+        QMutexLocker locker(&mutex);
+        for (int i = 0; i < numFineBins; i++) {
+            fineHistogram[i] += localFine[i];
+        }
+        for (int i = 0; i < numBins; i++) {
+            statistics.histogram[i] += localHistogram[i];
+        }
+        statistics.numValid += localValid;
+        if (countNear) {
+            statistics.numNear += localNear;
+        }
+    });
+
+    // Median disparity
+    statistics.medianDisparity = std::numeric_limits<double>::quiet_NaN();
+    statistics.medianDepth = std::numeric_limits<double>::quiet_NaN();
+
+    if (!statistics.numValid) {
+        return;
+    }
+
+    int cumulative = 0;
+    for (int i = 0; i < numFineBins; i++) {
+        cumulative += fineHistogram[i];
+        if (2*cumulative >= statistics.numValid) {
+            statistics.medianDisparity = (i + 0.5) / subPixelBins;
+            break;
+        }
+    }
+
+    // For a rectified pair, depth depends only on disparity (and
+    // decreases with it), so median depth is the depth of median
+    // disparity; evaluated at the image centre
+    if (haveDepth) {
+        double x = disparityFloat.cols / 2.0;
+        double y = disparityFloat.rows / 2.0;
+        double d = statistics.medianDisparity;
+        double w = q30*x + q31*y + q32*d + q33;
+        if (w != 0) {
+            statistics.medianDepth = (q20*x + q21*y + q22*d + q23) / w;
+        }
+    }
+}
+
+
+// Run function on given thread pool
+void runInThreadPool (QThreadPool *pool, const std::function<void ()> &function)
+{
+    pool->start(new FunctionRunnable(function));
+}
+
+
 } // Utils
 } // StereoProcessor
 } // MVL
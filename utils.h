@@ -21,6 +21,9 @@
 #define MVL_STEREO_PROCESSOR__UTILS_H
 
 #include <QtCore>
+#include <opencv2/core.hpp>
+
+#include <functional>
 
 
 namespace MVL {
@@ -33,6 +36,39 @@ QString formatString (const QString &format, const QHash<QString, QVariant> &dic
 // Create parent directory if it does not exist
 void ensureParentDirectoryExists (const QString &filename);
 
+// Find largest axis-aligned rectangle that contains only valid
+// (non-zero) pixels of the given 8-bit mask
+cv::Rect findValidRegion (const cv::Mat &mask);
+
+// Compute depth (Z coordinate) from disparity, using the 4x4
+// reprojection matrix; invalid disparities yield NaN
+void computeDepthFromDisparity (const cv::Mat &disparity, const cv::Mat &reprojectionMatrix, cv::Mat &depth);
+
+// Per-frame summary statistics of disparity
+struct DisparityStatistics {
+    int numPixels;
+    int numValid;
+
+    // Histogram of valid disparities over [0, numDisparities)
+    QVector<int> histogram;
+
+    // Median of valid disparities and corresponding depth (NaN if not
+    // available)
+    double medianDisparity;
+    double medianDepth;
+
+    // Number of valid pixels closer than near distance (-1 if not
+    // computed)
+    int numNear;
+};
+
+// Compute disparity statistics in a single parallel pass; depth-related
+// values require reprojection matrix
+void computeDisparityStatistics (const cv::Mat &disparity, int numDisparities, const cv::Mat &reprojectionMatrix, int numBins, double nearDistance, DisparityStatistics &statistics);
+
+// Run function on given thread pool
+void runInThreadPool (QThreadPool *pool, const std::function<void ()> &function);
+
 
 } // Utils
 } // StereoProcessor